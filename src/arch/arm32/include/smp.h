@@ -21,11 +21,38 @@ static inline int smp_processor_id(void)
 		: "memory");
 	return tmp;
 }
+
+/*
+ * Entered with irqs masked. A masked irq does not end a wfe, so they are
+ * unmasked around it, an irq taken in between resumes tasks with a sev.
+ */
+static inline void arch_cpu_idle(void)
+{
+	__asm__ __volatile__("cpsie i\n" "wfe\n" "cpsid i\n" : : : "memory");
+}
+
+static inline void arch_cpu_wakeup(void)
+{
+	__asm__ __volatile__("dsb\n" "sev\n" : : : "memory");
+}
 #else
 static inline int smp_processor_id(void)
 {
 	return 0;
 }
+
+static inline void arch_cpu_idle(void)
+{
+#if defined(__ARM_ARCH) && (__ARM_ARCH >= 7)
+	__asm__ __volatile__("wfi" : : : "memory");
+#else
+	__asm__ __volatile__("mcr p15, 0, %0, c7, c0, 4" : : "r" (0) : "memory");
+#endif
+}
+
+static inline void arch_cpu_wakeup(void)
+{
+}
 #endif
 
 #ifdef __cplusplus
@@ -13,11 +13,34 @@ static inline int smp_processor_id(void)
 {
 	return arm64_read_sysreg(tpidrro_el0);
 }
+
+/*
+ * Entered with irqs masked. A masked irq does not end a wfe, so they are
+ * unmasked around it, an irq taken in between resumes tasks with a sev.
+ */
+static inline void arch_cpu_idle(void)
+{
+	__asm__ __volatile__("msr daifclr, #2\n" "wfe\n" "msr daifset, #2\n" : : : "memory");
+}
+
+static inline void arch_cpu_wakeup(void)
+{
+	__asm__ __volatile__("dsb sy\n" "sev\n" : : : "memory");
+}
 #else
 static inline int smp_processor_id(void)
 {
 	return 0;
 }
+
+static inline void arch_cpu_idle(void)
+{
+	__asm__ __volatile__("wfi" : : : "memory");
+}
+
+static inline void arch_cpu_wakeup(void)
+{
+}
 #endif
 
 #ifdef __cplusplus
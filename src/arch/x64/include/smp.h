@@ -12,11 +12,29 @@ static inline int smp_processor_id(void)
 {
 	return 0;
 }
+
+static inline void arch_cpu_idle(void)
+{
+	__asm__ __volatile__("pause" : : : "memory");
+}
+
+static inline void arch_cpu_wakeup(void)
+{
+}
 #else
 static inline int smp_processor_id(void)
 {
 	return 0;
 }
+
+static inline void arch_cpu_idle(void)
+{
+	__asm__ __volatile__("pause" : : : "memory");
+}
+
+static inline void arch_cpu_wakeup(void)
+{
+}
 #endif
 
 #ifdef __cplusplus
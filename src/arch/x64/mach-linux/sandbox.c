@@ -57,6 +57,11 @@ static void mach_sleep(struct machine_t * mach)
 	sandbox_pm_sleep();
 }
 
+static void mach_idle(struct machine_t * mach)
+{
+	sandbox_pm_idle();
+}
+
 static void mach_cleanup(struct machine_t * mach)
 {
 }
@@ -85,6 +90,7 @@ static struct machine_t sandbox = {
 	.shutdown	= mach_shutdown,
 	.reboot		= mach_reboot,
 	.sleep		= mach_sleep,
+	.idle		= mach_idle,
 	.cleanup	= mach_cleanup,
 	.logger		= mach_logger,
 	.uniqueid	= mach_uniqueid,
@@ -18,3 +18,14 @@ void sandbox_pm_sleep(void)
 	sync();
 	sandbox_sysfs_write_string("/sys/power/state", "mem");
 }
+
+/*
+ * Block until the host timer signal arrives, capped at 10ms so that a
+ * wakeup raced in just before the call is never delayed for long.
+ */
+void sandbox_pm_idle(void)
+{
+	struct timespec ts = { 0, 10000000 };
+
+	nanosleep(&ts, NULL);
+}
@@ -302,6 +302,7 @@ void sandbox_meminfo(size_t * mused, size_t * mfree);
 void sandbox_pm_shutdown(void);
 void sandbox_pm_reboot(void);
 void sandbox_pm_sleep(void);
+void sandbox_pm_idle(void);
 
 /*
  * Shell interface
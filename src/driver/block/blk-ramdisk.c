@@ -57,6 +57,12 @@ static void blk_ramdisk_sync(struct block_t * blk)
 {
 }
 
+static void * blk_ramdisk_mmap(struct block_t * blk)
+{
+	struct blk_ramdisk_pdata_t * pdat = (struct blk_ramdisk_pdata_t *)(blk->priv);
+	return (void *)pdat->addr;
+}
+
 static struct device_t * blk_ramdisk_probe(struct driver_t * drv, struct dtnode_t * n)
 {
 	struct blk_ramdisk_pdata_t * pdat;
@@ -90,6 +96,8 @@ static struct device_t * blk_ramdisk_probe(struct driver_t * drv, struct dtnode_
 	blk->read = blk_ramdisk_read;
 	blk->write = blk_ramdisk_write;
 	blk->sync = blk_ramdisk_sync;
+	blk->submit = NULL;
+	blk->mmap = blk_ramdisk_mmap;
 	blk->priv = pdat;
 
 	if(!(dev = register_block(blk, drv)))
@@ -99,6 +107,7 @@ static struct device_t * blk_ramdisk_probe(struct driver_t * drv, struct dtnode_
 		free(blk);
 		return NULL;
 	}
+	block_cache_resize(blk, 0);
 	return dev;
 }
 
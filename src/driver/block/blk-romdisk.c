@@ -53,6 +53,12 @@ static void blk_romdisk_sync(struct block_t * blk)
 {
 }
 
+static void * blk_romdisk_mmap(struct block_t * blk)
+{
+	struct blk_romdisk_pdata_t * pdat = (struct blk_romdisk_pdata_t *)(blk->priv);
+	return (void *)pdat->addr;
+}
+
 static struct device_t * blk_romdisk_probe(struct driver_t * drv, struct dtnode_t * n)
 {
 	struct blk_romdisk_pdata_t * pdat;
@@ -86,6 +92,8 @@ static struct device_t * blk_romdisk_probe(struct driver_t * drv, struct dtnode_
 	blk->read = blk_romdisk_read;
 	blk->write = blk_romdisk_write;
 	blk->sync = blk_romdisk_sync;
+	blk->submit = NULL;
+	blk->mmap = blk_romdisk_mmap;
 	blk->priv = pdat;
 
 	if(!(dev = register_block(blk, drv)))
@@ -95,6 +103,7 @@ static struct device_t * blk_romdisk_probe(struct driver_t * drv, struct dtnode_
 		free(blk);
 		return NULL;
 	}
+	block_cache_resize(blk, 0);
 	return dev;
 }
 
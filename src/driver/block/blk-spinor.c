@@ -738,6 +738,8 @@ static struct device_t * blk_spinor_probe(struct driver_t * drv, struct dtnode_t
 	blk->read = blk_spinor_read;
 	blk->write = blk_spinor_write;
 	blk->sync = blk_spinor_sync;
+	blk->submit = NULL;
+	blk->mmap = NULL;
 	blk->priv = pdat;
 	blk_spinor_init(pdat);
 
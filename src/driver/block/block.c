@@ -73,6 +73,658 @@ static void sub_block_sync(struct block_t * blk)
 	pblk->sync(pblk);
 }
 
+/*
+ * Buffer cache, one per physical device. Sub blocks are translated to their
+ * parent so that partitions share the cache of the underlying media.
+ */
+struct block_buffer_t
+{
+	struct hlist_node node;
+	struct list_head entry;
+	u64_t blkno;
+	int dirty;
+	u8_t * data;
+};
+
+struct block_cache_t
+{
+	struct mutex_t lock;
+	struct hlist_head * hash;
+	struct list_head lru;
+	u8_t * bounce;
+	u8_t * scratch;
+	u64_t hsize;
+	u64_t capacity;
+	u64_t nbuf;
+	u64_t ndirty;
+	u64_t ramax;
+	u64_t ra;
+	u64_t next;
+
+	u64_t hit;
+	u64_t miss;
+	u64_t readahead;
+	u64_t writeback;
+
+	spinlock_t qlock;
+	struct list_head queue;
+	struct work_t work;
+	u64_t qpos;
+	u64_t queued;
+	u64_t merged;
+};
+
+static inline struct block_buffer_t * block_cache_find(struct block_cache_t * c, u64_t blkno)
+{
+	struct block_buffer_t * b;
+
+	hlist_for_each_entry(b, &c->hash[(blkno ^ (blkno >> 16)) & (c->hsize - 1)], node)
+	{
+		if(b->blkno == blkno)
+			return b;
+	}
+	return NULL;
+}
+
+static inline struct block_buffer_t * block_cache_lookup(struct block_cache_t * c, u64_t blkno)
+{
+	struct block_buffer_t * b = block_cache_find(c, blkno);
+
+	if(b)
+		list_move(&b->entry, &c->lru);
+	return b;
+}
+
+static inline void block_cache_overlay(struct block_t * blk, struct block_cache_t * c, u8_t * buf, u64_t blkno, u64_t n)
+{
+	struct block_buffer_t * b;
+	u64_t i;
+
+	for(i = 0; (i < n) && c->capacity; i++)
+	{
+		b = block_cache_find(c, blkno + i);
+		if(b && b->dirty)
+			memcpy(&buf[i * block_size(blk)], b->data, block_size(blk));
+	}
+}
+
+static inline void block_cache_update(struct block_t * blk, struct block_cache_t * c, u8_t * buf, u64_t blkno, u64_t n)
+{
+	struct block_buffer_t * b;
+	u64_t i;
+
+	for(i = 0; (i < n) && c->capacity; i++)
+	{
+		b = block_cache_find(c, blkno + i);
+		if(b)
+		{
+			memcpy(b->data, &buf[i * block_size(blk)], block_size(blk));
+			if(b->dirty)
+			{
+				b->dirty = 0;
+				c->ndirty--;
+			}
+		}
+	}
+}
+
+static struct block_buffer_t * block_cache_get(struct block_t * blk, struct block_cache_t * c, u64_t blkno)
+{
+	struct block_buffer_t * b;
+
+	if(c->nbuf < c->capacity)
+	{
+		b = malloc(sizeof(struct block_buffer_t) + block_size(blk));
+		if(!b)
+			return NULL;
+		b->data = (u8_t *)(b + 1);
+		c->nbuf++;
+	}
+	else
+	{
+		b = list_last_entry(&c->lru, struct block_buffer_t, entry);
+		if(b->dirty)
+		{
+			if(blk->write(blk, b->data, b->blkno, 1) != 1)
+				return NULL;
+			b->dirty = 0;
+			c->ndirty--;
+			c->writeback++;
+		}
+		hlist_del(&b->node);
+		list_del(&b->entry);
+	}
+	b->blkno = blkno;
+	b->dirty = 0;
+	hlist_add_head(&b->node, &c->hash[(blkno ^ (blkno >> 16)) & (c->hsize - 1)]);
+	list_add(&b->entry, &c->lru);
+	return b;
+}
+
+/*
+ * Read a run of blocks through the scratch buffer and keep the ones not yet
+ * cached. The first block always stays available in the scratch buffer.
+ */
+static u64_t block_cache_fill(struct block_t * blk, struct block_cache_t * c, u64_t blkno, u64_t n)
+{
+	struct block_buffer_t * b;
+	u64_t blksz = block_size(blk);
+	u64_t r, i;
+
+	r = blk->read(blk, c->scratch, blkno, n);
+	if(r > n)
+		r = n;
+	for(i = r; i > 0; i--)
+	{
+		if(!block_cache_find(c, blkno + i - 1))
+		{
+			b = block_cache_get(blk, c, blkno + i - 1);
+			if(b)
+				memcpy(b->data, &c->scratch[(i - 1) * blksz], blksz);
+		}
+	}
+	return r;
+}
+
+static int block_buffer_cmp(const void * a, const void * b)
+{
+	u64_t x = (*(struct block_buffer_t **)a)->blkno;
+	u64_t y = (*(struct block_buffer_t **)b)->blkno;
+	return (x < y) ? -1 : ((x > y) ? 1 : 0);
+}
+
+/*
+ * Write back all dirty buffers in block order, merging adjacent ones into a
+ * single driver request of at most the readahead window.
+ */
+static void block_cache_flush(struct block_t * blk, struct block_cache_t * c)
+{
+	struct block_buffer_t ** v, * b;
+	u64_t blksz = block_size(blk);
+	u64_t n = 0, i, j, k;
+
+	if(c->ndirty == 0)
+		return;
+	v = malloc(sizeof(struct block_buffer_t *) * c->ndirty);
+	if(v)
+	{
+		list_for_each_entry(b, &c->lru, entry)
+		{
+			if(b->dirty && (n < c->ndirty))
+				v[n++] = b;
+		}
+		qsort(v, n, sizeof(struct block_buffer_t *), block_buffer_cmp);
+		for(i = 0; i < n; i = j)
+		{
+			for(j = i + 1; (j < n) && (j - i < c->ramax) && (v[j]->blkno == v[j - 1]->blkno + 1); j++);
+			for(k = i; k < j; k++)
+				memcpy(&c->scratch[(k - i) * blksz], v[k]->data, blksz);
+			if(blk->write(blk, c->scratch, v[i]->blkno, j - i) == j - i)
+			{
+				for(k = i; k < j; k++)
+					v[k]->dirty = 0;
+				c->ndirty -= j - i;
+				c->writeback += j - i;
+			}
+		}
+		free(v);
+	}
+	else
+	{
+		list_for_each_entry(b, &c->lru, entry)
+		{
+			if(b->dirty && (blk->write(blk, b->data, b->blkno, 1) == 1))
+			{
+				b->dirty = 0;
+				c->ndirty--;
+				c->writeback++;
+			}
+		}
+	}
+}
+
+static void block_cache_drop(struct block_cache_t * c)
+{
+	struct block_buffer_t * b, * n;
+
+	list_for_each_entry_safe(b, n, &c->lru, entry)
+	{
+		if(!b->dirty)
+		{
+			hlist_del(&b->node);
+			list_del(&b->entry);
+			free(b);
+			c->nbuf--;
+		}
+	}
+}
+
+static void block_cache_setup(struct block_t * blk, struct block_cache_t * c, u64_t size)
+{
+	u64_t blksz = block_size(blk);
+	u64_t i;
+
+	block_cache_flush(blk, c);
+	block_cache_drop(c);
+	if(c->nbuf > 0)
+		return;
+	if(c->hash)
+	{
+		free(c->hash);
+		c->hash = NULL;
+	}
+	if(c->scratch)
+	{
+		free(c->scratch);
+		c->scratch = NULL;
+	}
+	c->capacity = 0;
+	c->ra = 0;
+	c->next = 0;
+	if(!blksz || (size / blksz < 2))
+		return;
+
+	c->ramax = CONFIG_BLOCK_READAHEAD_SIZE / blksz;
+	if(c->ramax > size / blksz / 2)
+		c->ramax = size / blksz / 2;
+	if(c->ramax < 1)
+		c->ramax = 1;
+	for(c->hsize = 16; c->hsize < size / blksz; c->hsize <<= 1);
+	c->hash = malloc(sizeof(struct hlist_head) * c->hsize);
+	c->scratch = malloc(c->ramax * blksz);
+	if(!c->hash || !c->scratch)
+	{
+		free(c->hash);
+		free(c->scratch);
+		c->hash = NULL;
+		c->scratch = NULL;
+		return;
+	}
+	for(i = 0; i < c->hsize; i++)
+		init_hlist_head(&c->hash[i]);
+	c->capacity = size / blksz;
+}
+
+static inline u64_t block_request_io(struct block_t * blk, struct block_request_t * req)
+{
+	if(blk->submit)
+		return blk->submit(blk, req);
+	if(req->write)
+		return blk->write(blk, req->buf, req->blkno, req->blkcnt);
+	return blk->read(blk, req->buf, req->blkno, req->blkcnt);
+}
+
+/*
+ * Transfer a run of adjacent requests with one driver call, either in place
+ * when their buffers are contiguous or through the readahead scratch.
+ */
+static void block_queue_dispatch(struct block_t * blk, struct block_cache_t * c, struct list_head * run)
+{
+	struct block_request_t * first = list_first_entry(run, struct block_request_t, entry);
+	struct block_request_t * r, io;
+	u64_t blksz = block_size(blk);
+	u64_t done, n = 0;
+	u8_t * p = first->buf;
+	int contig = 1;
+
+	list_for_each_entry(r, run, entry)
+	{
+		if(r->buf != p)
+			contig = 0;
+		p = r->buf + r->blkcnt * blksz;
+		n += r->blkcnt;
+	}
+	io.write = first->write;
+	io.blkno = first->sector;
+	io.blkcnt = n;
+	io.buf = contig ? first->buf : c->scratch;
+	io.sector = first->sector;
+	if(!contig && io.write)
+	{
+		p = io.buf;
+		list_for_each_entry(r, run, entry)
+		{
+			memcpy(p, r->buf, r->blkcnt * blksz);
+			p += r->blkcnt * blksz;
+		}
+	}
+	done = block_request_io(blk, &io);
+	if(done > n)
+		done = n;
+	if(io.write)
+		block_cache_update(blk, c, io.buf, io.blkno, done);
+	else
+		block_cache_overlay(blk, c, io.buf, io.blkno, done);
+	p = io.buf;
+	list_for_each_entry(r, run, entry)
+	{
+		r->done = (done > r->blkcnt) ? r->blkcnt : done;
+		done -= r->done;
+		if(!contig && !io.write)
+			memcpy(r->buf, p, r->done * blksz);
+		p += r->blkcnt * blksz;
+	}
+}
+
+/*
+ * One-way elevator, serve the lowest sector at or above the last position
+ * and wrap around, merging adjacent requests of the same direction.
+ */
+static void block_queue_run(struct block_t * blk, struct block_cache_t * c)
+{
+	struct block_request_t * r, * n, * first;
+	struct list_head run;
+	irq_flags_t flags;
+	u64_t blksz = block_size(blk);
+	u64_t end, cnt;
+	u8_t * p;
+	int contig;
+
+	while(1)
+	{
+		init_list_head(&run);
+		mutex_lock(&c->lock);
+		spin_lock_irqsave(&c->qlock, flags);
+		if(list_empty(&c->queue))
+		{
+			spin_unlock_irqrestore(&c->qlock, flags);
+			mutex_unlock(&c->lock);
+			break;
+		}
+		first = list_first_entry(&c->queue, struct block_request_t, entry);
+		list_for_each_entry(r, &c->queue, entry)
+		{
+			if(r->sector >= c->qpos)
+			{
+				first = r;
+				break;
+			}
+		}
+		end = first->sector + first->blkcnt;
+		cnt = first->blkcnt;
+		p = first->buf + first->blkcnt * blksz;
+		contig = 1;
+		r = list_next_entry(first, entry);
+		list_move_tail(&first->entry, &run);
+		while(&r->entry != &c->queue)
+		{
+			n = list_next_entry(r, entry);
+			if((r->write != first->write) || (r->sector != end))
+				break;
+			contig = contig && (r->buf == p);
+			if(!contig && (!c->scratch || (cnt + r->blkcnt > c->ramax)))
+				break;
+			end += r->blkcnt;
+			cnt += r->blkcnt;
+			p = r->buf + r->blkcnt * blksz;
+			list_move_tail(&r->entry, &run);
+			c->merged++;
+			r = n;
+		}
+		c->qpos = end;
+		spin_unlock_irqrestore(&c->qlock, flags);
+		block_queue_dispatch(blk, c, &run);
+		mutex_unlock(&c->lock);
+
+		list_for_each_entry_safe(r, n, &run, entry)
+		{
+			list_del_init(&r->entry);
+			if(r->complete)
+				r->complete(r);
+		}
+	}
+}
+
+static void block_queue_work(struct work_t * work, void * data)
+{
+	struct block_t * blk = (struct block_t *)data;
+
+	if(blk->cache)
+		block_queue_run(blk, blk->cache);
+}
+
+static struct block_cache_t * block_cache_alloc(struct block_t * blk, u64_t size)
+{
+	struct block_cache_t * c;
+
+	c = malloc(sizeof(struct block_cache_t));
+	if(!c)
+		return NULL;
+	memset(c, 0, sizeof(struct block_cache_t));
+	c->bounce = malloc(block_size(blk));
+	if(!c->bounce)
+	{
+		free(c);
+		return NULL;
+	}
+	mutex_init(&c->lock);
+	init_list_head(&c->lru);
+	spin_lock_init(&c->qlock);
+	init_list_head(&c->queue);
+	work_init(&c->work, block_queue_work, NULL, blk);
+	block_cache_setup(blk, c, size);
+	return c;
+}
+
+static void block_cache_free(struct block_t * blk, struct block_cache_t * c)
+{
+	struct block_buffer_t * b, * n;
+
+	if(c)
+	{
+		work_flush(&c->work);
+		work_cancel(&c->work);
+		block_queue_run(blk, c);
+		mutex_lock(&c->lock);
+		block_cache_flush(blk, c);
+		list_for_each_entry_safe(b, n, &c->lru, entry)
+			free(b);
+		free(c->hash);
+		free(c->scratch);
+		free(c->bounce);
+		mutex_unlock(&c->lock);
+		free(c);
+	}
+}
+
+static inline struct block_t * block_root(struct block_t * blk, u64_t * offset)
+{
+	struct sub_block_pdata_t * pdat;
+
+	while(blk->read == sub_block_read)
+	{
+		pdat = (struct sub_block_pdata_t *)(blk->priv);
+		if(offset)
+			*offset += block_offset(blk, pdat->blkno);
+		blk = pdat->pblk;
+	}
+	return blk;
+}
+
+static u64_t block_cache_read(struct block_t * blk, struct block_cache_t * c, u8_t * buf, u64_t offset, u64_t count)
+{
+	struct block_buffer_t * b;
+	u64_t blksz = block_size(blk);
+	u64_t blkno = offset / blksz;
+	u64_t o = offset % blksz;
+	u64_t ret = 0;
+	u64_t len, n, i;
+
+	while(count > 0)
+	{
+		len = blksz - o;
+		if(count < len)
+			len = count;
+		if((b = block_cache_lookup(c, blkno)))
+		{
+			memcpy(buf, &b->data[o], len);
+			c->hit++;
+		}
+		else if((o == 0) && (count / blksz >= c->ramax))
+		{
+			n = count / blksz;
+			if(blk->read(blk, buf, blkno, n) != n)
+				break;
+			block_cache_overlay(blk, c, buf, blkno, n);
+			c->miss += n;
+			c->next = blkno + n;
+			len = n * blksz;
+			buf += len;
+			count -= len;
+			ret += len;
+			blkno += n;
+			continue;
+		}
+		else
+		{
+			if(blkno == c->next)
+				c->ra = (c->ra > 0) ? c->ra << 1 : 4;
+			else
+				c->ra = 0;
+			if(c->ra > c->ramax)
+				c->ra = c->ramax;
+			n = (o + count + blksz - 1) / blksz;
+			if(n < c->ra)
+				n = c->ra;
+			if(n > c->ramax)
+				n = c->ramax;
+			n = block_available_count(blk, blkno, n);
+			for(i = 1; (i < n) && !block_cache_find(c, blkno + i); i++);
+			n = i;
+			if(block_cache_fill(blk, c, blkno, n) == 0)
+				break;
+			if(n * blksz > o + count)
+				c->readahead += n - (o + count + blksz - 1) / blksz;
+			memcpy(buf, &c->scratch[o], len);
+			c->miss++;
+		}
+		c->next = blkno + 1;
+		buf += len;
+		count -= len;
+		ret += len;
+		blkno += 1;
+		o = 0;
+	}
+	return ret;
+}
+
+static u64_t block_cache_write(struct block_t * blk, struct block_cache_t * c, u8_t * buf, u64_t offset, u64_t count)
+{
+	struct block_buffer_t * b;
+	u64_t blksz = block_size(blk);
+	u64_t blkno = offset / blksz;
+	u64_t o = offset % blksz;
+	u64_t ret = 0;
+	u64_t len, n;
+
+	while(count > 0)
+	{
+		len = blksz - o;
+		if(count < len)
+			len = count;
+		if((o == 0) && (count / blksz >= c->ramax))
+		{
+			n = count / blksz;
+			if(blk->write(blk, buf, blkno, n) != n)
+				break;
+			block_cache_update(blk, c, buf, blkno, n);
+			len = n * blksz;
+			buf += len;
+			count -= len;
+			ret += len;
+			blkno += n;
+			continue;
+		}
+		if((b = block_cache_lookup(c, blkno)))
+		{
+			c->hit++;
+		}
+		else
+		{
+			if(len < blksz)
+			{
+				if(block_cache_fill(blk, c, blkno, 1) != 1)
+					break;
+				b = block_cache_lookup(c, blkno);
+			}
+			else
+			{
+				b = block_cache_get(blk, c, blkno);
+			}
+			c->miss++;
+			if(!b)
+			{
+				if(len < blksz)
+				{
+					memcpy(&c->scratch[o], buf, len);
+					if(blk->write(blk, c->scratch, blkno, 1) != 1)
+						break;
+				}
+				else if(blk->write(blk, buf, blkno, 1) != 1)
+				{
+					break;
+				}
+				buf += len;
+				count -= len;
+				ret += len;
+				blkno += 1;
+				o = 0;
+				continue;
+			}
+		}
+		memcpy(&b->data[o], buf, len);
+		if(!b->dirty)
+		{
+			b->dirty = 1;
+			c->ndirty++;
+		}
+		buf += len;
+		count -= len;
+		ret += len;
+		blkno += 1;
+		o = 0;
+	}
+	if(c->ndirty > (c->capacity >> 1))
+		block_cache_flush(blk, c);
+	return ret;
+}
+
+static ssize_t block_read_cachesize(struct kobj_t * kobj, void * buf, size_t size)
+{
+	struct block_t * blk = (struct block_t *)kobj->priv;
+	struct block_cache_t * c = blk->cache;
+	return sprintf(buf, "%lld", c ? c->capacity * block_size(blk) : 0);
+}
+
+static ssize_t block_write_cachesize(struct kobj_t * kobj, void * buf, size_t size)
+{
+	struct block_t * blk = (struct block_t *)kobj->priv;
+	block_cache_resize(blk, strtoull(buf, NULL, 0));
+	return size;
+}
+
+static ssize_t block_read_cachestat(struct kobj_t * kobj, void * buf, size_t size)
+{
+	struct block_t * blk = (struct block_t *)kobj->priv;
+	struct block_cache_t * c = blk->cache;
+	int len = 0;
+
+	if(c)
+	{
+		mutex_lock(&c->lock);
+		len += sprintf((char *)buf + len, "hit: %lld\r\n", c->hit);
+		len += sprintf((char *)buf + len, "miss: %lld\r\n", c->miss);
+		len += sprintf((char *)buf + len, "readahead: %lld\r\n", c->readahead);
+		len += sprintf((char *)buf + len, "writeback: %lld\r\n", c->writeback);
+		len += sprintf((char *)buf + len, "buffers: %lld/%lld\r\n", c->nbuf, c->capacity);
+		len += sprintf((char *)buf + len, "dirty: %lld\r\n", c->ndirty);
+		len += sprintf((char *)buf + len, "queued: %lld\r\n", c->queued);
+		len += sprintf((char *)buf + len, "merged: %lld\r\n", c->merged);
+		mutex_unlock(&c->lock);
+	}
+	return len;
+}
+
 struct block_t * search_block(const char * name)
 {
 	struct device_t * dev;
@@ -101,13 +753,23 @@ struct device_t * register_block(struct block_t * blk, struct driver_t * drv)
 	dev->type = DEVICE_TYPE_BLOCK;
 	dev->driver = drv;
 	dev->priv = blk;
+	blk->cache = NULL;
+	if(blk->read != sub_block_read)
+		blk->cache = block_cache_alloc(blk, CONFIG_BLOCK_CACHE_SIZE);
 	dev->kobj = kobj_alloc_directory(dev->name);
 	kobj_add_regular(dev->kobj, "size", block_read_size, NULL, blk);
 	kobj_add_regular(dev->kobj, "count", block_read_count, NULL, blk);
 	kobj_add_regular(dev->kobj, "capacity", block_read_capacity, NULL, blk);
+	if(blk->cache)
+	{
+		kobj_add_regular(dev->kobj, "cachesize", block_read_cachesize, block_write_cachesize, blk);
+		kobj_add_regular(dev->kobj, "cachestat", block_read_cachestat, NULL, blk);
+	}
 
 	if(!register_device(dev))
 	{
+		block_cache_free(blk, blk->cache);
+		blk->cache = NULL;
 		kobj_remove_self(dev->kobj);
 		free(dev->name);
 		free(dev);
@@ -125,6 +787,8 @@ void unregister_block(struct block_t * blk)
 		dev = search_device(blk->name, DEVICE_TYPE_BLOCK);
 		if(dev && unregister_device(dev))
 		{
+			block_cache_free(blk, blk->cache);
+			blk->cache = NULL;
 			kobj_remove_self(dev->kobj);
 			free(dev->name);
 			free(dev);
@@ -175,6 +839,8 @@ struct device_t * register_sub_block(struct block_t * pblk, u64_t offset, u64_t
 	blk->read = sub_block_read;
 	blk->write = sub_block_write;
 	blk->sync = sub_block_sync;
+	blk->submit = NULL;
+	blk->mmap = NULL;
 	blk->priv = pdat;
 
 	if(!(dev = register_block(blk, NULL)))
@@ -213,47 +879,25 @@ void unregister_sub_block(struct block_t * pblk)
 	}
 }
 
-u64_t block_read(struct block_t * blk, u8_t * buf, u64_t offset, u64_t count)
+/*
+ * Uncached transfer, partial head and tail blocks go through the bounce
+ * block of the device and whole block runs go straight to the driver.
+ */
+static u64_t __block_read(struct block_t * blk, u8_t * p, u8_t * buf, u64_t offset, u64_t count)
 {
-	u64_t blkno, blksz, blkcnt, capacity;
-	u64_t len, tmp;
+	u64_t blksz = block_size(blk);
+	u64_t blkno = offset / blksz;
+	u64_t tmp = offset % blksz;
 	u64_t ret = 0;
-	u8_t * p;
+	u64_t len;
 
-	if(!blk || !buf || !count)
-		return 0;
-
-	blksz = block_size(blk);
-	blkcnt = block_count(blk);
-	if(!blksz || !blkcnt)
-		return 0;
-
-	capacity = block_capacity(blk);
-	if(offset >= capacity)
-		return 0;
-
-	tmp = capacity - offset;
-	if(count > tmp)
-		count = tmp;
-
-	p = malloc(blksz);
-	if(!p)
-		return 0;
-
-	blkno = offset / blksz;
-	tmp = offset % blksz;
 	if(tmp > 0)
 	{
 		len = blksz - tmp;
 		if(count < len)
 			len = count;
-
 		if(blk->read(blk, p, blkno, 1) != 1)
-		{
-			free(p);
 			return ret;
-		}
-
 		memcpy((void *)buf, (const void *)(&p[tmp]), len);
 		buf += len;
 		count -= len;
@@ -265,13 +909,8 @@ u64_t block_read(struct block_t * blk, u8_t * buf, u64_t offset, u64_t count)
 	if(tmp > 0)
 	{
 		len = tmp * blksz;
-
 		if(blk->read(blk, buf, blkno, tmp) != tmp)
-		{
-			free(p);
 			return ret;
-		}
-
 		buf += len;
 		count -= len;
 		ret += len;
@@ -281,70 +920,32 @@ u64_t block_read(struct block_t * blk, u8_t * buf, u64_t offset, u64_t count)
 	if(count > 0)
 	{
 		len = count;
-
 		if(blk->read(blk, p, blkno, 1) != 1)
-		{
-			free(p);
 			return ret;
-		}
-
 		memcpy((void *)buf, (const void *)(&p[0]), len);
 		ret += len;
 	}
-
-	free(p);
 	return ret;
 }
 
-u64_t block_write(struct block_t * blk, u8_t * buf, u64_t offset, u64_t count)
+static u64_t __block_write(struct block_t * blk, u8_t * p, u8_t * buf, u64_t offset, u64_t count)
 {
-	u64_t blkno, blksz, blkcnt, capacity;
-	u64_t len, tmp;
+	u64_t blksz = block_size(blk);
+	u64_t blkno = offset / blksz;
+	u64_t tmp = offset % blksz;
 	u64_t ret = 0;
-	u8_t * p;
-
-	if(!blk || !buf || !count)
-		return 0;
-
-	blksz = block_size(blk);
-	blkcnt = block_count(blk);
-	if(!blksz || !blkcnt)
-		return 0;
-
-	capacity = block_capacity(blk);
-	if(offset >= capacity)
-		return 0;
-
-	tmp = capacity - offset;
-	if(count > tmp)
-		count = tmp;
-
-	p = malloc(blksz);
-	if(!p)
-		return 0;
+	u64_t len;
 
-	blkno = offset / blksz;
-	tmp = offset % blksz;
 	if(tmp > 0)
 	{
 		len = blksz - tmp;
 		if(count < len)
 			len = count;
-
 		if(blk->read(blk, p, blkno, 1) != 1)
-		{
-			free(p);
 			return ret;
-		}
-
 		memcpy((void *)(&p[tmp]), (const void *)buf, len);
-
 		if(blk->write(blk, p, blkno, 1) != 1)
-		{
-			free(p);
 			return ret;
-		}
-
 		buf += len;
 		count -= len;
 		ret += len;
@@ -355,13 +956,8 @@ u64_t block_write(struct block_t * blk, u8_t * buf, u64_t offset, u64_t count)
 	if(tmp > 0)
 	{
 		len = tmp * blksz;
-
 		if(blk->write(blk, buf, blkno, tmp) != tmp)
-		{
-			free(p);
 			return ret;
-		}
-
 		buf += len;
 		count -= len;
 		ret += len;
@@ -371,30 +967,225 @@ u64_t block_write(struct block_t * blk, u8_t * buf, u64_t offset, u64_t count)
 	if(count > 0)
 	{
 		len = count;
-
 		if(blk->read(blk, p, blkno, 1) != 1)
-		{
-			free(p);
 			return ret;
-		}
-
 		memcpy((void *)(&p[0]), (const void *)buf, len);
-
 		if(blk->write(blk, p, blkno, 1) != 1)
-		{
-			free(p);
 			return ret;
-		}
-
 		ret += len;
 	}
+	return ret;
+}
+
+static u64_t block_transfer(struct block_t * blk, struct block_vec_t * vec, int nvec, u64_t offset, int write)
+{
+	struct block_t * root;
+	struct block_cache_t * c;
+	u64_t capacity, count, len;
+	u64_t ret = 0;
+	u8_t * p = NULL;
+	int i;
+
+	if(!blk || !vec || (nvec <= 0))
+		return 0;
+
+	capacity = block_capacity(blk);
+	if(offset >= capacity)
+		return 0;
+	capacity -= offset;
 
-	free(p);
+	root = block_root(blk, &offset);
+	c = root->cache;
+	if(c)
+	{
+		mutex_lock(&c->lock);
+		p = c->bounce;
+	}
+	else
+	{
+		p = malloc(block_size(root));
+		if(!p)
+			return 0;
+	}
+	for(i = 0; (i < nvec) && (capacity > 0); i++)
+	{
+		count = vec[i].len;
+		if(!vec[i].buf || !count)
+			continue;
+		if(count > capacity)
+			count = capacity;
+		if(c && c->capacity)
+			len = write ? block_cache_write(root, c, vec[i].buf, offset, count) : block_cache_read(root, c, vec[i].buf, offset, count);
+		else
+			len = write ? __block_write(root, p, vec[i].buf, offset, count) : __block_read(root, p, vec[i].buf, offset, count);
+		ret += len;
+		if(len != count)
+			break;
+		offset += len;
+		capacity -= len;
+	}
+	if(c)
+		mutex_unlock(&c->lock);
+	else
+		free(p);
 	return ret;
 }
 
+u64_t block_readv(struct block_t * blk, struct block_vec_t * vec, int nvec, u64_t offset)
+{
+	return block_transfer(blk, vec, nvec, offset, 0);
+}
+
+u64_t block_writev(struct block_t * blk, struct block_vec_t * vec, int nvec, u64_t offset)
+{
+	return block_transfer(blk, vec, nvec, offset, 1);
+}
+
+u64_t block_read(struct block_t * blk, u8_t * buf, u64_t offset, u64_t count)
+{
+	struct block_vec_t vec = { buf, count };
+	return block_transfer(blk, &vec, 1, offset, 0);
+}
+
+u64_t block_write(struct block_t * blk, u8_t * buf, u64_t offset, u64_t count)
+{
+	struct block_vec_t vec = { buf, count };
+	return block_transfer(blk, &vec, 1, offset, 1);
+}
+
 void block_sync(struct block_t * blk)
 {
-	if(blk && blk->sync)
-		blk->sync(blk);
+	struct block_t * root;
+	struct block_cache_t * c;
+
+	if(blk)
+	{
+		root = block_root(blk, NULL);
+		if((c = root->cache))
+		{
+			work_flush(&c->work);
+			mutex_lock(&c->lock);
+			block_cache_flush(root, c);
+			mutex_unlock(&c->lock);
+		}
+		if(blk->sync)
+			blk->sync(blk);
+	}
+}
+
+/*
+ * Direct pointer to the contents of a memory resident block device,
+ * or NULL if the range can only be reached through block_read
+ */
+void * block_mmap(struct block_t * blk, u64_t offset, u64_t count)
+{
+	struct block_t * root;
+	struct block_cache_t * c;
+	u64_t capacity;
+	u8_t * p;
+
+	if(!blk)
+		return NULL;
+
+	capacity = block_capacity(blk);
+	if((offset > capacity) || (count > capacity - offset))
+		return NULL;
+
+	root = block_root(blk, &offset);
+	if(!root->mmap)
+		return NULL;
+	if((c = root->cache) && c->capacity)
+		return NULL;
+
+	p = root->mmap(root);
+	return p ? (void *)(p + offset) : NULL;
+}
+
+int block_submit(struct block_t * blk, struct block_request_t * req)
+{
+	struct block_t * root;
+	struct block_cache_t * c;
+	struct block_request_t * r, io;
+	irq_flags_t flags;
+	u64_t offset;
+
+	if(!blk || !req || !req->buf)
+		return 0;
+
+	req->blkcnt = block_available_count(blk, req->blkno, req->blkcnt);
+	if(req->blkcnt == 0)
+		return 0;
+
+	offset = block_offset(blk, req->blkno);
+	root = block_root(blk, &offset);
+	req->sector = offset / block_size(root);
+	req->done = 0;
+	init_list_head(&req->entry);
+
+	c = root->cache;
+	if(!c)
+	{
+		io.write = req->write;
+		io.blkno = req->sector;
+		io.blkcnt = req->blkcnt;
+		io.buf = req->buf;
+		io.sector = req->sector;
+		req->done = block_request_io(root, &io);
+		if(req->complete)
+			req->complete(req);
+		return 1;
+	}
+
+	spin_lock_irqsave(&c->qlock, flags);
+	list_for_each_entry(r, &c->queue, entry)
+	{
+		if(r->sector > req->sector)
+			break;
+	}
+	list_add_tail(&req->entry, &r->entry);
+	c->queued++;
+	spin_unlock_irqrestore(&c->qlock, flags);
+	work_queue(&c->work);
+	return 1;
+}
+
+void block_drain(struct block_t * blk)
+{
+	struct block_cache_t * c;
+
+	if(blk && (c = block_root(blk, NULL)->cache))
+		work_flush(&c->work);
+}
+
+void block_cache_resize(struct block_t * blk, u64_t size)
+{
+	struct block_cache_t * c;
+
+	if(blk && (c = block_root(blk, NULL)->cache))
+	{
+		mutex_lock(&c->lock);
+		block_cache_setup(block_root(blk, NULL), c, size);
+		mutex_unlock(&c->lock);
+	}
+}
+
+void block_cache_invalidate(struct block_t * blk)
+{
+	struct block_t * root;
+	struct block_cache_t * c;
+
+	if(blk)
+	{
+		root = block_root(blk, NULL);
+		if((c = root->cache))
+		{
+			work_flush(&c->work);
+			mutex_lock(&c->lock);
+			block_cache_flush(root, c);
+			block_cache_drop(c);
+			c->ra = 0;
+			c->next = 0;
+			mutex_unlock(&c->lock);
+		}
+	}
 }
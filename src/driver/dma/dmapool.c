@@ -29,15 +29,351 @@
 #include <xboot.h>
 #include <dma/dmapool.h>
 
+/*
+ * Coherent memory comes from a fixed region carved at boot. The region is
+ * managed in pages by a buddy allocator, small requests are served from
+ * per-size sub-pools that split a single page with a bitmap. Every object
+ * of a sub-pool is naturally aligned to its size, so a request never gets
+ * less than cache line alignment and never shares a cache line with an
+ * unrelated buffer.
+ */
+#define DMA_POOL_PAGE_SHIFT		(12)
+#define DMA_POOL_PAGE_SIZE		(1UL << DMA_POOL_PAGE_SHIFT)
+#define DMA_POOL_MAX_ORDER		(16)
+#define DMA_POOL_MIN_SHIFT		(6)
+#define DMA_POOL_NSUB			(DMA_POOL_PAGE_SHIFT - DMA_POOL_MIN_SHIFT)
+
+enum {
+	DMA_PAGE_NONE	= 0,
+	DMA_PAGE_FREE	= 1,
+	DMA_PAGE_HEAD	= 2,
+	DMA_PAGE_SUB	= 3,
+};
+
+struct dma_page_t {
+	struct list_head entry;
+	u64_t map;
+	u32_t count;
+	u8_t order;
+	u8_t type;
+	u8_t sub;
+	u8_t inuse;
+};
+
+struct dma_subpool_t {
+	struct list_head partial;
+	unsigned long size;
+	unsigned long nobj;
+	unsigned long npages;
+	unsigned long nused;
+};
+
+struct dma_pool_t {
+	unsigned char * base;
+	unsigned long size;
+	unsigned long npages;
+	struct dma_page_t * pages;
+	struct list_head free[DMA_POOL_MAX_ORDER];
+	unsigned long nfree[DMA_POOL_MAX_ORDER];
+	struct dma_subpool_t sub[DMA_POOL_NSUB];
+	struct dma_pool_info_t info;
+	spinlock_t lock;
+};
+
+extern unsigned char __dma_start[] __attribute__((weak));
+extern unsigned char __dma_end[] __attribute__((weak));
+
+static struct dma_pool_t __dma_pool = {
+	.lock = SPIN_LOCK_INIT(),
+};
+
+static inline unsigned long dma_page_index(struct dma_pool_t * pool, struct dma_page_t * page)
+{
+	return (unsigned long)(page - pool->pages);
+}
+
+static inline void * dma_page_address(struct dma_pool_t * pool, unsigned long idx)
+{
+	return pool->base + (idx << DMA_POOL_PAGE_SHIFT);
+}
+
+static void dma_buddy_free(struct dma_pool_t * pool, unsigned long idx, int order)
+{
+	struct dma_page_t * buddy;
+	unsigned long bidx;
+
+	while(order < DMA_POOL_MAX_ORDER - 1)
+	{
+		bidx = idx ^ (1UL << order);
+		if(bidx + (1UL << order) > pool->npages)
+			break;
+		buddy = &pool->pages[bidx];
+		if((buddy->type != DMA_PAGE_FREE) || (buddy->order != order))
+			break;
+		list_del(&buddy->entry);
+		pool->nfree[order]--;
+		buddy->type = DMA_PAGE_NONE;
+		idx &= ~(1UL << order);
+		order++;
+	}
+	pool->pages[idx].type = DMA_PAGE_FREE;
+	pool->pages[idx].order = order;
+	list_add(&pool->pages[idx].entry, &pool->free[order]);
+	pool->nfree[order]++;
+}
+
+static void dma_buddy_free_range(struct dma_pool_t * pool, unsigned long idx, unsigned long n)
+{
+	int order;
+
+	while(n > 0)
+	{
+		for(order = DMA_POOL_MAX_ORDER - 1; order > 0; order--)
+		{
+			if(!(idx & ((1UL << order) - 1)) && ((1UL << order) <= n))
+				break;
+		}
+		dma_buddy_free(pool, idx, order);
+		idx += 1UL << order;
+		n -= 1UL << order;
+	}
+}
+
+static long dma_buddy_alloc(struct dma_pool_t * pool, unsigned long n)
+{
+	struct dma_page_t * page;
+	unsigned long idx;
+	int order, k;
+
+	for(order = 0; (1UL << order) < n; order++);
+	for(k = order; k < DMA_POOL_MAX_ORDER; k++)
+	{
+		if(!list_empty(&pool->free[k]))
+			break;
+	}
+	if(k >= DMA_POOL_MAX_ORDER)
+		return -1;
+	page = list_first_entry(&pool->free[k], struct dma_page_t, entry);
+	list_del(&page->entry);
+	pool->nfree[k]--;
+	page->type = DMA_PAGE_HEAD;
+	page->order = 0;
+	page->count = n;
+	idx = dma_page_index(pool, page);
+	while(k > order)
+	{
+		k--;
+		pool->pages[idx + (1UL << k)].type = DMA_PAGE_FREE;
+		pool->pages[idx + (1UL << k)].order = k;
+		list_add(&pool->pages[idx + (1UL << k)].entry, &pool->free[k]);
+		pool->nfree[k]++;
+	}
+	if(n < (1UL << order))
+		dma_buddy_free_range(pool, idx + n, (1UL << order) - n);
+	return idx;
+}
+
+static void * dma_subpool_alloc(struct dma_pool_t * pool, int i)
+{
+	struct dma_subpool_t * sp = &pool->sub[i];
+	struct dma_page_t * page;
+	unsigned long n;
+	long idx;
+
+	if(list_empty(&sp->partial))
+	{
+		idx = dma_buddy_alloc(pool, 1);
+		if(idx < 0)
+			return NULL;
+		page = &pool->pages[idx];
+		page->type = DMA_PAGE_SUB;
+		page->sub = i;
+		page->inuse = 0;
+		page->map = 0;
+		list_add(&page->entry, &sp->partial);
+		sp->npages++;
+	}
+	page = list_first_entry(&sp->partial, struct dma_page_t, entry);
+	for(n = 0; n < sp->nobj; n++)
+	{
+		if(!(page->map & ((u64_t)1 << n)))
+			break;
+	}
+	page->map |= (u64_t)1 << n;
+	if(++page->inuse >= sp->nobj)
+		list_del_init(&page->entry);
+	sp->nused++;
+	return (unsigned char *)dma_page_address(pool, dma_page_index(pool, page)) + n * sp->size;
+}
+
+static void dma_subpool_free(struct dma_pool_t * pool, struct dma_page_t * page, unsigned long offset)
+{
+	struct dma_subpool_t * sp = &pool->sub[page->sub];
+	unsigned long n = offset / sp->size;
+
+	if((offset % sp->size) || !(page->map & ((u64_t)1 << n)))
+		return;
+	page->map &= ~((u64_t)1 << n);
+	if(page->inuse-- >= sp->nobj)
+		list_add(&page->entry, &sp->partial);
+	sp->nused--;
+	pool->info.used -= sp->size;
+	pool->info.frees++;
+	if(page->inuse == 0)
+	{
+		list_del(&page->entry);
+		sp->npages--;
+		dma_buddy_free(pool, dma_page_index(pool, page), 0);
+	}
+}
+
+/*
+ * Set the pool up on first use. Memory is allocated before taking the
+ * lock and only published under it, the loser of a race frees its copy
+ */
+static void dma_pool_setup(struct dma_pool_t * pool)
+{
+	struct dma_page_t * pages;
+	unsigned char * start, * end, * mem = NULL;
+	unsigned long npages;
+	irq_flags_t flags;
+	int i;
+
+	if(pool->pages)
+		return;
+	if((unsigned long)__dma_end > (unsigned long)__dma_start)
+	{
+		start = __dma_start;
+		end = __dma_end;
+	}
+	else
+	{
+		mem = memalign(DMA_POOL_PAGE_SIZE, CONFIG_DMA_POOL_SIZE);
+		if(!mem)
+			return;
+		start = mem;
+		end = start + CONFIG_DMA_POOL_SIZE;
+	}
+	start = (unsigned char *)(((unsigned long)start + DMA_POOL_PAGE_SIZE - 1) & ~(DMA_POOL_PAGE_SIZE - 1));
+	end = (unsigned char *)((unsigned long)end & ~(DMA_POOL_PAGE_SIZE - 1));
+	if(end <= start)
+	{
+		free(mem);
+		return;
+	}
+	npages = (unsigned long)(end - start) >> DMA_POOL_PAGE_SHIFT;
+	pages = calloc(npages, sizeof(struct dma_page_t));
+	if(!pages)
+	{
+		free(mem);
+		return;
+	}
+
+	spin_lock_irqsave(&pool->lock, flags);
+	if(pool->pages)
+	{
+		spin_unlock_irqrestore(&pool->lock, flags);
+		free(pages);
+		free(mem);
+		return;
+	}
+	pool->pages = pages;
+	pool->npages = npages;
+	pool->base = start;
+	pool->size = pool->npages << DMA_POOL_PAGE_SHIFT;
+	for(i = 0; i < DMA_POOL_MAX_ORDER; i++)
+	{
+		init_list_head(&pool->free[i]);
+		pool->nfree[i] = 0;
+	}
+	for(i = 0; i < DMA_POOL_NSUB; i++)
+	{
+		init_list_head(&pool->sub[i].partial);
+		pool->sub[i].size = 1UL << (DMA_POOL_MIN_SHIFT + i);
+		pool->sub[i].nobj = DMA_POOL_PAGE_SIZE >> (DMA_POOL_MIN_SHIFT + i);
+		pool->sub[i].npages = 0;
+		pool->sub[i].nused = 0;
+	}
+	memset(&pool->info, 0, sizeof(struct dma_pool_info_t));
+	pool->info.base = pool->base;
+	pool->info.size = pool->size;
+	dma_buddy_free_range(pool, 0, pool->npages);
+	spin_unlock_irqrestore(&pool->lock, flags);
+}
+
 static void * __dma_alloc_coherent(unsigned long size)
 {
-	return memalign(SZ_4K, size);
+	struct dma_pool_t * pool = &__dma_pool;
+	irq_flags_t flags;
+	void * m = NULL;
+	unsigned long n;
+	long idx;
+	int i;
+
+	if(size == 0)
+		return NULL;
+	dma_pool_setup(pool);
+	spin_lock_irqsave(&pool->lock, flags);
+	if(pool->pages)
+	{
+		if(size <= (DMA_POOL_PAGE_SIZE >> 1))
+		{
+			for(i = 0; (1UL << (DMA_POOL_MIN_SHIFT + i)) < size; i++);
+			m = dma_subpool_alloc(pool, i);
+			n = pool->sub[i].size;
+		}
+		else
+		{
+			n = (size + DMA_POOL_PAGE_SIZE - 1) >> DMA_POOL_PAGE_SHIFT;
+			idx = dma_buddy_alloc(pool, n);
+			if(idx >= 0)
+				m = dma_page_address(pool, idx);
+			n <<= DMA_POOL_PAGE_SHIFT;
+		}
+		if(m)
+		{
+			pool->info.allocs++;
+			pool->info.used += n;
+			if(pool->info.used > pool->info.peak)
+				pool->info.peak = pool->info.used;
+		}
+		else
+		{
+			pool->info.fails++;
+		}
+	}
+	spin_unlock_irqrestore(&pool->lock, flags);
+	return m;
 }
 extern __typeof(__dma_alloc_coherent) dma_alloc_coherent __attribute__((weak, alias("__dma_alloc_coherent")));
 
 static void __dma_free_coherent(void * addr)
 {
-	free(addr);
+	struct dma_pool_t * pool = &__dma_pool;
+	struct dma_page_t * page;
+	irq_flags_t flags;
+	unsigned long offset;
+
+	if(!addr)
+		return;
+	spin_lock_irqsave(&pool->lock, flags);
+	if(pool->pages && ((unsigned char *)addr >= pool->base) && ((unsigned char *)addr < pool->base + pool->size))
+	{
+		offset = (unsigned long)((unsigned char *)addr - pool->base);
+		page = &pool->pages[offset >> DMA_POOL_PAGE_SHIFT];
+		if(page->type == DMA_PAGE_SUB)
+		{
+			dma_subpool_free(pool, page, offset & (DMA_POOL_PAGE_SIZE - 1));
+		}
+		else if((page->type == DMA_PAGE_HEAD) && !(offset & (DMA_POOL_PAGE_SIZE - 1)))
+		{
+			page->type = DMA_PAGE_NONE;
+			pool->info.used -= (unsigned long)page->count << DMA_POOL_PAGE_SHIFT;
+			pool->info.frees++;
+			dma_buddy_free_range(pool, offset >> DMA_POOL_PAGE_SHIFT, page->count);
+		}
+	}
+	spin_unlock_irqrestore(&pool->lock, flags);
 }
 extern __typeof(__dma_free_coherent) dma_free_coherent __attribute__((weak, alias("__dma_free_coherent")));
 
@@ -58,3 +394,63 @@ static void __dma_cache_sync(void * addr, unsigned long size, int dir)
 }
 extern __typeof(__dma_cache_sync) dma_cache_sync __attribute__((weak, alias("__dma_cache_sync")));
 
+void dma_pool_info(struct dma_pool_info_t * info)
+{
+	struct dma_pool_t * pool = &__dma_pool;
+	irq_flags_t flags;
+	int i;
+
+	if(!info)
+		return;
+	dma_pool_setup(pool);
+	spin_lock_irqsave(&pool->lock, flags);
+	memcpy(info, &pool->info, sizeof(struct dma_pool_info_t));
+	info->largest = 0;
+	for(i = DMA_POOL_MAX_ORDER - 1; i >= 0; i--)
+	{
+		if(pool->nfree[i] > 0)
+		{
+			info->largest = DMA_POOL_PAGE_SIZE << i;
+			break;
+		}
+	}
+	spin_unlock_irqrestore(&pool->lock, flags);
+}
+
+static struct kobj_t * search_class_memory_kobj(void)
+{
+	struct kobj_t * kclass = kobj_search_directory_with_create(kobj_get_root(), "class");
+	return kobj_search_directory_with_create(kclass, "memory");
+}
+
+static ssize_t memory_read_dmapool(struct kobj_t * kobj, void * buf, size_t size)
+{
+	struct dma_pool_t * pool = &__dma_pool;
+	struct dma_pool_info_t info;
+	irq_flags_t flags;
+	char * p = buf;
+	int len = 0;
+	int i;
+
+	dma_pool_info(&info);
+	len += sprintf((char *)(p + len), " base:    %p\r\n", info.base);
+	len += sprintf((char *)(p + len), " size:    %lu\r\n", info.size);
+	len += sprintf((char *)(p + len), " used:    %lu\r\n", info.used);
+	len += sprintf((char *)(p + len), " peak:    %lu\r\n", info.peak);
+	len += sprintf((char *)(p + len), " largest: %lu\r\n", info.largest);
+	len += sprintf((char *)(p + len), " allocs:  %lu\r\n", info.allocs);
+	len += sprintf((char *)(p + len), " frees:   %lu\r\n", info.frees);
+	len += sprintf((char *)(p + len), " fails:   %lu\r\n", info.fails);
+	spin_lock_irqsave(&pool->lock, flags);
+	for(i = 0; i < DMA_POOL_NSUB; i++)
+		len += sprintf((char *)(p + len), " pool-%-4lu %lu/%lu\r\n", pool->sub[i].size, pool->sub[i].nused, pool->sub[i].npages * pool->sub[i].nobj);
+	spin_unlock_irqrestore(&pool->lock, flags);
+	return len;
+}
+
+static __init void dma_pool_init(void)
+{
+	dma_pool_setup(&__dma_pool);
+	kobj_add_regular(search_class_memory_kobj(), "dmapool", memory_read_dmapool, NULL, NULL);
+}
+core_initcall(dma_pool_init);
@@ -42,8 +42,19 @@ static int l_new(lua_State * L)
 	return 1;
 }
 
+static int l_sleep(lua_State * L)
+{
+	lua_Number s = luaL_optnumber(L, 1, 0);
+	if(s > 0)
+		task_sleep((uint64_t)(s * (lua_Number)1000000000.0));
+	else
+		task_yield();
+	return 0;
+}
+
 static const luaL_Reg l_stopwatch[] = {
 	{"new", l_new},
+	{"sleep", l_sleep},
 	{NULL, NULL}
 };
 
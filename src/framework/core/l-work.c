@@ -0,0 +1,294 @@
+/*
+ * framework/core/l-work.c
+ *
+ * Copyright(c) 2007-2021 Jianjun Jiang <8192542@qq.com>
+ * Official site: http://xboot.org
+ * Mobile phone: +86-18665388956
+ * QQ: 8192542
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#include <core/l-work.h>
+
+#define	MT_WORK		"__mt_work__"
+
+/*
+ * A work runs a lua function on a kernel worker, inside a private lua state,
+ * so that heavy jobs never block the caller. The function is copied as a
+ * binary chunk, it can't share upvalues with the caller, and the argument
+ * and the result are limited to nil, boolean, number and string.
+ */
+struct lwork_value_t {
+	int type;
+	int isint;
+	lua_Integer i;
+	lua_Number n;
+	char * s;
+	size_t l;
+};
+
+struct lwork_t {
+	struct work_t work;
+	char * code;
+	size_t len;
+	struct lwork_value_t arg;
+	struct lwork_value_t ret;
+	char * err;
+	int done;
+};
+
+struct lwork_writer_t {
+	char * buf;
+	size_t len;
+	size_t size;
+};
+
+static int lwork_writer(lua_State * L, const void * p, size_t sz, void * ud)
+{
+	struct lwork_writer_t * w = (struct lwork_writer_t *)ud;
+	char * buf;
+	size_t size;
+
+	if(w->len + sz > w->size)
+	{
+		size = (w->size > 0) ? w->size : 256;
+		while(size < w->len + sz)
+			size <<= 1;
+		buf = realloc(w->buf, size);
+		if(!buf)
+			return 1;
+		w->buf = buf;
+		w->size = size;
+	}
+	memcpy(w->buf + w->len, p, sz);
+	w->len += sz;
+	return 0;
+}
+
+static int lwork_value_get(lua_State * L, int idx, struct lwork_value_t * v)
+{
+	const char * s;
+
+	memset(v, 0, sizeof(struct lwork_value_t));
+	v->type = lua_type(L, idx);
+	switch(v->type)
+	{
+	case LUA_TNONE:
+	case LUA_TNIL:
+		v->type = LUA_TNIL;
+		break;
+	case LUA_TBOOLEAN:
+		v->i = lua_toboolean(L, idx);
+		break;
+	case LUA_TNUMBER:
+		v->isint = lua_isinteger(L, idx);
+		if(v->isint)
+			v->i = lua_tointeger(L, idx);
+		else
+			v->n = lua_tonumber(L, idx);
+		break;
+	case LUA_TSTRING:
+		s = lua_tolstring(L, idx, &v->l);
+		v->s = malloc(v->l + 1);
+		if(!v->s)
+			return 0;
+		memcpy(v->s, s, v->l + 1);
+		break;
+	default:
+		v->type = LUA_TNIL;
+		return 0;
+	}
+	return 1;
+}
+
+static void lwork_value_push(lua_State * L, struct lwork_value_t * v)
+{
+	switch(v->type)
+	{
+	case LUA_TBOOLEAN:
+		lua_pushboolean(L, v->i);
+		break;
+	case LUA_TNUMBER:
+		if(v->isint)
+			lua_pushinteger(L, v->i);
+		else
+			lua_pushnumber(L, v->n);
+		break;
+	case LUA_TSTRING:
+		lua_pushlstring(L, v->s, v->l);
+		break;
+	default:
+		lua_pushnil(L);
+		break;
+	}
+}
+
+static void lwork_value_free(struct lwork_value_t * v)
+{
+	if(v->s)
+		free(v->s);
+	memset(v, 0, sizeof(struct lwork_value_t));
+}
+
+static char * lwork_error(lua_State * L)
+{
+	const char * msg = lua_tostring(L, -1);
+	char buf[64];
+
+	if(msg)
+		return strdup(msg);
+	snprintf(buf, sizeof(buf), "(error object is a %s value)", luaL_typename(L, -1));
+	return strdup(buf);
+}
+
+static void lwork_function(struct work_t * work, void * data)
+{
+	struct lwork_t * w = (struct lwork_t *)data;
+	lua_State * L;
+
+	L = luaL_newstate();
+	if(L)
+	{
+		luaL_openlibs(L);
+		if(luaL_loadbufferx(L, w->code, w->len, "=work", "b") == LUA_OK)
+		{
+			lwork_value_push(L, &w->arg);
+			if(lua_pcall(L, 1, 1, 0) == LUA_OK)
+			{
+				if(!lwork_value_get(L, -1, &w->ret))
+					w->err = strdup("unsupported result type");
+			}
+			else
+				w->err = lwork_error(L);
+		}
+		else
+			w->err = lwork_error(L);
+		lua_close(L);
+	}
+	else
+		w->err = strdup("cannot create lua state");
+	smp_wmb();
+	w->done = 1;
+}
+
+static int l_work_new(lua_State * L)
+{
+	struct lwork_writer_t writer = { NULL, 0, 0 };
+	struct lwork_t * w;
+
+	luaL_checktype(L, 1, LUA_TFUNCTION);
+	if(lua_iscfunction(L, 1))
+		return luaL_argerror(L, 1, "lua function expected");
+	lua_pushvalue(L, 1);
+	if(lua_dump(L, lwork_writer, &writer, 1) != 0)
+	{
+		if(writer.buf)
+			free(writer.buf);
+		return luaL_error(L, "unable to dump given function");
+	}
+	lua_pop(L, 1);
+
+	w = lua_newuserdata(L, sizeof(struct lwork_t));
+	memset(w, 0, sizeof(struct lwork_t));
+	w->code = writer.buf;
+	w->len = writer.len;
+	if(!lwork_value_get(L, 2, &w->arg))
+	{
+		lwork_value_free(&w->arg);
+		free(w->code);
+		w->code = NULL;
+		return luaL_argerror(L, 2, "nil, boolean, number or string expected");
+	}
+	work_init(&w->work, lwork_function, NULL, w);
+	luaL_setmetatable(L, MT_WORK);
+	work_queue(&w->work);
+	return 1;
+}
+
+static const luaL_Reg l_work[] = {
+	{"new",	l_work_new},
+	{NULL,	NULL}
+};
+
+static int m_work_gc(lua_State * L)
+{
+	struct lwork_t * w = luaL_checkudata(L, 1, MT_WORK);
+	work_cancel(&w->work);
+	if(w->code)
+		free(w->code);
+	if(w->err)
+		free(w->err);
+	lwork_value_free(&w->arg);
+	lwork_value_free(&w->ret);
+	return 0;
+}
+
+static int m_work_is_done(lua_State * L)
+{
+	struct lwork_t * w = luaL_checkudata(L, 1, MT_WORK);
+	lua_pushboolean(L, w->done);
+	return 1;
+}
+
+static int m_work_result(lua_State * L)
+{
+	struct lwork_t * w = luaL_checkudata(L, 1, MT_WORK);
+	if(!w->done)
+		return 0;
+	smp_rmb();
+	if(w->err)
+	{
+		lua_pushnil(L);
+		lua_pushstring(L, w->err);
+		return 2;
+	}
+	lwork_value_push(L, &w->ret);
+	return 1;
+}
+
+static int m_work_wait(lua_State * L)
+{
+	struct lwork_t * w = luaL_checkudata(L, 1, MT_WORK);
+	work_flush(&w->work);
+	return m_work_result(L);
+}
+
+static int m_work_cancel(lua_State * L)
+{
+	struct lwork_t * w = luaL_checkudata(L, 1, MT_WORK);
+	lua_pushboolean(L, work_cancel(&w->work));
+	return 1;
+}
+
+static const luaL_Reg m_work[] = {
+	{"__gc",		m_work_gc},
+	{"isDone",		m_work_is_done},
+	{"result",		m_work_result},
+	{"wait",		m_work_wait},
+	{"cancel",		m_work_cancel},
+	{NULL,			NULL}
+};
+
+int luaopen_work(lua_State * L)
+{
+	luaL_newlib(L, l_work);
+	luahelper_create_metatable(L, MT_WORK, m_work);
+	return 1;
+}
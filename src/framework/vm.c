@@ -56,6 +56,7 @@
 #include <core/l-text.h>
 #include <core/l-timer.h>
 #include <core/l-window.h>
+#include <core/l-work.h>
 #include <core/l-xfs.h>
 #include <codec/l-codec.h>
 #include <hardware/l-hardware.h>
@@ -73,6 +74,7 @@ static void luaopen_glblibs(lua_State * L)
 		{ "Easing",					luaopen_easing },
 		{ "Spring",					luaopen_spring },
 		{ "Stopwatch",				luaopen_stopwatch },
+		{ "Work",					luaopen_work },
 		{ "Color",					luaopen_color },
 		{ "Matrix",					luaopen_matrix },
 		{ "Image",					luaopen_image },
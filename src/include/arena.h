@@ -0,0 +1,44 @@
+#ifndef __ARENA_H__
+#define __ARENA_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <types.h>
+
+struct arena_chunk_t {
+	struct arena_chunk_t * next;
+	size_t size;
+	size_t used;
+	unsigned char mem[0] __attribute__((aligned(16)));
+};
+
+struct arena_t {
+	struct arena_chunk_t * head;
+	struct arena_chunk_t * cur;
+	size_t chunksz;
+	size_t used;
+	size_t peak;
+};
+
+struct arena_mark_t {
+	struct arena_chunk_t * chunk;
+	size_t used;
+	size_t total;
+};
+
+struct arena_t * arena_alloc(size_t chunksz);
+void arena_free(struct arena_t * a);
+void * arena_malloc(struct arena_t * a, size_t size);
+void * arena_calloc(struct arena_t * a, size_t size);
+void * arena_realloc(struct arena_t * a, void * ptr, size_t osize, size_t nsize);
+void arena_mark(struct arena_t * a, struct arena_mark_t * m);
+void arena_release(struct arena_t * a, struct arena_mark_t * m);
+void arena_reset(struct arena_t * a);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __ARENA_H__ */
@@ -7,6 +7,34 @@ extern "C" {
 
 #include <xboot.h>
 
+struct block_t;
+struct block_cache_t;
+
+struct block_vec_t
+{
+	void * buf;
+	u64_t len;
+};
+
+struct block_request_t
+{
+	struct list_head entry;
+	u64_t sector;
+
+	/* Request to read or write blkcnt blocks at blkno */
+	int write;
+	u64_t blkno;
+	u64_t blkcnt;
+	u8_t * buf;
+
+	/* The block counts transferred, valid in complete */
+	u64_t done;
+
+	/* Completion callback, called from the block queue worker */
+	void (*complete)(struct block_request_t * req);
+	void * data;
+};
+
 struct block_t
 {
 	/* The block name */
@@ -27,6 +55,15 @@ struct block_t
 	/* Sync cache to block device */
 	void (*sync)(struct block_t * blk);
 
+	/* Transfer a queued request, optional, return the block counts of transfer */
+	u64_t (*submit)(struct block_t * blk, struct block_request_t * req);
+
+	/* Address of the memory resident device contents, optional */
+	void * (*mmap)(struct block_t * blk);
+
+	/* Buffer cache, managed by the block core */
+	struct block_cache_t * cache;
+
 	/* Private data */
 	void * priv;
 };
@@ -77,7 +114,14 @@ void unregister_sub_block(struct block_t * pblk);
 
 u64_t block_read(struct block_t * blk, u8_t * buf, u64_t offset, u64_t count);
 u64_t block_write(struct block_t * blk, u8_t * buf, u64_t offset, u64_t count);
+u64_t block_readv(struct block_t * blk, struct block_vec_t * vec, int nvec, u64_t offset);
+u64_t block_writev(struct block_t * blk, struct block_vec_t * vec, int nvec, u64_t offset);
 void block_sync(struct block_t * blk);
+void * block_mmap(struct block_t * blk, u64_t offset, u64_t count);
+int block_submit(struct block_t * blk, struct block_request_t * req);
+void block_drain(struct block_t * blk);
+void block_cache_resize(struct block_t * blk, u64_t size);
+void block_cache_invalidate(struct block_t * blk);
 
 #ifdef __cplusplus
 }
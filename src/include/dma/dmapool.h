@@ -11,11 +11,23 @@ enum {
 	DMA_FROM_DEVICE		= 2,
 };
 
+struct dma_pool_info_t {
+	void * base;
+	unsigned long size;
+	unsigned long used;
+	unsigned long peak;
+	unsigned long largest;
+	unsigned long allocs;
+	unsigned long frees;
+	unsigned long fails;
+};
+
 void * dma_alloc_coherent(unsigned long size);
 void dma_free_coherent(void * addr);
 void * dma_alloc_noncoherent(unsigned long size);
 void dma_free_noncoherent(void * addr);
 void dma_cache_sync(void * addr, unsigned long size, int dir);
+void dma_pool_info(struct dma_pool_info_t * info);
 
 #ifdef __cplusplus
 }
@@ -5,8 +5,26 @@
 extern "C" {
 #endif
 
+#include <xconfigs.h>
 #include <types.h>
 
+#define MALLOC_FRAG_BUCKETS		(32)
+
+struct malloc_frag_t {
+	size_t count[MALLOC_FRAG_BUCKETS];
+	size_t bytes[MALLOC_FRAG_BUCKETS];
+	size_t nfree;
+	size_t tfree;
+	size_t largest;
+};
+
+struct malloc_site_t {
+	void * caller;
+	ssize_t count;
+	ssize_t bytes;
+	u64_t oldest;
+};
+
 void * mm_create(void * mem, size_t bytes);
 void mm_destroy(void * mem);
 void * mm_get(void * mem);
@@ -24,6 +42,12 @@ void * realloc(void * ptr, size_t size);
 void * calloc(size_t nmemb, size_t size);
 void free(void * ptr);
 void meminfo(size_t * mused, size_t * mfree);
+void malloc_frag(struct malloc_frag_t * f);
+#if defined(CONFIG_MALLOC_PROFILE) && (CONFIG_MALLOC_PROFILE > 0)
+int malloc_profile_top(struct malloc_site_t * sites, int n);
+int malloc_profile_snapshot(int slot);
+int malloc_profile_diff(int a, int b, struct malloc_site_t * sites, int n);
+#endif
 
 void do_init_mem(void);
 
@@ -10,6 +10,7 @@ extern "C" {
 void ndelay(u32_t ns);
 void udelay(u32_t us);
 void mdelay(u32_t ms);
+void msleep(u32_t ms);
 
 #ifdef __cplusplus
 }
@@ -51,6 +51,19 @@ struct ext4fs_control_t {
 	u32_t group_count;
 	u32_t group_table_blkno;
 	struct ext4fs_group_t * groups;
+
+	/* Directory index (htree) parameters */
+	bool_t dx_enabled;
+	bool_t dx_unsigned;
+	u32_t dx_seed[4];
+
+	/* Directory lookup statistics */
+	u64_t lookup_count;
+	u64_t lookup_hits;
+	u64_t lookup_htree;
+	u64_t lookup_scans;
+	u64_t lookup_blocks;
+	struct kobj_t * kobj;
 };
 
 u32_t ext4fs_current_timestamp(void);
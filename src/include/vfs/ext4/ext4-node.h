@@ -9,6 +9,20 @@ extern "C" {
 
 #define EXT4_NODE_LOOKUP_SIZE	(4)
 
+/* A run of blocks taken from the extent tree */
+struct ext4fs_extent_t {
+	u32_t lblk;
+	u32_t pblk;	/* Zero for uninitialized extents */
+	u32_t len;
+};
+
+/* An entry of the in-memory index of a directory */
+struct ext4fs_dindex_t {
+	struct hlist_node node;
+	struct ext2_dirent_t dent;
+	char * name;	/* Stored right after this structure */
+};
+
 /* Information for accessing a ext4fs file/directory */
 struct ext4fs_node_t {
 	/* Parent ext4fs control */
@@ -49,6 +63,22 @@ struct ext4fs_node_t {
 	u32_t dindir2_blkno;
 	bool_t dindir2_dirty;
 
+	/*
+	 * Extent map of EXT4_EXTENTS_FL inodes
+	 * Loaded on demand. Must be freed in vput()
+	 */
+	struct ext4fs_extent_t * extents;
+	u32_t extent_count;
+	u32_t extent_size;
+	bool_t extent_loaded;
+
+	/*
+	 * Hash index of all child directory entries
+	 * Built by the first full directory scan. Must be freed in vput()
+	 */
+	struct hlist_head * dindex;
+	u32_t dindex_size;
+
 	/* Child directory entry lookup table */
 	u32_t lookup_victim;
 	char lookup_name[EXT4_NODE_LOOKUP_SIZE][VFS_MAX_NAME];
@@ -79,8 +79,18 @@ struct ext2_sblock_t {
 	u32_t first_meta_bg;
 	u32_t mkfs_time;
 	u32_t jnl_blocks[17];
+	u32_t total_blocks_hi;
+	u32_t reserved_blocks_hi;
+	u32_t free_blocks_hi;
+	u16_t min_extra_isize;
+	u16_t want_extra_isize;
+	u32_t flags;
 } __attribute__ ((packed));
 
+/* Superblock flags */
+#define EXT2_FLAGS_SIGNED_HASH			0x0001 /* Directory hashes use signed chars */
+#define EXT2_FLAGS_UNSIGNED_HASH		0x0002 /* Directory hashes use unsigned chars */
+
 /* FS States */
 #define EXT2_VALID_FS					1 /* Unmounted cleanly */
 #define EXT2_ERROR_FS					2 /* Errors detected */
@@ -115,6 +125,7 @@ struct ext2_sblock_t {
 #define EXT3_FEAT_INCOMPAT_RECOVER		0x0004
 #define EXT3_FEAT_INCOMPAT_JOURNAL_DEV	0x0008	 
 #define EXT2_FEAT_INCOMPAT_META_BG		0x0010
+#define EXT4_FEAT_INCOMPAT_EXTENTS		0x0040 /* Files use extent trees */
 
 /* Feature Read-Only Compatibility */
 #define EXT2_FEAT_RO_COMPAT_SPARS_SUPER	0x0001 /* Sparse Superblock */
@@ -172,6 +183,35 @@ struct ext2_inode_t {
 	u32_t osd2[3];
 } __attribute__ ((packed));
 
+/* The ext4 extent tree header, found in the inode block array and in tree blocks */
+#define EXT4_EXT_MAGIC					0xF30A
+#define EXT4_EXT_INIT_MAX_LEN			(1 << 15)
+#define EXT4_EXT_MAX_DEPTH				5
+
+struct ext4_extent_header_t {
+	u16_t magic;
+	u16_t entries;	/* Number of valid entries */
+	u16_t max;		/* Capacity of entries */
+	u16_t depth;	/* Zero for leaves */
+	u32_t generation;
+} __attribute__ ((packed));
+
+/* The ext4 extent tree index entry */
+struct ext4_extent_idx_t {
+	u32_t block;	/* First logical block covered */
+	u32_t leaf_lo;	/* Block of the next level */
+	u16_t leaf_hi;
+	u16_t unused;
+} __attribute__ ((packed));
+
+/* The ext4 extent tree leaf entry */
+struct ext4_extent_t {
+	u32_t block;	/* First logical block */
+	u16_t len;		/* Uninitialized if above EXT4_EXT_INIT_MAX_LEN */
+	u16_t start_hi;
+	u32_t start_lo;
+} __attribute__ ((packed));
+
 /* Inode modes */
 #define EXT2_S_IFMASK					0xF000 /* Inode type mask */
 #define EXT2_S_IFSOCK					0xC000 /* socket */
@@ -215,6 +255,7 @@ struct ext2_inode_t {
 #define EXT2_INDEX_FL					0x00001000 /* hash indexed directory */
 #define EXT2_IMAGIC_FL					0x00002000 /* AFS directory */
 #define EXT3_JOURNAL_DATA_FL			0x00004000 /* journal file data */
+#define EXT4_EXTENTS_FL					0x00080000 /* inode uses extents */
 #define EXT2_RESERVED_FL				0x80000000 /* reserved for ext2 library */
 
 /* The ext2 directory entry. */
@@ -225,6 +266,38 @@ struct ext2_dirent_t {
 	u8_t filetype;
 } __attribute__ ((packed));
 
+/* Directory index hash versions */
+#define EXT2_HASH_LEGACY				0
+#define EXT2_HASH_HALF_MD4				1
+#define EXT2_HASH_TEA					2
+#define EXT2_HASH_LEGACY_UNSIGNED		3
+#define EXT2_HASH_HALF_MD4_UNSIGNED		4
+#define EXT2_HASH_TEA_UNSIGNED			5
+
+/* Maximum depth of a directory index, root included */
+#define EXT2_DX_MAX_LEVELS				3
+
+/* The directory index root info, following the "." and ".." entries of block 0 */
+struct ext2_dx_root_info_t {
+	u32_t reserved_zero;
+	u8_t hash_version;
+	u8_t info_length;	/* Size of this structure */
+	u8_t indirect_levels;
+	u8_t unused_flags;
+} __attribute__ ((packed));
+
+/* The count and limit of a directory index node, taking the place of its first hash */
+struct ext2_dx_countlimit_t {
+	u16_t limit;
+	u16_t count;
+} __attribute__ ((packed));
+
+/* The directory index entry, sorted by hash */
+struct ext2_dx_entry_t {
+	u32_t hash;		/* Lowest hash held by block */
+	u32_t block;	/* Logical block of the directory */
+} __attribute__ ((packed));
+
 /* Directory entry file types */
 #define EXT2_FT_UNKNOWN					0 /* Unknown File Type */
 #define EXT2_FT_REG_FILE				1 /* Regular File */
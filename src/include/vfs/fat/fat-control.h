@@ -8,6 +8,20 @@ extern "C" {
 #include <vfs/fat/fat.h>
 
 #define FAT_TABLE_CACHE_SIZE	(32)
+#define FAT_TABLE_CACHE_SECTORS	(8)
+#define FAT_TABLE_CACHE_HASH	(64)
+
+/*
+ * A window of consecutive FAT sectors kept in memory
+ */
+struct fatfs_fat_cache_t {
+	struct hlist_node node;
+	struct list_head entry;
+	u32_t sect_num;
+	bool_t valid;
+	bool_t dirty;
+	u8_t * buf;
+};
 
 /*
  * Information about a "mounted" FAT filesystem
@@ -44,10 +58,20 @@ struct fatfs_control_t {
 
 	/* FAT sector cache */
 	struct mutex_t fat_cache_lock;
-	u32_t fat_cache_victim;
-	bool_t fat_cache_dirty[FAT_TABLE_CACHE_SIZE];
-	u32_t fat_cache_num[FAT_TABLE_CACHE_SIZE];
+	struct fatfs_fat_cache_t fat_cache[FAT_TABLE_CACHE_SIZE];
+	struct hlist_head fat_cache_hash[FAT_TABLE_CACHE_HASH];
+	struct list_head fat_cache_lru;
 	u8_t * fat_cache_buf;
+
+	/* Free cluster bitmap, one bit per data cluster, set when in use */
+	u32_t * free_map;
+	bool_t free_map_valid;
+	u32_t free_count;
+	u32_t next_free;
+
+	/* FAT32 file system information sector */
+	u32_t fsinfo_sector;
+	bool_t fsinfo_dirty;
 };
 
 u32_t fatfs_pack_timestamp(u32_t year, u32_t mon, u32_t day, u32_t hour, u32_t min, u32_t sec);
@@ -58,6 +82,7 @@ int fatfs_control_nth_cluster(struct fatfs_control_t * ctrl, u32_t clust, u32_t
 int fatfs_control_set_last_cluster(struct fatfs_control_t * ctrl, u32_t clust);
 int fatfs_control_alloc_first_cluster(struct fatfs_control_t * ctrl, u32_t * newclust);
 int fatfs_control_append_free_cluster(struct fatfs_control_t * ctrl, u32_t clust, u32_t * newclust);
+int fatfs_control_alloc_clusters(struct fatfs_control_t * ctrl, u32_t clust, u32_t count, u32_t * newclust);
 int fatfs_control_truncate_clusters(struct fatfs_control_t * ctrl, u32_t clust);
 int fatfs_control_sync(struct fatfs_control_t * ctrl);
 int fatfs_control_init(struct fatfs_control_t * ctrl, struct block_t * bdev);
@@ -7,6 +7,14 @@ extern "C" {
 
 #include <vfs/fat/fat.h>
 
+/*
+ * A run of contiguous clusters, starting at file cluster index
+ */
+struct fatfs_extent_t {
+	u32_t index;
+	u32_t cluster;
+	u32_t count;
+};
 
 /*
  * Information for accessing a FAT file/directory
@@ -33,6 +41,14 @@ struct fatfs_node_t {
 	u8_t *cached_data;
 	u32_t cached_clust;
 	bool_t cached_dirty;
+
+	/* Cluster extent map, built lazily from first cluster */
+	struct fatfs_extent_t * extents;
+	u32_t extent_count;
+	u32_t extent_size;
+	u32_t extent_clusters;
+	u32_t extent_first;
+	bool_t extent_eof;
 };
 
 u32_t fatfs_node_get_size(struct fatfs_node_t * node);
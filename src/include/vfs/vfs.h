@@ -21,6 +21,7 @@ extern "C" {
 #define	VFS_MAX_NAME		(256)
 #define VFS_MAX_FD			(256)
 #define VFS_NODE_HASH_SIZE	(256)
+#define VFS_DENTRY_MAX		(256)
 
 #define O_RDONLY			(1 << 0)
 #define O_WRONLY			(1 << 1)
@@ -144,6 +145,10 @@ struct vfs_node_t {
 	void * v_data;
 };
 
+enum {
+	FS_NOCACHE	= (0x1 << 0),	/* Namespace also changes outside the vfs */
+};
+
 enum {
 	MOUNT_RW	= (0x0 << 0),
 	MOUNT_RO	= (0x1 << 0),
@@ -167,6 +172,7 @@ struct filesystem_t {
 	struct kobj_t * kobj;
 	struct list_head list;
 	const char * name;
+	u32_t flags;
 
 	int (*mount)(struct vfs_mount_t *, const char *);
 	int (*unmount)(struct vfs_mount_t *);
@@ -61,8 +61,15 @@ extern "C" {
 #include <xboot/device.h>
 #include <xboot/driver.h>
 #include <xboot/task.h>
+#include <xboot/trace.h>
+#include <xboot/slab.h>
 #include <xboot/mutex.h>
+#include <xboot/rwlock.h>
+#include <xboot/semaphore.h>
+#include <xboot/condvar.h>
 #include <xboot/channel.h>
+#include <xboot/workqueue.h>
+#include <xboot/future.h>
 #include <xboot/window.h>
 #include <xboot/module.h>
 #include <xboot/setting.h>
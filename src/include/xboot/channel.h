@@ -6,23 +6,48 @@ extern "C" {
 #endif
 
 #include <types.h>
+#include <stdint.h>
 #include <list.h>
 #include <spinlock.h>
 
+enum channel_flag_t {
+	CHANNEL_FLAG_SPSC	= (1 << 0),
+};
+
+struct task_t;
+
+struct channel_waiter_t {
+	struct list_head entry;
+	struct task_t * task;
+};
+
 struct channel_t {
 	unsigned char * buffer;
 	unsigned int size;
 	unsigned int in;
 	unsigned int out;
+	int flags;
 	struct list_head swait;
 	struct list_head rwait;
 	spinlock_t lock;
 };
 
+struct channel_select_t {
+	struct channel_t * c;
+	int send;
+	struct channel_waiter_t w;
+};
+
 struct channel_t * channel_alloc(unsigned int size);
+struct channel_t * channel_alloc_spsc(unsigned int size);
 void channel_free(struct channel_t * c);
 void channel_send(struct channel_t * c, unsigned char * buf, unsigned int len);
 void channel_recv(struct channel_t * c, unsigned char * buf, unsigned int len);
+unsigned int channel_reserve(struct channel_t * c, unsigned char ** buf, unsigned int len);
+void channel_commit(struct channel_t * c, unsigned int len);
+unsigned int channel_peek(struct channel_t * c, unsigned char ** buf, unsigned int len);
+void channel_consume(struct channel_t * c, unsigned int len);
+int channel_select(struct channel_select_t * sel, int n, int64_t timeout);
 
 #ifdef __cplusplus
 }
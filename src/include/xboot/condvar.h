@@ -0,0 +1,27 @@
+#ifndef __CONDVAR_H__
+#define __CONDVAR_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <types.h>
+#include <list.h>
+#include <spinlock.h>
+#include <xboot/mutex.h>
+
+struct condvar_t {
+	struct list_head wait;
+	spinlock_t lock;
+};
+
+void condvar_init(struct condvar_t * cv);
+void condvar_wait(struct condvar_t * cv, struct mutex_t * m);
+void condvar_signal(struct condvar_t * cv);
+void condvar_broadcast(struct condvar_t * cv);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __CONDVAR_H__ */
@@ -0,0 +1,34 @@
+#ifndef __FUTURE_H__
+#define __FUTURE_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <types.h>
+#include <list.h>
+#include <spinlock.h>
+#include <xboot/workqueue.h>
+
+struct future_t;
+typedef void (*future_then_func_t)(struct future_t * f, void * value, void * data);
+
+struct future_t {
+	int ready;
+	void * value;
+	struct list_head wait;
+	struct list_head then;
+	spinlock_t lock;
+};
+
+void future_init(struct future_t * f);
+void future_set(struct future_t * f, void * value);
+int future_ready(struct future_t * f);
+int future_get(struct future_t * f, void ** value, int64_t timeout);
+int future_then(struct future_t * f, future_then_func_t func, void * data);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __FUTURE_H__ */
@@ -40,6 +40,7 @@ struct machine_t {
 	void (*shutdown)(struct machine_t * mach);
 	void (*reboot)(struct machine_t * mach);
 	void (*sleep)(struct machine_t * mach);
+	void (*idle)(struct machine_t * mach);
 	void (*cleanup)(struct machine_t * mach);
 	void (*logger)(struct machine_t * mach, const char * buf, int count);
 	const char * (*uniqueid)(struct machine_t * mach);
@@ -55,6 +56,7 @@ void machine_smpboot(void (*func)(void));
 void machine_shutdown(void);
 void machine_reboot(void);
 void machine_sleep(void);
+void machine_idle(void);
 void machine_cleanup(void);
 int machine_logger(const char * fmt, ...);
 const char * machine_uniqueid(void);
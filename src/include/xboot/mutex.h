@@ -10,14 +10,18 @@ extern "C" {
 #include <atomic.h>
 #include <spinlock.h>
 
+struct task_t;
+
 struct mutex_t {
 	atomic_t atomic;
+	struct task_t * owner;
 	struct list_head mwait;
 	spinlock_t lock;
 };
 
 void mutex_init(struct mutex_t * m);
 void mutex_lock(struct mutex_t * m);
+int mutex_trylock(struct mutex_t * m);
 void mutex_unlock(struct mutex_t * m);
 
 #ifdef __cplusplus
@@ -0,0 +1,28 @@
+#ifndef __RWLOCK_H__
+#define __RWLOCK_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <types.h>
+#include <list.h>
+#include <spinlock.h>
+
+struct rwlock_t {
+	int count;
+	struct list_head wait;
+	spinlock_t lock;
+};
+
+void rwlock_init(struct rwlock_t * rw);
+void rwlock_read_lock(struct rwlock_t * rw);
+void rwlock_read_unlock(struct rwlock_t * rw);
+void rwlock_write_lock(struct rwlock_t * rw);
+void rwlock_write_unlock(struct rwlock_t * rw);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __RWLOCK_H__ */
@@ -0,0 +1,65 @@
+#ifndef __SLAB_H__
+#define __SLAB_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <xconfigs.h>
+#include <types.h>
+#include <list.h>
+#include <spinlock.h>
+
+#define KMEM_CPU_DEPTH		(16)
+#define KMEM_CPU_BATCH		(KMEM_CPU_DEPTH / 2)
+
+struct kmem_cpu_cache_t {
+	void * objs[KMEM_CPU_DEPTH];
+	int count;
+	spinlock_t lock;
+};
+
+struct kmem_cache_t {
+	struct list_head list;
+	const char * name;
+	size_t size;
+	size_t align;
+	void (*ctor)(void * obj);
+	void (*dtor)(void * obj);
+
+	size_t objsize;
+	size_t slabsize;
+	unsigned int nobjs;
+	struct list_head partial;
+	struct list_head full;
+	struct list_head empty;
+	struct kmem_cpu_cache_t cpu[CONFIG_MAX_SMP_CPUS];
+	spinlock_t lock;
+
+	unsigned long slabs;
+	unsigned long inuse;
+	unsigned long hit;
+	unsigned long miss;
+};
+
+/*
+ * A statically defined cache is set up on its first allocation, so it may
+ * be used from any init level without an explicit init call.
+ */
+#define KMEM_CACHE_DEFINE(var, n, s, a, c, d) \
+	struct kmem_cache_t var = { .name = n, .size = s, .align = a, .ctor = c, .dtor = d }
+
+struct kmem_cache_t * kmem_cache_create(const char * name, size_t size, size_t align, void (*ctor)(void *), void (*dtor)(void *));
+void kmem_cache_destroy(struct kmem_cache_t * c);
+void * kmem_cache_alloc(struct kmem_cache_t * c);
+void * kmem_cache_zalloc(struct kmem_cache_t * c);
+void kmem_cache_free(struct kmem_cache_t * c, void * obj);
+void kmem_cache_shrink(struct kmem_cache_t * c);
+
+void do_init_slab(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __SLAB_H__ */
@@ -13,15 +13,20 @@ extern "C" {
 #include <spinlock.h>
 #include <smp.h>
 #include <rbtree_augmented.h>
+#include <xboot/ktime.h>
+#include <time/timer.h>
 
 struct task_t;
 struct scheduler_t;
+struct task_group_t;
+struct arena_t;
 typedef void (*task_func_t)(struct task_t * task, void * data);
 
 enum task_status_t {
 	TASK_STATUS_RUNNING	= 0,
 	TASK_STATUS_READY	= 1,
 	TASK_STATUS_SUSPEND	= 2,
+	TASK_STATUS_EXIT	= 3,
 };
 
 struct task_data_t {
@@ -33,9 +38,6 @@ struct task_data_t {
 struct task_t {
 	struct rb_node node;
 	struct list_head list;
-	struct list_head slist;
-	struct list_head rlist;
-	struct list_head mlist;
 	struct scheduler_t * sched;
 	enum task_status_t status;
 	uint64_t start;
@@ -50,18 +52,43 @@ struct task_t {
 	uint32_t inv_weight;
 	task_func_t func;
 	void * data;
+	struct arena_t * arena;
+	struct list_head join;
+	struct list_head gentry;
+	struct task_group_t * group;
+	int joinable;
+	int exited;
+	int wakeup;
+	int pinned;
 	int __errno;
 };
 
+struct task_group_t {
+	struct list_head running;
+	struct list_head exited;
+	struct list_head wait;
+};
+
 struct scheduler_t {
 	struct rb_root_cached ready;
 	struct list_head suspend;
 	struct task_t * running;
+	struct task_t * idle;
 	uint64_t min_vtime;
 	uint64_t weight;
+	uint64_t balance;
+	uint64_t migrations;
+	uint64_t idle_time;
+	uint64_t idle_count;
 	spinlock_t lock;
 };
 
+struct task_timeout_t {
+	struct timer_t timer;
+	struct task_t * task;
+	int expired;
+};
+
 extern struct scheduler_t __sched[CONFIG_MAX_SMP_CPUS];
 
 static inline struct scheduler_t * scheduler_self(void)
@@ -74,12 +101,33 @@ static inline struct task_t * task_self(void)
 	return __sched[smp_processor_id()].running;
 }
 
+static inline struct arena_t * task_arena(void)
+{
+	struct task_t * self = task_self();
+	return self ? self->arena : NULL;
+}
+
 struct task_t * task_create(struct scheduler_t * sched, const char * name, task_func_t func, void * data, size_t stksz, int nice);
 void task_destroy(struct task_t * task);
+void task_set_joinable(struct task_t * task, int joinable);
+void task_set_pinned(struct task_t * task, int pinned);
+void task_join(struct task_t * task);
 void task_renice(struct task_t * task, int nice);
 void task_suspend(struct task_t * task);
 void task_resume(struct task_t * task);
 void task_yield(void);
+void task_timeout_start(struct task_timeout_t * to, ktime_t expires);
+void task_timeout_cancel(struct task_timeout_t * to);
+void task_sleep(uint64_t ns);
+void task_sleep_until(ktime_t expires);
+size_t task_stack_usage(struct task_t * task);
+
+void task_group_init(struct task_group_t * g);
+struct task_t * task_group_spawn(struct task_group_t * g, struct scheduler_t * sched, const char * name, task_func_t func, void * data, size_t stksz, int nice);
+int task_group_wait_any(struct task_group_t * g, void ** data);
+int task_group_wait_all(struct task_group_t * g);
+
+void scheduler_load_balance(struct scheduler_t * sched, int idle);
 
 struct task_data_t * task_data_alloc(const char * fb, const char * input, void * data);
 void task_data_free(struct task_data_t * td);
@@ -0,0 +1,69 @@
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <types.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic.h>
+#include <xboot/ktime.h>
+
+struct task_t;
+
+enum trace_type_t {
+	TRACE_TYPE_SWITCH	= 0,
+	TRACE_TYPE_SUSPEND	= 1,
+	TRACE_TYPE_RESUME	= 2,
+	TRACE_TYPE_MUTEX	= 3,
+	TRACE_TYPE_TIMER	= 4,
+};
+
+struct trace_event_t {
+	uint64_t ts;
+	uint64_t dur;
+	enum trace_type_t type;
+	void * arg;
+	char name[16];
+};
+
+struct trace_buffer_t {
+	struct trace_event_t * event;
+	unsigned int size;
+	atomic_t head;
+};
+
+extern int __trace_enable;
+
+void __trace_record(enum trace_type_t type, struct task_t * task, void * arg, uint64_t ts, uint64_t dur);
+
+static inline int trace_enabled(void)
+{
+	return unlikely(__trace_enable);
+}
+
+static inline void trace_record(enum trace_type_t type, struct task_t * task, void * arg)
+{
+	if(trace_enabled())
+		__trace_record(type, task, arg, 0, 0);
+}
+
+static inline void trace_record_span(enum trace_type_t type, struct task_t * task, void * arg, uint64_t ts, uint64_t dur)
+{
+	if(trace_enabled())
+		__trace_record(type, task, arg, ts, dur);
+}
+
+void trace_start(void);
+void trace_stop(void);
+void trace_clear(void);
+int trace_dump(const char * path);
+void do_init_trace(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __TRACE_H__ */
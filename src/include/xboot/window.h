@@ -9,6 +9,7 @@ extern "C" {
 #include <stdint.h>
 #include <list.h>
 #include <fifo.h>
+#include <arena.h>
 #include <irqflags.h>
 #include <spinlock.h>
 #include <xboot/event.h>
@@ -38,6 +39,7 @@ struct window_t {
 	struct region_list_t * rl;
 	struct fifo_t * event;
 	struct hmap_t * map;
+	struct arena_t * arena;
 	int launcher;
 };
 
@@ -0,0 +1,57 @@
+#ifndef __WORKQUEUE_H__
+#define __WORKQUEUE_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <types.h>
+#include <list.h>
+#include <spinlock.h>
+#include <xboot/ktime.h>
+#include <xboot/semaphore.h>
+#include <time/timer.h>
+
+struct work_t;
+struct worker_t;
+typedef void (*work_func_t)(struct work_t * work, void * data);
+
+enum work_state_t {
+	WORK_STATE_IDLE		= 0,
+	WORK_STATE_PENDING	= 1,
+	WORK_STATE_DELAYED	= 2,
+	WORK_STATE_RUNNING	= 3,
+};
+
+struct work_t {
+	struct list_head entry;
+	struct timer_t timer;
+	struct worker_t * worker;
+	enum work_state_t state;
+	work_func_t func;
+	work_func_t done;
+	void * data;
+};
+
+struct worker_t {
+	struct task_t * task;
+	struct list_head head;
+	struct list_head flush;
+	struct semaphore_t sem;
+};
+
+void work_init(struct work_t * work, work_func_t func, work_func_t done, void * data);
+int work_queue(struct work_t * work);
+int work_queue_on(int cpu, struct work_t * work);
+int work_queue_delayed(struct work_t * work, uint64_t ns);
+int work_pending(struct work_t * work);
+void work_flush(struct work_t * work);
+int work_cancel(struct work_t * work);
+
+void do_init_workqueue(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __WORKQUEUE_H__ */
@@ -19,6 +19,42 @@ extern "C" {
 #define CONFIG_TASK_STACK_SIZE				(512 * 1024)
 #endif
 
+#if !defined(CONFIG_TASK_POOL_DEPTH)
+#define CONFIG_TASK_POOL_DEPTH				(4)
+#endif
+
+#if !defined(CONFIG_MALLOC_CACHE)
+#define CONFIG_MALLOC_CACHE					(1)
+#endif
+
+#if !defined(CONFIG_MALLOC_CACHE_DEPTH)
+#define CONFIG_MALLOC_CACHE_DEPTH			(32)
+#endif
+
+#if !defined(CONFIG_MALLOC_PROFILE)
+#define CONFIG_MALLOC_PROFILE				(0)
+#endif
+
+#if !defined(CONFIG_BLOCK_CACHE_SIZE)
+#define CONFIG_BLOCK_CACHE_SIZE				(256 * 1024)
+#endif
+
+#if !defined(CONFIG_BLOCK_READAHEAD_SIZE)
+#define CONFIG_BLOCK_READAHEAD_SIZE			(32 * 1024)
+#endif
+
+#if !defined(CONFIG_DMA_POOL_SIZE)
+#define CONFIG_DMA_POOL_SIZE				(4 * 1024 * 1024)
+#endif
+
+#if !defined(CONFIG_WINDOW_ARENA_SIZE)
+#define CONFIG_WINDOW_ARENA_SIZE			(64 * 1024)
+#endif
+
+#if !defined(CONFIG_TRACE_BUFFER_SIZE)
+#define CONFIG_TRACE_BUFFER_SIZE			(4096)
+#endif
+
 #if !defined(CONFIG_DRIVER_HASH_SIZE)
 #define CONFIG_DRIVER_HASH_SIZE				(521)
 #endif
@@ -34,9 +34,18 @@ void xboot_main(void)
 	/* Do initial memory */
 	do_init_mem();
 
+	/* Do initial slab */
+	do_init_slab();
+
 	/* Do initial scheduler */
 	do_init_sched();
 
+	/* Do initial trace */
+	do_init_trace();
+
+	/* Do initial workqueue */
+	do_init_workqueue();
+
 	/* Do initial vfs */
 	do_init_vfs();
 
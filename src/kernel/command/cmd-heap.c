@@ -0,0 +1,158 @@
+/*
+ * kernel/command/cmd-heap.c
+ *
+ * Copyright(c) 2007-2021 Jianjun Jiang <8192542@qq.com>
+ * Official site: http://xboot.org
+ * Mobile phone: +86-18665388956
+ * QQ: 8192542
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#include <xboot.h>
+#include <command/command.h>
+
+static void usage(void)
+{
+	printf("usage:\r\n");
+	printf("    heap frag\r\n");
+#if defined(CONFIG_MALLOC_PROFILE) && (CONFIG_MALLOC_PROFILE > 0)
+	printf("    heap top [count]\r\n");
+	printf("    heap snapshot <slot>\r\n");
+	printf("    heap diff <slot> <slot> [count]\r\n");
+#endif
+}
+
+static void heap_frag(void)
+{
+	struct malloc_frag_t f;
+	int i;
+
+	malloc_frag(&f);
+	printf(" %-12s %8s %12s\r\n", "size", "blocks", "bytes");
+	for(i = 0; i < MALLOC_FRAG_BUCKETS; i++)
+	{
+		if(f.count[i] > 0)
+			printf(" >= %-9lu %8lu %12lu\r\n", 1UL << i, (unsigned long)f.count[i], (unsigned long)f.bytes[i]);
+	}
+	printf(" free blocks: %lu, free bytes: %lu, largest: %lu\r\n", (unsigned long)f.nfree, (unsigned long)f.tfree, (unsigned long)f.largest);
+	if(f.tfree > 0)
+		printf(" fragmentation: %lu%%\r\n", (unsigned long)(100 - (u64_t)f.largest * 100 / f.tfree));
+}
+
+#if defined(CONFIG_MALLOC_PROFILE) && (CONFIG_MALLOC_PROFILE > 0)
+static void heap_show_sites(struct malloc_site_t * sites, int n, int age)
+{
+	u64_t now = ktime_to_ns(ktime_get());
+	int i;
+
+	printf(" %-18s %8s %12s", "caller", "blocks", "bytes");
+	if(age)
+		printf(" %10s", "oldest(s)");
+	printf("\r\n");
+	for(i = 0; i < n; i++)
+	{
+		printf(" %-18p %8ld %12ld", sites[i].caller, (long)sites[i].count, (long)sites[i].bytes);
+		if(age)
+			printf(" %10llu", (unsigned long long)((now - sites[i].oldest) / 1000000000ULL));
+		printf("\r\n");
+	}
+}
+#endif
+
+static int do_heap(int argc, char ** argv)
+{
+#if defined(CONFIG_MALLOC_PROFILE) && (CONFIG_MALLOC_PROFILE > 0)
+	struct malloc_site_t * sites;
+	int n;
+#endif
+
+	if(argc < 2)
+	{
+		usage();
+		return -1;
+	}
+
+	if(!strcmp(argv[1], "frag"))
+	{
+		heap_frag();
+	}
+#if defined(CONFIG_MALLOC_PROFILE) && (CONFIG_MALLOC_PROFILE > 0)
+	else if(!strcmp(argv[1], "top") && (argc <= 3))
+	{
+		n = (argc == 3) ? strtol(argv[2], NULL, 0) : 16;
+		if((n <= 0) || !(sites = malloc(sizeof(struct malloc_site_t) * n)))
+			return -1;
+		n = malloc_profile_top(sites, n);
+		heap_show_sites(sites, n, 1);
+		free(sites);
+	}
+	else if(!strcmp(argv[1], "snapshot") && (argc == 3))
+	{
+		n = malloc_profile_snapshot(strtol(argv[2], NULL, 0));
+		if(n < 0)
+		{
+			printf("Can not take snapshot '%s'\r\n", argv[2]);
+			return -1;
+		}
+		printf("Snapshot '%s' with %d sites\r\n", argv[2], n);
+	}
+	else if(!strcmp(argv[1], "diff") && ((argc == 4) || (argc == 5)))
+	{
+		n = (argc == 5) ? strtol(argv[4], NULL, 0) : 16;
+		if((n <= 0) || !(sites = malloc(sizeof(struct malloc_site_t) * n)))
+			return -1;
+		n = malloc_profile_diff(strtol(argv[2], NULL, 0), strtol(argv[3], NULL, 0), sites, n);
+		if(n < 0)
+		{
+			printf("Can not diff snapshot '%s' and '%s'\r\n", argv[2], argv[3]);
+			free(sites);
+			return -1;
+		}
+		heap_show_sites(sites, n, 0);
+		free(sites);
+	}
+#endif
+	else
+	{
+		usage();
+		return -1;
+	}
+	return 0;
+}
+
+static struct command_t cmd_heap = {
+	.name	= "heap",
+	.desc	= "show heap fragmentation and allocation sites",
+	.usage	= usage,
+	.exec	= do_heap,
+};
+
+static __init void heap_cmd_init(void)
+{
+	register_command(&cmd_heap);
+}
+
+static __exit void heap_cmd_exit(void)
+{
+	unregister_command(&cmd_heap);
+}
+
+command_initcall(heap_cmd_init);
+command_exitcall(heap_cmd_exit);
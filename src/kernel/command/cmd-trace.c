@@ -1,5 +1,5 @@
 /*
- * dmapool.c
+ * kernel/command/cmd-trace.c
  *
  * Copyright(c) 2007-2021 Jianjun Jiang <8192542@qq.com>
  * Official site: http://xboot.org
@@ -25,43 +25,77 @@
  * SOFTWARE.
  *
  */
+#include <xboot.h>
+#include <command/command.h>
 
-#include <stddef.h>
-#include <sizes.h>
-#include <spinlock.h>
-#include <malloc.h>
-
-extern unsigned char __dma_start[];
-extern unsigned char __dma_end[];
-
-static void * __dma_pool = NULL;
-static spinlock_t __dma_lock = SPIN_LOCK_INIT();
+static void usage(void)
+{
+	printf("usage:\r\n");
+	printf("    trace start\r\n");
+	printf("    trace stop\r\n");
+	printf("    trace clear\r\n");
+	printf("    trace dump <file>\r\n");
+}
 
-void * dma_alloc_coherent(unsigned long size)
+static int do_trace(int argc, char ** argv)
 {
-	irq_flags_t flags;
-	void * m;
+	char fpath[VFS_MAX_PATH];
 
-	if(!__dma_pool)
-		__dma_pool = mm_create((void *)__dma_start, (size_t)(__dma_end - __dma_start));
-	if(__dma_pool)
+	if(argc < 2)
+	{
+		usage();
+		return -1;
+	}
+
+	if(!strcmp(argv[1], "start"))
+	{
+		trace_start();
+	}
+	else if(!strcmp(argv[1], "stop"))
+	{
+		trace_stop();
+	}
+	else if(!strcmp(argv[1], "clear"))
 	{
-		spin_lock_irqsave(&__dma_lock, flags);
-		m = mm_memalign(__dma_pool, SZ_4K, size);
-		spin_unlock_irqrestore(&__dma_lock, flags);
-		return m;
+		trace_clear();
 	}
-	return NULL;
+	else if(!strcmp(argv[1], "dump") && (argc == 3))
+	{
+		if(shell_realpath(argv[2], fpath) < 0)
+		{
+			usage();
+			return -1;
+		}
+		if(trace_dump(fpath) < 0)
+		{
+			printf("Can not dump trace to '%s'\r\n", fpath);
+			return -1;
+		}
+	}
+	else
+	{
+		usage();
+		return -1;
+	}
+	return 0;
 }
 
-void dma_free_coherent(void * addr)
+static struct command_t cmd_trace = {
+	.name	= "trace",
+	.desc	= "record scheduler events as chrome trace",
+	.usage	= usage,
+	.exec	= do_trace,
+};
+
+static __init void trace_cmd_init(void)
 {
-	irq_flags_t flags;
+	register_command(&cmd_trace);
+}
 
-	if(__dma_pool)
-	{
-		spin_lock_irqsave(&__dma_lock, flags);
-		mm_free(__dma_pool, addr);
-		spin_unlock_irqrestore(&__dma_lock, flags);
-	}
+static __exit void trace_cmd_exit(void)
+{
+	unregister_command(&cmd_trace);
 }
+
+command_initcall(trace_cmd_init);
+command_exitcall(trace_cmd_exit);
@@ -25,11 +25,10 @@
  * SOFTWARE.
  *
  */
-
 #include <xboot.h>
 #include <xboot/channel.h>
 
-struct channel_t * channel_alloc(unsigned int size)
+static struct channel_t * __channel_alloc(unsigned int size, int flags)
 {
 	struct channel_t * c;
 
@@ -49,6 +48,7 @@ struct channel_t * channel_alloc(unsigned int size)
 	c->size = size;
 	c->in = 0;
 	c->out = 0;
+	c->flags = flags;
 	init_list_head(&c->swait);
 	init_list_head(&c->rwait);
 	spin_lock_init(&c->lock);
@@ -56,6 +56,16 @@ struct channel_t * channel_alloc(unsigned int size)
 	return c;
 }
 
+struct channel_t * channel_alloc(unsigned int size)
+{
+	return __channel_alloc(size, 0);
+}
+
+struct channel_t * channel_alloc_spsc(unsigned int size)
+{
+	return __channel_alloc(size, CHANNEL_FLAG_SPSC);
+}
+
 void channel_free(struct channel_t * c)
 {
 	if(c)
@@ -65,41 +75,105 @@ void channel_free(struct channel_t * c)
 	}
 }
 
-static inline int channel_isempty(struct channel_t * c)
+/*
+ * The producer only writes 'in' and the consumer only writes 'out', so
+ * the ring itself needs nothing but barriers. The spinlock serialises
+ * multiple producers or consumers and protects the wait lists, and in
+ * spsc mode it is only taken when there is a waiter to wake up.
+ */
+static inline unsigned int channel_space(struct channel_t * c)
+{
+	unsigned int used = c->in - c->out;
+
+	smp_mb();
+	return c->size - used;
+}
+
+static inline unsigned int channel_avail(struct channel_t * c)
 {
-	int ret;
+	unsigned int used = c->in - c->out;
+
+	smp_rmb();
+	return used;
+}
+
+static inline void channel_wakeup(struct channel_t * c, struct list_head * head)
+{
+	struct channel_waiter_t * pos, * n;
 
 	spin_lock(&c->lock);
-	ret = (c->in - c->out <= 0) ? 1 : 0;
+	list_for_each_entry_safe(pos, n, head, entry)
+	{
+		list_del_init(&pos->entry);
+		task_resume(pos->task);
+	}
 	spin_unlock(&c->lock);
-
-	return ret;
 }
 
-static inline int channel_isfull(struct channel_t * c)
+static inline void channel_add_waiter(struct channel_t * c, struct list_head * head, struct channel_waiter_t * w)
 {
-	int ret;
+	spin_lock(&c->lock);
+	if(list_empty_careful(&w->entry))
+		list_add_tail(&w->entry, head);
+	spin_unlock(&c->lock);
+	smp_mb();
+}
 
+static inline void channel_del_waiter(struct channel_t * c, struct channel_waiter_t * w)
+{
 	spin_lock(&c->lock);
-	ret = (c->in - c->out >= c->size) ? 1 : 0;
+	list_del_init(&w->entry);
 	spin_unlock(&c->lock);
+}
 
-	return ret;
+static inline void channel_wakeup_senders(struct channel_t * c)
+{
+	smp_mb();
+	if(!list_empty_careful(&c->swait))
+		channel_wakeup(c, &c->swait);
+}
+
+static inline void channel_wakeup_receivers(struct channel_t * c)
+{
+	smp_mb();
+	if(!list_empty_careful(&c->rwait))
+		channel_wakeup(c, &c->rwait);
+}
+
+static inline void channel_wait_space(struct channel_t * c)
+{
+	struct channel_waiter_t w;
+
+	init_list_head(&w.entry);
+	w.task = task_self();
+	channel_add_waiter(c, &c->swait, &w);
+	if(channel_space(c) == 0)
+		task_suspend(w.task);
+	channel_del_waiter(c, &w);
+}
+
+static inline void channel_wait_avail(struct channel_t * c)
+{
+	struct channel_waiter_t w;
+
+	init_list_head(&w.entry);
+	w.task = task_self();
+	channel_add_waiter(c, &c->rwait, &w);
+	if(channel_avail(c) == 0)
+		task_suspend(w.task);
+	channel_del_waiter(c, &w);
 }
 
 static inline unsigned int __channel_put(struct channel_t * c, unsigned char * buf, unsigned int len)
 {
 	unsigned int l;
 
-	spin_lock(&c->lock);
-	len = min(len, c->size - c->in + c->out);
-	smp_mb();
+	len = min(len, channel_space(c));
 	l = min(len, c->size - (c->in & (c->size - 1)));
 	memcpy(c->buffer + (c->in & (c->size - 1)), buf, l);
 	memcpy(c->buffer, buf + l, len - l);
 	smp_wmb();
 	c->in += len;
-	spin_unlock(&c->lock);
 
 	return len;
 }
@@ -108,146 +182,63 @@ static inline unsigned int __channel_get(struct channel_t * c, unsigned char * b
 {
 	unsigned int l;
 
-	spin_lock(&c->lock);
-	len = min(len, c->in - c->out);
-	smp_rmb();
+	len = min(len, channel_avail(c));
 	l = min(len, c->size - (c->out & (c->size - 1)));
 	memcpy(buf, c->buffer + (c->out & (c->size - 1)), l);
 	memcpy(buf + l, c->buffer, len - l);
 	smp_mb();
 	c->out += len;
-	spin_unlock(&c->lock);
 
 	return len;
 }
 
 static inline unsigned int channel_put(struct channel_t * c, unsigned char * buf, unsigned int len)
 {
-	struct task_t * self;
-	struct task_t * pos, * n;
 	unsigned int l;
 
-	if(channel_isfull(c))
-	{
-		self = task_self();
-		spin_lock(&c->lock);
-		if(!list_empty(&c->rwait))
-		{
-			list_for_each_entry_safe(pos, n, &c->rwait, rlist)
-			{
-				list_del_init(&pos->rlist);
-				task_resume(pos);
-			}
-		}
-		if(list_empty_careful(&self->slist))
-		{
-			list_add_tail(&self->slist, &c->swait);
-		}
-		spin_unlock(&c->lock);
-		task_suspend(self);
-		l = __channel_put(c, buf, len);
-	}
-	else if(channel_isempty(c))
+	while(1)
 	{
-		l = __channel_put(c, buf, len);
-		spin_lock(&c->lock);
-		if(!list_empty(&c->rwait))
-		{
-			list_for_each_entry_safe(pos, n, &c->rwait, rlist)
-			{
-				list_del_init(&pos->rlist);
-				task_resume(pos);
-			}
-		}
-		if(!list_empty(&c->swait))
+		if(c->flags & CHANNEL_FLAG_SPSC)
 		{
-			list_for_each_entry_safe(pos, n, &c->swait, slist)
-			{
-				list_del_init(&pos->slist);
-				task_resume(pos);
-			}
+			l = __channel_put(c, buf, len);
 		}
-		spin_unlock(&c->lock);
-	}
-	else
-	{
-		l = __channel_put(c, buf, len);
-		spin_lock(&c->lock);
-		if(!list_empty(&c->rwait))
+		else
 		{
-			list_for_each_entry_safe(pos, n, &c->rwait, rlist)
-			{
-				list_del_init(&pos->rlist);
-				task_resume(pos);
-			}
+			spin_lock(&c->lock);
+			l = __channel_put(c, buf, len);
+			spin_unlock(&c->lock);
 		}
-		spin_unlock(&c->lock);
+		if(l > 0)
+			break;
+		channel_wait_space(c);
 	}
+	channel_wakeup_receivers(c);
+
 	return l;
 }
 
 static inline unsigned int channel_get(struct channel_t * c, unsigned char * buf, unsigned int len)
 {
-	struct task_t * self;
-	struct task_t * pos, * n;
 	unsigned int l;
 
-	if(channel_isempty(c))
+	while(1)
 	{
-		self = task_self();
-		spin_lock(&c->lock);
-		if(!list_empty(&c->swait))
+		if(c->flags & CHANNEL_FLAG_SPSC)
 		{
-			list_for_each_entry_safe(pos, n, &c->swait, slist)
-			{
-				list_del_init(&pos->slist);
-				task_resume(pos);
-			}
+			l = __channel_get(c, buf, len);
 		}
-		if(list_empty_careful(&self->rlist))
+		else
 		{
-			list_add_tail(&self->rlist, &c->rwait);
+			spin_lock(&c->lock);
+			l = __channel_get(c, buf, len);
+			spin_unlock(&c->lock);
 		}
-		spin_unlock(&c->lock);
-		task_suspend(self);
-		l = __channel_get(c, buf, len);
-	}
-	else if(channel_isfull(c))
-	{
-		l = __channel_get(c, buf, len);
-		spin_lock(&c->lock);
-		if(!list_empty(&c->rwait))
-		{
-			list_for_each_entry_safe(pos, n, &c->rwait, rlist)
-			{
-				list_del_init(&pos->rlist);
-				task_resume(pos);
-			}
-		}
-		if(!list_empty(&c->swait))
-		{
-			list_for_each_entry_safe(pos, n, &c->swait, slist)
-			{
-				list_del_init(&pos->slist);
-				task_resume(pos);
-			}
-		}
-		spin_unlock(&c->lock);
-	}
-	else
-	{
-		l = __channel_get(c, buf, len);
-		spin_lock(&c->lock);
-		if(!list_empty(&c->swait))
-		{
-			list_for_each_entry_safe(pos, n, &c->swait, slist)
-			{
-				list_del_init(&pos->slist);
-				task_resume(pos);
-			}
-		}
-		spin_unlock(&c->lock);
+		if(l > 0)
+			break;
+		channel_wait_avail(c);
 	}
+	channel_wakeup_senders(c);
+
 	return l;
 }
 
@@ -257,10 +248,8 @@ void channel_send(struct channel_t * c, unsigned char * buf, unsigned int len)
 
 	if(c && buf)
 	{
-		do {
+		while(l < len)
 			l += channel_put(c, buf + l, len - l);
-			task_yield();
-		} while(l < len);
 	}
 }
 
@@ -270,9 +259,124 @@ void channel_recv(struct channel_t * c, unsigned char * buf, unsigned int len)
 
 	if(c && buf)
 	{
-		do {
+		while(l < len)
 			l += channel_get(c, buf + l, len - l);
-			task_yield();
-		} while(l < len);
 	}
 }
+
+/*
+ * Zero-copy access for the producer and consumer side. The returned span is
+ * contiguous, so it may be shorter than requested when the ring wraps. With
+ * several producers or consumers the caller must serialise each side.
+ */
+unsigned int channel_reserve(struct channel_t * c, unsigned char ** buf, unsigned int len)
+{
+	unsigned int l;
+
+	if(!c || !buf || (len == 0))
+		return 0;
+
+	while((l = channel_space(c)) == 0)
+		channel_wait_space(c);
+	l = min(min(len, l), c->size - (c->in & (c->size - 1)));
+	*buf = c->buffer + (c->in & (c->size - 1));
+
+	return l;
+}
+
+void channel_commit(struct channel_t * c, unsigned int len)
+{
+	if(c && (len > 0))
+	{
+		smp_wmb();
+		c->in += len;
+		channel_wakeup_receivers(c);
+	}
+}
+
+unsigned int channel_peek(struct channel_t * c, unsigned char ** buf, unsigned int len)
+{
+	unsigned int l;
+
+	if(!c || !buf || (len == 0))
+		return 0;
+
+	while((l = channel_avail(c)) == 0)
+		channel_wait_avail(c);
+	l = min(min(len, l), c->size - (c->out & (c->size - 1)));
+	*buf = c->buffer + (c->out & (c->size - 1));
+
+	return l;
+}
+
+void channel_consume(struct channel_t * c, unsigned int len)
+{
+	if(c && (len > 0))
+	{
+		smp_mb();
+		c->out += len;
+		channel_wakeup_senders(c);
+	}
+}
+
+static inline int channel_select_ready(struct channel_select_t * sel, int n)
+{
+	int i;
+
+	for(i = 0; i < n; i++)
+	{
+		if(!sel[i].c)
+			continue;
+		if(sel[i].send ? (channel_space(sel[i].c) > 0) : (channel_avail(sel[i].c) > 0))
+			return i;
+	}
+	return -1;
+}
+
+/*
+ * Wait until one of the channels can be written (send) or read (!send).
+ * A negative timeout waits forever and zero just polls. Returns the index
+ * of the first ready entry, or -1 on timeout.
+ */
+int channel_select(struct channel_select_t * sel, int n, int64_t timeout)
+{
+	struct task_timeout_t to;
+	struct task_t * self = task_self();
+	int ret, i;
+
+	if(!sel || (n <= 0))
+		return -1;
+
+	ret = channel_select_ready(sel, n);
+	if((ret >= 0) || (timeout == 0) || !self)
+		return ret;
+
+	for(i = 0; i < n; i++)
+	{
+		init_list_head(&sel[i].w.entry);
+		sel[i].w.task = self;
+	}
+	if(timeout > 0)
+		task_timeout_start(&to, ktime_add_ns(ktime_get(), timeout));
+	while(1)
+	{
+		for(i = 0; i < n; i++)
+		{
+			if(sel[i].c)
+				channel_add_waiter(sel[i].c, sel[i].send ? &sel[i].c->swait : &sel[i].c->rwait, &sel[i].w);
+		}
+		ret = channel_select_ready(sel, n);
+		if((ret >= 0) || ((timeout > 0) && to.expired))
+			break;
+		task_suspend(self);
+	}
+	for(i = 0; i < n; i++)
+	{
+		if(sel[i].c)
+			channel_del_waiter(sel[i].c, &sel[i].w);
+	}
+	if(timeout > 0)
+		task_timeout_cancel(&to);
+
+	return ret;
+}
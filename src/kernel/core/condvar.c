@@ -1,5 +1,5 @@
 /*
- * dmapool.c
+ * kernel/core/condvar.c
  *
  * Copyright(c) 2007-2021 Jianjun Jiang <8192542@qq.com>
  * Official site: http://xboot.org
@@ -25,43 +25,65 @@
  * SOFTWARE.
  *
  */
+#include <xboot.h>
+#include <xboot/condvar.h>
 
-#include <stddef.h>
-#include <sizes.h>
-#include <spinlock.h>
-#include <malloc.h>
+struct condvar_waiter_t {
+	struct list_head entry;
+	struct task_t * task;
+	int signaled;
+};
 
-extern unsigned char __dma_start[];
-extern unsigned char __dma_end[];
+void condvar_init(struct condvar_t * cv)
+{
+	init_list_head(&cv->wait);
+	spin_lock_init(&cv->lock);
+}
+
+void condvar_wait(struct condvar_t * cv, struct mutex_t * m)
+{
+	struct condvar_waiter_t w;
+
+	init_list_head(&w.entry);
+	w.task = task_self();
+	w.signaled = 0;
+	spin_lock(&cv->lock);
+	list_add_tail(&w.entry, &cv->wait);
+	spin_unlock(&cv->lock);
 
-static void * __dma_pool = NULL;
-static spinlock_t __dma_lock = SPIN_LOCK_INIT();
+	mutex_unlock(m);
+	while(!w.signaled)
+		task_suspend(w.task);
+	smp_rmb();
+	mutex_lock(m);
+}
 
-void * dma_alloc_coherent(unsigned long size)
+static inline void condvar_wakeup(struct condvar_waiter_t * w)
 {
-	irq_flags_t flags;
-	void * m;
+	struct task_t * task = w->task;
 
-	if(!__dma_pool)
-		__dma_pool = mm_create((void *)__dma_start, (size_t)(__dma_end - __dma_start));
-	if(__dma_pool)
-	{
-		spin_lock_irqsave(&__dma_lock, flags);
-		m = mm_memalign(__dma_pool, SZ_4K, size);
-		spin_unlock_irqrestore(&__dma_lock, flags);
-		return m;
-	}
-	return NULL;
+	list_del_init(&w->entry);
+	smp_wmb();
+	w->signaled = 1;
+	task_resume(task);
+}
+
+void condvar_signal(struct condvar_t * cv)
+{
+	spin_lock(&cv->lock);
+	if(!list_empty(&cv->wait))
+		condvar_wakeup(list_first_entry(&cv->wait, struct condvar_waiter_t, entry));
+	spin_unlock(&cv->lock);
 }
 
-void dma_free_coherent(void * addr)
+void condvar_broadcast(struct condvar_t * cv)
 {
-	irq_flags_t flags;
+	struct condvar_waiter_t * pos, * n;
 
-	if(__dma_pool)
+	spin_lock(&cv->lock);
+	list_for_each_entry_safe(pos, n, &cv->wait, entry)
 	{
-		spin_lock_irqsave(&__dma_lock, flags);
-		mm_free(__dma_pool, addr);
-		spin_unlock_irqrestore(&__dma_lock, flags);
+		condvar_wakeup(pos);
 	}
+	spin_unlock(&cv->lock);
 }
@@ -0,0 +1,195 @@
+/*
+ * kernel/core/future.c
+ *
+ * Copyright(c) 2007-2021 Jianjun Jiang <8192542@qq.com>
+ * Official site: http://xboot.org
+ * Mobile phone: +86-18665388956
+ * QQ: 8192542
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#include <xboot.h>
+#include <xboot/future.h>
+
+struct future_waiter_t {
+	struct list_head entry;
+	struct task_t * task;
+	int done;
+};
+
+struct future_then_t {
+	struct list_head entry;
+	struct work_t work;
+	struct future_t * f;
+	future_then_func_t func;
+	void * data;
+};
+
+static void future_then_work(struct work_t * work, void * data)
+{
+	struct future_then_t * t = (struct future_then_t *)data;
+
+	t->func(t->f, t->f->value, t->data);
+}
+
+static void future_then_done(struct work_t * work, void * data)
+{
+	free(data);
+}
+
+void future_init(struct future_t * f)
+{
+	if(f)
+	{
+		f->ready = 0;
+		f->value = NULL;
+		init_list_head(&f->wait);
+		init_list_head(&f->then);
+		spin_lock_init(&f->lock);
+	}
+}
+
+/*
+ * Resolve the future once, waking all waiters. The continuations are
+ * queued to the workqueue, so that the caller, which may be a timer or
+ * an interrupt, never runs them itself.
+ */
+void future_set(struct future_t * f, void * value)
+{
+	struct future_waiter_t * w, * wn;
+	struct future_then_t * t, * tn;
+	struct task_t * task;
+	struct list_head then;
+	irq_flags_t flags;
+
+	if(!f)
+		return;
+
+	init_list_head(&then);
+	spin_lock_irqsave(&f->lock, flags);
+	if(f->ready)
+	{
+		spin_unlock_irqrestore(&f->lock, flags);
+		return;
+	}
+	f->value = value;
+	smp_wmb();
+	f->ready = 1;
+	list_for_each_entry_safe(w, wn, &f->wait, entry)
+	{
+		list_del_init(&w->entry);
+		task = w->task;
+		smp_wmb();
+		w->done = 1;
+		task_resume(task);
+	}
+	list_splice_init(&f->then, &then);
+	spin_unlock_irqrestore(&f->lock, flags);
+
+	list_for_each_entry_safe(t, tn, &then, entry)
+	{
+		list_del_init(&t->entry);
+		work_queue(&t->work);
+	}
+}
+
+int future_ready(struct future_t * f)
+{
+	return f ? f->ready : 0;
+}
+
+/*
+ * Wait for the future to be resolved, a negative timeout waits forever
+ * and zero just polls. Return 1 with the value, or 0 on timeout.
+ */
+int future_get(struct future_t * f, void ** value, int64_t timeout)
+{
+	struct future_waiter_t w;
+	struct task_timeout_t to;
+	struct task_t * self = task_self();
+	irq_flags_t flags;
+
+	if(!f)
+		return 0;
+
+	spin_lock_irqsave(&f->lock, flags);
+	if(!f->ready && (timeout != 0) && self)
+	{
+		init_list_head(&w.entry);
+		w.task = self;
+		w.done = 0;
+		list_add_tail(&w.entry, &f->wait);
+		spin_unlock_irqrestore(&f->lock, flags);
+
+		if(timeout > 0)
+		{
+			task_timeout_start(&to, ktime_add_ns(ktime_get(), timeout));
+			while(!w.done && !to.expired)
+				task_suspend(self);
+			task_timeout_cancel(&to);
+		}
+		else
+		{
+			while(!w.done)
+				task_suspend(self);
+		}
+
+		spin_lock_irqsave(&f->lock, flags);
+		if(!w.done)
+			list_del_init(&w.entry);
+	}
+	spin_unlock_irqrestore(&f->lock, flags);
+
+	if(!f->ready)
+		return 0;
+	smp_rmb();
+	if(value)
+		*value = f->value;
+	return 1;
+}
+
+int future_then(struct future_t * f, future_then_func_t func, void * data)
+{
+	struct future_then_t * t;
+	irq_flags_t flags;
+	int ready;
+
+	if(!f || !func)
+		return 0;
+
+	t = malloc(sizeof(struct future_then_t));
+	if(!t)
+		return 0;
+	init_list_head(&t->entry);
+	work_init(&t->work, future_then_work, future_then_done, t);
+	t->f = f;
+	t->func = func;
+	t->data = data;
+
+	spin_lock_irqsave(&f->lock, flags);
+	ready = f->ready;
+	if(!ready)
+		list_add_tail(&t->entry, &f->then);
+	spin_unlock_irqrestore(&f->lock, flags);
+	if(ready)
+		work_queue(&t->work);
+
+	return 1;
+}
@@ -247,6 +247,20 @@ void machine_sleep(void)
 	}
 }
 
+/*
+ * Called with irqs masked, returns once an irq is pending or another cpu
+ * has called arch_cpu_wakeup().
+ */
+void machine_idle(void)
+{
+	struct machine_t * mach = get_machine();
+
+	if(mach && mach->idle)
+		mach->idle(mach);
+	else
+		arch_cpu_idle();
+}
+
 void machine_cleanup(void)
 {
 	struct machine_t * mach = get_machine();
@@ -25,48 +25,123 @@
  * SOFTWARE.
  *
  */
-
 #include <xboot.h>
 #include <xboot/mutex.h>
+#include <xboot/trace.h>
+
+#define MUTEX_SPIN_COUNT	(1000)
+
+struct mutex_waiter_t {
+	struct list_head entry;
+	struct task_t * task;
+	int granted;
+};
 
 void mutex_init(struct mutex_t * m)
 {
 	atomic_set(&m->atomic, 1);
+	m->owner = NULL;
 	init_list_head(&m->mwait);
 	spin_lock_init(&m->lock);
 }
 
+/*
+ * Keep spinning only while the owner is running on another cpu, it is
+ * likely to release the lock sooner than two context switches would take.
+ */
+static inline int mutex_spin_on_owner(struct mutex_t * m, struct task_t * self)
+{
+	struct task_t * owner;
+	int count;
+
+	if((CONFIG_MAX_SMP_CPUS < 2) || !self)
+		return 0;
+
+	for(count = 0; count < MUTEX_SPIN_COUNT; count++)
+	{
+		owner = m->owner;
+		smp_rmb();
+		if(!owner || (owner->status != TASK_STATUS_RUNNING) || (owner->sched == self->sched) || !list_empty_careful(&m->mwait))
+			return 0;
+		if((atomic_get(&m->atomic) == 1) && (atomic_cmpxchg(&m->atomic, 1, 0) == 1))
+			return 1;
+	}
+	return 0;
+}
+
 void mutex_lock(struct mutex_t * m)
 {
-	struct task_t * self;
+	struct mutex_waiter_t w;
+	struct task_t * self = task_self();
+	uint64_t ts = 0;
+
+	if(atomic_cmpxchg(&m->atomic, 1, 0) == 1)
+	{
+		m->owner = self;
+		return;
+	}
+	if(mutex_spin_on_owner(m, self))
+	{
+		m->owner = self;
+		return;
+	}
 
-	while(atomic_cmpxchg(&m->atomic, 1, 0) != 1)
+	if(trace_enabled())
+		ts = ktime_to_ns(ktime_get());
+	spin_lock(&m->lock);
+	if(atomic_cmpxchg(&m->atomic, 1, 0) == 1)
 	{
-		self = task_self();
-		spin_lock(&m->lock);
-		if(list_empty_careful(&self->mlist))
-			list_add_tail(&self->mlist, &m->mwait);
+		m->owner = self;
 		spin_unlock(&m->lock);
+		return;
+	}
+	init_list_head(&w.entry);
+	w.task = self;
+	w.granted = 0;
+	list_add_tail(&w.entry, &m->mwait);
+	spin_unlock(&m->lock);
+
+	while(!w.granted)
 		task_suspend(self);
+	smp_rmb();
+	if(ts)
+		trace_record_span(TRACE_TYPE_MUTEX, self, m, ts, ktime_to_ns(ktime_get()) - ts);
+}
+
+int mutex_trylock(struct mutex_t * m)
+{
+	if(atomic_cmpxchg(&m->atomic, 1, 0) == 1)
+	{
+		m->owner = task_self();
+		return 1;
 	}
+	return 0;
 }
 
+/*
+ * Ownership is handed straight to the longest waiter, the lock word stays
+ * taken, so a late arriving task can't steal the lock from the queue.
+ */
 void mutex_unlock(struct mutex_t * m)
 {
-	struct task_t * pos, * n;
+	struct mutex_waiter_t * w;
+	struct task_t * task;
 
-	if(atomic_cmpxchg(&m->atomic, 0, 1) == 0)
+	spin_lock(&m->lock);
+	if(!list_empty(&m->mwait))
 	{
-		spin_lock(&m->lock);
-		if(!list_empty(&m->mwait))
-		{
-			list_for_each_entry_safe(pos, n, &m->mwait, mlist)
-			{
-				list_del_init(&pos->mlist);
-				task_resume(pos);
-				break;
-			}
-		}
-		spin_unlock(&m->lock);
+		w = list_first_entry(&m->mwait, struct mutex_waiter_t, entry);
+		list_del_init(&w->entry);
+		task = w->task;
+		m->owner = task;
+		smp_wmb();
+		w->granted = 1;
+		task_resume(task);
+	}
+	else
+	{
+		m->owner = NULL;
+		atomic_set(&m->atomic, 1);
 	}
+	spin_unlock(&m->lock);
 }
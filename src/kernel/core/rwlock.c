@@ -0,0 +1,135 @@
+/*
+ * kernel/core/rwlock.c
+ *
+ * Copyright(c) 2007-2021 Jianjun Jiang <8192542@qq.com>
+ * Official site: http://xboot.org
+ * Mobile phone: +86-18665388956
+ * QQ: 8192542
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#include <xboot.h>
+#include <xboot/rwlock.h>
+
+struct rwlock_waiter_t {
+	struct list_head entry;
+	struct task_t * task;
+	int write;
+	int granted;
+};
+
+void rwlock_init(struct rwlock_t * rw)
+{
+	rw->count = 0;
+	init_list_head(&rw->wait);
+	spin_lock_init(&rw->lock);
+}
+
+static inline void rwlock_grant(struct rwlock_waiter_t * w)
+{
+	struct task_t * task = w->task;
+
+	list_del_init(&w->entry);
+	smp_wmb();
+	w->granted = 1;
+	task_resume(task);
+}
+
+/*
+ * Waiters are served in arrival order, a queued writer blocks any reader
+ * that comes after it, so neither side can starve the other.
+ */
+static void rwlock_wakeup(struct rwlock_t * rw)
+{
+	struct rwlock_waiter_t * pos, * n;
+
+	list_for_each_entry_safe(pos, n, &rw->wait, entry)
+	{
+		if(pos->write)
+		{
+			if(rw->count == 0)
+			{
+				rw->count = -1;
+				rwlock_grant(pos);
+			}
+			break;
+		}
+		if(rw->count < 0)
+			break;
+		rw->count++;
+		rwlock_grant(pos);
+	}
+}
+
+static void rwlock_wait(struct rwlock_t * rw, int write)
+{
+	struct rwlock_waiter_t w;
+
+	init_list_head(&w.entry);
+	w.task = task_self();
+	w.write = write;
+	w.granted = 0;
+	list_add_tail(&w.entry, &rw->wait);
+	spin_unlock(&rw->lock);
+
+	while(!w.granted)
+		task_suspend(w.task);
+	smp_rmb();
+}
+
+void rwlock_read_lock(struct rwlock_t * rw)
+{
+	spin_lock(&rw->lock);
+	if((rw->count >= 0) && list_empty(&rw->wait))
+	{
+		rw->count++;
+		spin_unlock(&rw->lock);
+		return;
+	}
+	rwlock_wait(rw, 0);
+}
+
+void rwlock_read_unlock(struct rwlock_t * rw)
+{
+	spin_lock(&rw->lock);
+	if(--rw->count == 0)
+		rwlock_wakeup(rw);
+	spin_unlock(&rw->lock);
+}
+
+void rwlock_write_lock(struct rwlock_t * rw)
+{
+	spin_lock(&rw->lock);
+	if((rw->count == 0) && list_empty(&rw->wait))
+	{
+		rw->count = -1;
+		spin_unlock(&rw->lock);
+		return;
+	}
+	rwlock_wait(rw, 1);
+}
+
+void rwlock_write_unlock(struct rwlock_t * rw)
+{
+	spin_lock(&rw->lock);
+	rw->count = 0;
+	rwlock_wakeup(rw);
+	spin_unlock(&rw->lock);
+}
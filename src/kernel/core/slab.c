@@ -0,0 +1,391 @@
+/*
+ * kernel/core/slab.c
+ *
+ * Copyright(c) 2007-2021 Jianjun Jiang <8192542@qq.com>
+ * Official site: http://xboot.org
+ * Mobile phone: +86-18665388956
+ * QQ: 8192542
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#include <xboot.h>
+#include <xboot/slab.h>
+
+/*
+ * Every slab is a power of two sized and aligned block taken from the heap,
+ * so the slab of an object is found by masking its address. Free objects are
+ * tracked by an index stack in the slab header, the objects themselves are
+ * never written, which keeps them in their constructed state.
+ */
+struct kmem_slab_t {
+	struct list_head entry;
+	struct kmem_cache_t * cache;
+	unsigned int inuse;
+	unsigned int nfree;
+	u16_t free[0];
+};
+
+#define KMEM_SLAB_MIN_SIZE		(4096)
+#define KMEM_SLAB_MIN_OBJS		(8)
+
+static struct list_head __kmem_cache_list = {
+	.next = &__kmem_cache_list,
+	.prev = &__kmem_cache_list,
+};
+static spinlock_t __kmem_cache_lock = SPIN_LOCK_INIT();
+
+static inline size_t kmem_slab_header_size(struct kmem_cache_t * c, unsigned int nobjs)
+{
+	return (sizeof(struct kmem_slab_t) + nobjs * sizeof(u16_t) + c->align - 1) & ~(c->align - 1);
+}
+
+static inline void * kmem_slab_base(struct kmem_cache_t * c, struct kmem_slab_t * s)
+{
+	return (char *)s + kmem_slab_header_size(c, c->nobjs);
+}
+
+static void kmem_cache_setup(struct kmem_cache_t * c)
+{
+	size_t align, objsize, slabsize;
+	unsigned int nobjs;
+	int i;
+
+	spin_lock(&__kmem_cache_lock);
+	if(!c->nobjs)
+	{
+		align = c->align;
+		if(align < sizeof(void *))
+			align = sizeof(void *);
+		if(align & (align - 1))
+			align = roundup_pow_of_two(align);
+		c->align = align;
+		objsize = (c->size + align - 1) & ~(align - 1);
+		if(objsize == 0)
+			objsize = align;
+		slabsize = roundup_pow_of_two(sizeof(struct kmem_slab_t) + (objsize + sizeof(u16_t)) * KMEM_SLAB_MIN_OBJS + align);
+		if(slabsize < KMEM_SLAB_MIN_SIZE)
+			slabsize = KMEM_SLAB_MIN_SIZE;
+		nobjs = (slabsize - sizeof(struct kmem_slab_t)) / (objsize + sizeof(u16_t));
+		while(kmem_slab_header_size(c, nobjs) + nobjs * objsize > slabsize)
+			nobjs--;
+		c->objsize = objsize;
+		c->slabsize = slabsize;
+		init_list_head(&c->partial);
+		init_list_head(&c->full);
+		init_list_head(&c->empty);
+		memset(c->cpu, 0, sizeof(c->cpu));
+		for(i = 0; i < CONFIG_MAX_SMP_CPUS; i++)
+			spin_lock_init(&c->cpu[i].lock);
+		spin_lock_init(&c->lock);
+		c->slabs = 0;
+		c->inuse = 0;
+		c->hit = 0;
+		c->miss = 0;
+		list_add_tail(&c->list, &__kmem_cache_list);
+		smp_wmb();
+		c->nobjs = nobjs;
+	}
+	spin_unlock(&__kmem_cache_lock);
+}
+
+static struct kmem_slab_t * kmem_slab_alloc(struct kmem_cache_t * c)
+{
+	struct kmem_slab_t * s;
+	char * base;
+	unsigned int i;
+
+	s = memalign(c->slabsize, c->slabsize);
+	if(!s)
+		return NULL;
+	init_list_head(&s->entry);
+	s->cache = c;
+	s->inuse = 0;
+	s->nfree = c->nobjs;
+	base = kmem_slab_base(c, s);
+	for(i = 0; i < c->nobjs; i++)
+	{
+		s->free[i] = c->nobjs - 1 - i;
+		if(c->ctor)
+			c->ctor(base + i * c->objsize);
+	}
+	return s;
+}
+
+static void kmem_slab_free(struct kmem_cache_t * c, struct kmem_slab_t * s)
+{
+	char * base = kmem_slab_base(c, s);
+	unsigned int i;
+
+	if(c->dtor)
+	{
+		for(i = 0; i < c->nobjs; i++)
+			c->dtor(base + i * c->objsize);
+	}
+	free(s);
+}
+
+static void kmem_cache_refill(struct kmem_cache_t * c, struct kmem_cpu_cache_t * cc)
+{
+	struct kmem_slab_t * s;
+	char * base;
+
+	spin_lock(&c->lock);
+	while(cc->count < KMEM_CPU_BATCH)
+	{
+		if(!list_empty(&c->partial))
+			s = list_first_entry(&c->partial, struct kmem_slab_t, entry);
+		else if(!list_empty(&c->empty))
+		{
+			s = list_first_entry(&c->empty, struct kmem_slab_t, entry);
+			list_move(&s->entry, &c->partial);
+		}
+		else
+		{
+			s = kmem_slab_alloc(c);
+			if(!s)
+				break;
+			list_add(&s->entry, &c->partial);
+			c->slabs++;
+		}
+		base = kmem_slab_base(c, s);
+		while((s->nfree > 0) && (cc->count < KMEM_CPU_BATCH))
+		{
+			cc->objs[cc->count++] = base + s->free[--s->nfree] * c->objsize;
+			s->inuse++;
+			c->inuse++;
+		}
+		if(s->nfree == 0)
+			list_move(&s->entry, &c->full);
+	}
+	spin_unlock(&c->lock);
+}
+
+static void kmem_cache_drain(struct kmem_cache_t * c, struct kmem_cpu_cache_t * cc, int n)
+{
+	struct kmem_slab_t * s, * sn;
+	struct list_head release;
+	void * obj;
+	int i, keep = 0;
+
+	if(n > cc->count)
+		n = cc->count;
+	init_list_head(&release);
+
+	spin_lock(&c->lock);
+	for(i = 0; i < n; i++)
+	{
+		obj = cc->objs[i];
+		s = (struct kmem_slab_t *)((unsigned long)obj & ~(c->slabsize - 1));
+		if(s->nfree == 0)
+			list_move(&s->entry, &c->partial);
+		s->free[s->nfree++] = ((char *)obj - (char *)kmem_slab_base(c, s)) / c->objsize;
+		s->inuse--;
+		c->inuse--;
+		if(s->inuse == 0)
+			list_move(&s->entry, &c->empty);
+	}
+	list_for_each_entry_safe(s, sn, &c->empty, entry)
+	{
+		if(keep++ > 0)
+		{
+			list_move(&s->entry, &release);
+			c->slabs--;
+		}
+	}
+	spin_unlock(&c->lock);
+
+	cc->count -= n;
+	if(cc->count > 0)
+		memmove(&cc->objs[0], &cc->objs[n], cc->count * sizeof(void *));
+
+	list_for_each_entry_safe(s, sn, &release, entry)
+	{
+		list_del(&s->entry);
+		kmem_slab_free(c, s);
+	}
+}
+
+struct kmem_cache_t * kmem_cache_create(const char * name, size_t size, size_t align, void (*ctor)(void *), void (*dtor)(void *))
+{
+	struct kmem_cache_t * c;
+
+	if(!name || (size == 0))
+		return NULL;
+
+	c = malloc(sizeof(struct kmem_cache_t));
+	if(!c)
+		return NULL;
+	memset(c, 0, sizeof(struct kmem_cache_t));
+	c->name = strdup(name);
+	c->size = size;
+	c->align = align;
+	c->ctor = ctor;
+	c->dtor = dtor;
+	kmem_cache_setup(c);
+
+	return c;
+}
+
+void kmem_cache_destroy(struct kmem_cache_t * c)
+{
+	struct kmem_slab_t * s, * n;
+
+	if(!c)
+		return;
+
+	kmem_cache_shrink(c);
+	spin_lock(&__kmem_cache_lock);
+	list_del(&c->list);
+	spin_unlock(&__kmem_cache_lock);
+	list_for_each_entry_safe(s, n, &c->partial, entry)
+		kmem_slab_free(c, s);
+	list_for_each_entry_safe(s, n, &c->full, entry)
+		kmem_slab_free(c, s);
+	free((void *)c->name);
+	free(c);
+}
+
+void * kmem_cache_alloc(struct kmem_cache_t * c)
+{
+	struct kmem_cpu_cache_t * cc;
+	irq_flags_t flags;
+	void * obj = NULL;
+
+	if(!c)
+		return NULL;
+	if(unlikely(!c->nobjs))
+		kmem_cache_setup(c);
+
+	local_irq_save(flags);
+	cc = &c->cpu[smp_processor_id()];
+	spin_lock(&cc->lock);
+	if(cc->count > 0)
+		c->hit++;
+	else
+	{
+		c->miss++;
+		kmem_cache_refill(c, cc);
+	}
+	if(cc->count > 0)
+		obj = cc->objs[--cc->count];
+	spin_unlock(&cc->lock);
+	local_irq_restore(flags);
+
+	return obj;
+}
+
+void * kmem_cache_zalloc(struct kmem_cache_t * c)
+{
+	void * obj = kmem_cache_alloc(c);
+
+	if(obj)
+		memset(obj, 0, c->size);
+	return obj;
+}
+
+void kmem_cache_free(struct kmem_cache_t * c, void * obj)
+{
+	struct kmem_cpu_cache_t * cc;
+	irq_flags_t flags;
+
+	if(!c || !obj)
+		return;
+
+	local_irq_save(flags);
+	cc = &c->cpu[smp_processor_id()];
+	spin_lock(&cc->lock);
+	if(cc->count >= KMEM_CPU_DEPTH)
+		kmem_cache_drain(c, cc, KMEM_CPU_BATCH);
+	cc->objs[cc->count++] = obj;
+	spin_unlock(&cc->lock);
+	local_irq_restore(flags);
+}
+
+void kmem_cache_shrink(struct kmem_cache_t * c)
+{
+	struct kmem_cpu_cache_t * cc;
+	struct kmem_slab_t * s, * n;
+	struct list_head release;
+	irq_flags_t flags;
+	int i;
+
+	if(!c || !c->nobjs)
+		return;
+
+	/*
+	 * The per cpu caches of other cpus are drained under their own lock,
+	 * their owners only hold it inside the irq off fast paths.
+	 */
+	for(i = 0; i < CONFIG_MAX_SMP_CPUS; i++)
+	{
+		cc = &c->cpu[i];
+		spin_lock_irqsave(&cc->lock, flags);
+		kmem_cache_drain(c, cc, cc->count);
+		spin_unlock_irqrestore(&cc->lock, flags);
+	}
+
+	init_list_head(&release);
+	spin_lock(&c->lock);
+	list_for_each_entry_safe(s, n, &c->empty, entry)
+	{
+		list_move(&s->entry, &release);
+		c->slabs--;
+	}
+	spin_unlock(&c->lock);
+	list_for_each_entry_safe(s, n, &release, entry)
+	{
+		list_del(&s->entry);
+		kmem_slab_free(c, s);
+	}
+}
+
+static struct kobj_t * search_class_memory_kobj(void)
+{
+	struct kobj_t * kclass = kobj_search_directory_with_create(kobj_get_root(), "class");
+	return kobj_search_directory_with_create(kclass, "memory");
+}
+
+static ssize_t memory_read_slabinfo(struct kobj_t * kobj, void * buf, size_t size)
+{
+	struct kmem_cache_t * c;
+	unsigned long cached;
+	char * p = buf;
+	int len = 0;
+	int i;
+
+	len += sprintf((char *)(p + len), " %-16s %8s %8s %8s %8s %8s\r\n", "name", "objsize", "active", "total", "slabs", "hit");
+	spin_lock(&__kmem_cache_lock);
+	list_for_each_entry(c, &__kmem_cache_list, list)
+	{
+		if(len + 80 > size)
+			break;
+		for(i = 0, cached = 0; i < CONFIG_MAX_SMP_CPUS; i++)
+			cached += c->cpu[i].count;
+		len += sprintf((char *)(p + len), " %-16s %8ld %8ld %8ld %8ld %7ld%%\r\n", c->name, (unsigned long)c->objsize,
+			c->inuse - cached, c->slabs * c->nobjs, c->slabs, (c->hit + c->miss) ? (c->hit * 100 / (c->hit + c->miss)) : 0);
+	}
+	spin_unlock(&__kmem_cache_lock);
+	return len;
+}
+
+void do_init_slab(void)
+{
+	kobj_add_regular(search_class_memory_kobj(), "slabinfo", memory_read_slabinfo, NULL, NULL);
+}
@@ -28,6 +28,7 @@
 
 #include <xboot.h>
 #include <xboot/task.h>
+#include <xboot/trace.h>
 
 struct transfer_t
 {
@@ -41,6 +42,37 @@ extern struct transfer_t jump_fcontext(void * fctx, void * priv);
 struct scheduler_t __sched[CONFIG_MAX_SMP_CPUS];
 EXPORT_SYMBOL(__sched);
 
+static struct {
+	int enable;
+	uint64_t interval;
+	uint64_t imbalance;
+} __balance = {
+	.enable = 1,
+	.interval = 4000000ULL,
+	.imbalance = 1024,
+};
+
+#define TASK_POOL_SIZES			(4)
+#define TASK_STACK_CANARY		(0x5a5a5a5a)
+#define TASK_STACK_GUARD		(64)
+
+struct task_pool_t {
+	size_t stksz;
+	struct list_head head;
+	int count;
+};
+
+static struct task_pool_t __task_pool[TASK_POOL_SIZES];
+static KMEM_CACHE_DEFINE(__task_cache, "task", sizeof(struct task_t), 0, NULL, NULL);
+static spinlock_t __task_pool_lock = SPIN_LOCK_INIT();
+
+struct task_join_waiter_t {
+	struct list_head entry;
+	struct task_t * task;
+	int done;
+};
+static spinlock_t __task_join_lock = SPIN_LOCK_INIT();
+
 static const int nice_to_weight[40] = {
  /* -20 */     88761,     71755,     56483,     46273,     36291,
  /* -15 */     29154,     23254,     18705,     14949,     11916,
@@ -121,11 +153,23 @@ static inline struct task_t * scheduler_next_ready_task(struct scheduler_t * sch
 	return rb_entry(leftmost, struct task_t, node);
 }
 
-static inline void scheduler_enqueue_task(struct scheduler_t * sched, struct task_t * task)
+static inline void scheduler_update_min_vtime(struct scheduler_t * sched)
+{
+	struct task_t * next = scheduler_next_ready_task(sched);
+
+	if(likely(next))
+		sched->min_vtime = next->vtime;
+	else if(sched->running)
+		sched->min_vtime = sched->running->vtime;
+	else
+		sched->min_vtime = 0;
+}
+
+static inline void __scheduler_enqueue_task(struct scheduler_t * sched, struct task_t * task)
 {
 	struct rb_node ** link = &sched->ready.rb_root.rb_node;
 	struct rb_node * parent = NULL;
-	struct task_t * next, * entry;
+	struct task_t * entry;
 	int leftmost = 1;
 
 	while(*link)
@@ -145,36 +189,129 @@ static inline void scheduler_enqueue_task(struct scheduler_t * sched, struct tas
 
 	rb_link_node(&task->node, parent, link);
 	rb_insert_color_cached(&task->node, &sched->ready, leftmost);
-	next = scheduler_next_ready_task(sched);
-	if(likely(next))
-		sched->min_vtime = next->vtime;
-	else if(sched->running)
-		sched->min_vtime = sched->running->vtime;
-	else
-		sched->min_vtime = 0;
+	scheduler_update_min_vtime(sched);
+}
+
+static inline void __scheduler_dequeue_task(struct scheduler_t * sched, struct task_t * task)
+{
+	rb_erase_cached(&task->node, &sched->ready);
+	RB_CLEAR_NODE(&task->node);
+	scheduler_update_min_vtime(sched);
+}
+
+/*
+ * A ready task can be stolen by another cpu at any time, so the scheduler
+ * of a task is only stable once its lock is held and it is checked again.
+ * The scheduler locks are taken with irqs off, as timers resume tasks.
+ */
+static inline struct scheduler_t * task_sched_lock(struct task_t * task, irq_flags_t * flags)
+{
+	struct scheduler_t * sched;
+
+	local_irq_save(*flags);
+	while(1)
+	{
+		sched = task->sched;
+		spin_lock(&sched->lock);
+		if(likely(sched == task->sched))
+			return sched;
+		spin_unlock(&sched->lock);
+	}
 }
 
-static inline void scheduler_dequeue_task(struct scheduler_t * sched, struct task_t * task)
+static inline struct task_t * scheduler_pick_next_task(struct scheduler_t * sched)
 {
 	struct task_t * next;
+	irq_flags_t flags;
 
-	rb_erase_cached(&task->node, &sched->ready);
+	spin_lock_irqsave(&sched->lock, flags);
 	next = scheduler_next_ready_task(sched);
 	if(likely(next))
-		sched->min_vtime = next->vtime;
-	else if(sched->running)
-		sched->min_vtime = sched->running->vtime;
-	else
-		sched->min_vtime = 0;
+		__scheduler_dequeue_task(sched, next);
+	spin_unlock_irqrestore(&sched->lock, flags);
+
+	return next;
+}
+
+static inline void task_join_wakeup(struct list_head * head)
+{
+	struct task_join_waiter_t * w, * n;
+	struct task_t * task;
+
+	list_for_each_entry_safe(w, n, head, entry)
+	{
+		list_del_init(&w->entry);
+		task = w->task;
+		smp_wmb();
+		w->done = 1;
+		task_resume(task);
+	}
 }
 
+/*
+ * An exited joinable task keeps its stack until joined, but no longer
+ * counts in the weight of its scheduler.
+ */
+static inline void task_exit_notify(struct task_t * task)
+{
+	struct scheduler_t * sched = task->sched;
+	irq_flags_t flags;
+
+	spin_lock_irqsave(&sched->lock, flags);
+	sched->weight -= task->weight;
+	task->weight = 0;
+	spin_unlock_irqrestore(&sched->lock, flags);
+
+	spin_lock(&__task_join_lock);
+	task->exited = 1;
+	task_join_wakeup(&task->join);
+	if(task->group)
+	{
+		list_move_tail(&task->gentry, &task->group->exited);
+		task_join_wakeup(&task->group->wait);
+	}
+	spin_unlock(&__task_join_lock);
+}
+
+/*
+ * The previous task is left only once the next one runs on its own stack,
+ * this is where an exited task is released or handed to its joiners.
+ */
+static inline void scheduler_switch_finish(struct transfer_t from)
+{
+	struct task_t * t = (struct task_t *)from.priv;
+
+	if(likely(t))
+	{
+		if(unlikely(t->status == TASK_STATUS_EXIT))
+		{
+			if(t->joinable)
+				task_exit_notify(t);
+			else
+				task_destroy(t);
+		}
+		else
+		{
+			smp_wmb();
+			t->fctx = from.fctx;
+		}
+	}
+}
+
+/*
+ * The fctx of a running task is cleared before switching to it, and only
+ * published again once its context has been saved by the next task. A task
+ * with a null fctx is still in transit and can't be migrated.
+ */
 static inline void scheduler_switch_task(struct scheduler_t * sched, struct task_t * task)
 {
 	struct task_t * running = sched->running;
+	void * fctx = task->fctx;
+
+	trace_record(TRACE_TYPE_SWITCH, task, NULL);
 	sched->running = task;
-	struct transfer_t from = jump_fcontext(task->fctx, running);
-	struct task_t * t = (struct task_t *)from.priv;
-	t->fctx = from.fctx;
+	task->fctx = NULL;
+	scheduler_switch_finish(jump_fcontext(fctx, running));
 }
 
 static inline struct scheduler_t * scheduler_load_balance_choice(void)
@@ -194,29 +331,216 @@ static inline struct scheduler_t * scheduler_load_balance_choice(void)
 	return sched;
 }
 
+static inline struct scheduler_t * scheduler_find_busiest(struct scheduler_t * sched)
+{
+	struct scheduler_t * busiest = NULL;
+	uint64_t weight = 0;
+	int i;
+
+	for(i = 0; i < CONFIG_MAX_SMP_CPUS; i++)
+	{
+		if((&__sched[i] != sched) && (__sched[i].weight > weight) && rb_first_cached(&__sched[i].ready))
+		{
+			busiest = &__sched[i];
+			weight = __sched[i].weight;
+		}
+	}
+	return busiest;
+}
+
+static inline struct task_t * scheduler_steal_candidate(struct scheduler_t * busiest, uint64_t limit)
+{
+	struct rb_node * rbn;
+	struct task_t * task;
+
+	for(rbn = rb_first_cached(&busiest->ready); rbn; rbn = rb_next(rbn))
+	{
+		task = rb_entry(rbn, struct task_t, node);
+		if(!task->pinned && task->fctx && (task->weight < limit))
+			return task;
+	}
+	return NULL;
+}
+
+void scheduler_load_balance(struct scheduler_t * sched, int idle)
+{
+	struct scheduler_t * busiest, * first, * second;
+	struct task_t * task;
+	uint64_t now, limit, lag;
+	irq_flags_t flags;
+
+	if((CONFIG_MAX_SMP_CPUS < 2) || !__balance.enable)
+		return;
+
+	now = ktime_to_ns(ktime_get());
+	if(!idle && (now - sched->balance < __balance.interval))
+		return;
+	sched->balance = now;
+
+	busiest = scheduler_find_busiest(sched);
+	if(!busiest || (busiest->weight <= sched->weight))
+		return;
+	limit = busiest->weight - sched->weight;
+	if(!idle && (limit < __balance.imbalance))
+		return;
+
+	if(busiest < sched)
+	{
+		first = busiest;
+		second = sched;
+	}
+	else
+	{
+		first = sched;
+		second = busiest;
+	}
+	spin_lock_irqsave(&first->lock, flags);
+	spin_lock(&second->lock);
+	task = scheduler_steal_candidate(busiest, idle ? ~0ULL : limit);
+	if(task)
+	{
+		/* The lag is taken before the dequeue moves min_vtime */
+		lag = task->vtime - busiest->min_vtime;
+		__scheduler_dequeue_task(busiest, task);
+		busiest->weight -= task->weight;
+		task->vtime = sched->min_vtime + lag;
+		task->sched = sched;
+		sched->weight += task->weight;
+		__scheduler_enqueue_task(sched, task);
+		sched->migrations++;
+	}
+	spin_unlock(&second->lock);
+	spin_unlock_irqrestore(&first->lock, flags);
+}
+
+/*
+ * An exited task is still running on its own stack, so it is released by
+ * the next task once the switch away from it has completed.
+ */
 static void fcontext_entry_func(struct transfer_t from)
 {
-	struct task_t * t = (struct task_t *)from.priv;
-	struct scheduler_t * sched = t->sched;
-	struct task_t * next, * task = sched->running;
+	struct task_t * next, * task = task_self();
+	struct scheduler_t * sched;
 
-	t->fctx = from.fctx;
+	scheduler_switch_finish(from);
 	task->func(task, task->data);
-	task_destroy(task);
+	sched = task->sched;
+	task->status = TASK_STATUS_EXIT;
 
-	next = scheduler_next_ready_task(sched);
+	next = scheduler_pick_next_task(sched);
 	if(likely(next))
 	{
-		scheduler_dequeue_task(sched, next);
 		next->status = TASK_STATUS_RUNNING;
 		next->start = ktime_to_ns(ktime_get());
 		scheduler_switch_task(sched, next);
 	}
 }
 
+static inline void task_stack_fill(void * stack, size_t stksz)
+{
+	uint32_t * p = (uint32_t *)stack;
+	int i;
+
+	for(i = 0; i < stksz / sizeof(uint32_t); i++)
+		p[i] = TASK_STACK_CANARY;
+}
+
+static inline size_t task_stack_used(void * stack, size_t stksz)
+{
+	uint32_t * p = (uint32_t *)stack;
+	int i;
+
+	for(i = 0; i < TASK_STACK_GUARD / sizeof(uint32_t); i++)
+	{
+		if(p[i] != TASK_STACK_CANARY)
+			return stksz;
+	}
+	for(; i < stksz / sizeof(uint32_t); i++)
+	{
+		if(p[i] != TASK_STACK_CANARY)
+			break;
+	}
+	return stksz - i * sizeof(uint32_t);
+}
+
+static struct task_t * task_pool_get(size_t stksz)
+{
+	struct task_pool_t * pool;
+	struct task_t * task = NULL;
+	int i;
+
+	spin_lock(&__task_pool_lock);
+	for(i = 0; i < TASK_POOL_SIZES; i++)
+	{
+		pool = &__task_pool[i];
+		if((pool->stksz == stksz) && (pool->count > 0))
+		{
+			task = list_first_entry(&pool->head, struct task_t, list);
+			list_del_init(&task->list);
+			pool->count--;
+			break;
+		}
+	}
+	spin_unlock(&__task_pool_lock);
+
+	return task;
+}
+
+static int task_pool_put(struct task_t * task)
+{
+	struct task_pool_t * pool = NULL;
+	size_t used;
+	int i;
+
+	if(CONFIG_TASK_POOL_DEPTH <= 0)
+		return 0;
+
+	/*
+	 * Only the region below the high-water mark was touched, so refilling
+	 * that part is enough to recycle the stack with a clean canary.
+	 */
+	used = task_stack_used(task->stack, task->stksz);
+	task_stack_fill(task->stack + task->stksz - used, used);
+
+	spin_lock(&__task_pool_lock);
+	for(i = 0; i < TASK_POOL_SIZES; i++)
+	{
+		if(__task_pool[i].stksz == task->stksz)
+		{
+			pool = &__task_pool[i];
+			break;
+		}
+		if(!pool && (__task_pool[i].count == 0))
+			pool = &__task_pool[i];
+	}
+	if(pool && (pool->count < CONFIG_TASK_POOL_DEPTH))
+	{
+		if(pool->stksz != task->stksz)
+		{
+			pool->stksz = task->stksz;
+			init_list_head(&pool->head);
+		}
+		list_add(&task->list, &pool->head);
+		pool->count++;
+		spin_unlock(&__task_pool_lock);
+		return 1;
+	}
+	spin_unlock(&__task_pool_lock);
+
+	return 0;
+}
+
+size_t task_stack_usage(struct task_t * task)
+{
+	if(task && task->stack)
+		return task_stack_used(task->stack, task->stksz);
+	return 0;
+}
+
 struct task_t * task_create(struct scheduler_t * sched, const char * name, task_func_t func, void * data, size_t stksz, int nice)
 {
 	struct task_t * task;
+	irq_flags_t flags;
 	void * stack;
 
 	if(!func)
@@ -233,26 +557,32 @@ struct task_t * task_create(struct scheduler_t * sched, const char * name, task_
 	else if(nice > 19)
 		nice = 19;
 
-	task = malloc(sizeof(struct task_t));
+	task = task_pool_get(stksz);
 	if(!task)
-		return NULL;
+	{
+		task = kmem_cache_alloc(&__task_cache);
+		if(!task)
+			return NULL;
 
-	stack = malloc(stksz);
-	if(!stack)
+		stack = malloc(stksz);
+		if(!stack)
+		{
+			kmem_cache_free(&__task_cache, task);
+			return NULL;
+		}
+		task_stack_fill(stack, stksz);
+	}
+	else
 	{
-		free(task);
-		return NULL;
+		stack = task->stack;
 	}
 
 	RB_CLEAR_NODE(&task->node);
 	init_list_head(&task->list);
-	init_list_head(&task->slist);
-	init_list_head(&task->rlist);
-	init_list_head(&task->mlist);
-	spin_lock(&sched->lock);
+	spin_lock_irqsave(&sched->lock, flags);
 	list_add_tail(&task->list, &sched->suspend);
 	sched->weight += nice_to_weight[nice + 20];
-	spin_unlock(&sched->lock);
+	spin_unlock_irqrestore(&sched->lock, flags);
 
 	task->name = strdup(name);
 	task->status = TASK_STATUS_SUSPEND;
@@ -268,6 +598,14 @@ struct task_t * task_create(struct scheduler_t * sched, const char * name, task_
 	task->fctx = make_fcontext(task->stack + stksz, task->stksz, fcontext_entry_func);
 	task->func = func;
 	task->data = data;
+	task->arena = NULL;
+	init_list_head(&task->join);
+	init_list_head(&task->gentry);
+	task->group = NULL;
+	task->joinable = 0;
+	task->exited = 0;
+	task->wakeup = 0;
+	task->pinned = 0;
 	task->__errno = 0;
 
 	return task;
@@ -275,21 +613,76 @@ struct task_t * task_create(struct scheduler_t * sched, const char * name, task_
 
 void task_destroy(struct task_t * task)
 {
+	struct scheduler_t * sched;
+	irq_flags_t flags;
+
 	if(task)
 	{
-		spin_lock(&task->sched->lock);
-		task->sched->weight -= nice_to_weight[task->nice + 20];
-		spin_unlock(&task->sched->lock);
+		sched = task_sched_lock(task, &flags);
+		sched->weight -= task->weight;
+		spin_unlock_irqrestore(&sched->lock, flags);
 
 		if(task->name)
 			free(task->name);
-		free(task->stack);
-		free(task);
+		if(!task_pool_put(task))
+		{
+			free(task->stack);
+			kmem_cache_free(&__task_cache, task);
+		}
 	}
 }
 
+void task_set_joinable(struct task_t * task, int joinable)
+{
+	if(task && (task->status != TASK_STATUS_EXIT))
+		task->joinable = joinable ? 1 : 0;
+}
+
+/*
+ * A pinned task is never migrated by the load balancer.
+ */
+void task_set_pinned(struct task_t * task, int pinned)
+{
+	if(task)
+		task->pinned = pinned ? 1 : 0;
+}
+
+void task_join(struct task_t * task)
+{
+	struct task_join_waiter_t w;
+	struct task_t * self = task_self();
+
+	if(!task || !task->joinable || !self || (task == self))
+		return;
+
+	spin_lock(&__task_join_lock);
+	if(!task->exited)
+	{
+		init_list_head(&w.entry);
+		w.task = self;
+		w.done = 0;
+		list_add_tail(&w.entry, &task->join);
+		spin_unlock(&__task_join_lock);
+
+		while(!w.done)
+			task_suspend(self);
+		smp_rmb();
+		spin_lock(&__task_join_lock);
+	}
+	if(task->group)
+	{
+		list_del_init(&task->gentry);
+		task->group = NULL;
+	}
+	spin_unlock(&__task_join_lock);
+	task_destroy(task);
+}
+
 void task_renice(struct task_t * task, int nice)
 {
+	struct scheduler_t * sched;
+	irq_flags_t flags;
+
 	if(nice < -20)
 		nice = -20;
 	else if(nice > 19)
@@ -297,31 +690,50 @@ void task_renice(struct task_t * task, int nice)
 
 	if(task->nice != nice)
 	{
-		spin_lock(&task->sched->lock);
-		task->sched->weight -= nice_to_weight[task->nice + 20];
-		task->sched->weight += nice_to_weight[nice + 20];
-		spin_unlock(&task->sched->lock);
-
+		sched = task_sched_lock(task, &flags);
+		sched->weight -= nice_to_weight[task->nice + 20];
+		sched->weight += nice_to_weight[nice + 20];
 		task->nice = nice;
 		task->weight = nice_to_weight[nice + 20];
 		task->inv_weight = nice_to_wmult[nice + 20];
+		spin_unlock_irqrestore(&sched->lock, flags);
 	}
 }
 
+/*
+ * A resume that finds the task not yet suspended leaves a pending wakeup,
+ * which makes its next suspend return at once. Waiters recheck their
+ * condition around task_suspend(), so the wakeup is never lost.
+ */
 void task_suspend(struct task_t * task)
 {
+	struct scheduler_t * sched;
 	struct task_t * next;
 	uint64_t now, detla;
+	irq_flags_t flags;
 
 	if(task)
 	{
+		trace_record(TRACE_TYPE_SUSPEND, task, NULL);
+		sched = task->sched;
 		if(task->status == TASK_STATUS_READY)
 		{
-			task->status = TASK_STATUS_SUSPEND;
-			spin_lock(&task->sched->lock);
-			list_add_tail(&task->list, &task->sched->suspend);
-			spin_unlock(&task->sched->lock);
-			scheduler_dequeue_task(task->sched, task);
+			/*
+			 * The task may have been migrated or picked to run since
+			 * its status was read, only a queued task is dequeued.
+			 */
+			sched = task_sched_lock(task, &flags);
+			if(task->wakeup)
+			{
+				task->wakeup = 0;
+			}
+			else if((task->status == TASK_STATUS_READY) && !RB_EMPTY_NODE(&task->node))
+			{
+				__scheduler_dequeue_task(sched, task);
+				task->status = TASK_STATUS_SUSPEND;
+				list_add_tail(&task->list, &sched->suspend);
+			}
+			spin_unlock_irqrestore(&sched->lock, flags);
 		}
 		else if(task->status == TASK_STATUS_RUNNING)
 		{
@@ -330,18 +742,29 @@ void task_suspend(struct task_t * task)
 
 			task->time += detla;
 			task->vtime += calc_delta_fair(task, detla);
-			task->status = TASK_STATUS_SUSPEND;
-			spin_lock(&task->sched->lock);
-			list_add_tail(&task->list, &task->sched->suspend);
-			spin_unlock(&task->sched->lock);
+			spin_lock_irqsave(&sched->lock, flags);
+			if(task->wakeup)
+			{
+				task->wakeup = 0;
+				next = NULL;
+				task->start = now;
+			}
+			else
+			{
+				task->status = TASK_STATUS_SUSPEND;
+				list_add_tail(&task->list, &sched->suspend);
+				next = scheduler_next_ready_task(sched);
+				if(next)
+					__scheduler_dequeue_task(sched, next);
+			}
+			spin_unlock_irqrestore(&sched->lock, flags);
 
-			next = scheduler_next_ready_task(task->sched);
 			if(next)
 			{
-				scheduler_dequeue_task(task->sched, next);
 				next->status = TASK_STATUS_RUNNING;
 				next->start = now;
-				scheduler_switch_task(task->sched, next);
+				if(likely(next != task))
+					scheduler_switch_task(sched, next);
 			}
 		}
 	}
@@ -349,14 +772,31 @@ void task_suspend(struct task_t * task)
 
 void task_resume(struct task_t * task)
 {
-	if(task && (task->status == TASK_STATUS_SUSPEND))
+	struct scheduler_t * sched;
+	irq_flags_t flags;
+	int resumed = 0;
+
+	if(task)
 	{
-		task->vtime = task->sched->min_vtime;
-		task->status = TASK_STATUS_READY;
-		spin_lock(&task->sched->lock);
-		list_del_init(&task->list);
-		spin_unlock(&task->sched->lock);
-		scheduler_enqueue_task(task->sched, task);
+		sched = task_sched_lock(task, &flags);
+		if(task->status == TASK_STATUS_SUSPEND)
+		{
+			task->vtime = sched->min_vtime;
+			task->status = TASK_STATUS_READY;
+			list_del_init(&task->list);
+			__scheduler_enqueue_task(sched, task);
+			resumed = 1;
+		}
+		else
+		{
+			task->wakeup = 1;
+		}
+		spin_unlock_irqrestore(&sched->lock, flags);
+		if(resumed)
+		{
+			trace_record(TRACE_TYPE_RESUME, task, NULL);
+			arch_cpu_wakeup();
+		}
 	}
 }
 
@@ -366,9 +806,11 @@ void task_yield(void)
 	struct task_t * next, * self = task_self();
 	uint64_t now = ktime_to_ns(ktime_get());
 	uint64_t detla = now - self->start;
+	irq_flags_t flags;
 
 	self->time += detla;
 	self->vtime += calc_delta_fair(self, detla);
+	scheduler_load_balance(sched, 0);
 
 	if((int64_t)(self->vtime - sched->min_vtime) < 0)
 	{
@@ -376,10 +818,12 @@ void task_yield(void)
 	}
 	else
 	{
+		spin_lock_irqsave(&sched->lock, flags);
 		self->status = TASK_STATUS_READY;
-		scheduler_enqueue_task(sched, self);
+		__scheduler_enqueue_task(sched, self);
 		next = scheduler_next_ready_task(sched);
-		scheduler_dequeue_task(sched, next);
+		__scheduler_dequeue_task(sched, next);
+		spin_unlock_irqrestore(&sched->lock, flags);
 		next->status = TASK_STATUS_RUNNING;
 		next->start = now;
 		if(likely(next != self))
@@ -387,6 +831,134 @@ void task_yield(void)
 	}
 }
 
+void task_group_init(struct task_group_t * g)
+{
+	if(g)
+	{
+		init_list_head(&g->running);
+		init_list_head(&g->exited);
+		init_list_head(&g->wait);
+	}
+}
+
+struct task_t * task_group_spawn(struct task_group_t * g, struct scheduler_t * sched, const char * name, task_func_t func, void * data, size_t stksz, int nice)
+{
+	struct task_t * task;
+
+	if(!g)
+		return NULL;
+
+	task = task_create(sched, name, func, data, stksz, nice);
+	if(task)
+	{
+		task->joinable = 1;
+		task->group = g;
+		spin_lock(&__task_join_lock);
+		list_add_tail(&task->gentry, &g->running);
+		spin_unlock(&__task_join_lock);
+		task_resume(task);
+	}
+	return task;
+}
+
+int task_group_wait_any(struct task_group_t * g, void ** data)
+{
+	struct task_join_waiter_t w;
+	struct task_t * self = task_self();
+	struct task_t * task;
+
+	if(!g || !self)
+		return 0;
+
+	spin_lock(&__task_join_lock);
+	while(list_empty(&g->exited))
+	{
+		if(list_empty(&g->running))
+		{
+			spin_unlock(&__task_join_lock);
+			return 0;
+		}
+		init_list_head(&w.entry);
+		w.task = self;
+		w.done = 0;
+		list_add_tail(&w.entry, &g->wait);
+		spin_unlock(&__task_join_lock);
+
+		while(!w.done)
+			task_suspend(self);
+		smp_rmb();
+		spin_lock(&__task_join_lock);
+	}
+	task = list_first_entry(&g->exited, struct task_t, gentry);
+	list_del_init(&task->gentry);
+	task->group = NULL;
+	spin_unlock(&__task_join_lock);
+
+	if(data)
+		*data = task->data;
+	task_destroy(task);
+
+	return 1;
+}
+
+int task_group_wait_all(struct task_group_t * g)
+{
+	int n = 0;
+
+	while(task_group_wait_any(g, NULL))
+		n++;
+	return n;
+}
+
+static int task_timeout_function(struct timer_t * timer, void * data)
+{
+	struct task_timeout_t * to = (struct task_timeout_t *)data;
+
+	to->expired = 1;
+	task_resume(to->task);
+	return 0;
+}
+
+void task_timeout_start(struct task_timeout_t * to, ktime_t expires)
+{
+	timer_init(&to->timer, task_timeout_function, to);
+	to->task = task_self();
+	to->expired = 0;
+	timer_start(&to->timer, expires, ns_to_ktime(0));
+}
+
+void task_timeout_cancel(struct task_timeout_t * to)
+{
+	timer_cancel(&to->timer);
+}
+
+void task_sleep_until(ktime_t expires)
+{
+	struct task_timeout_t to;
+	struct task_t * self = task_self();
+
+	if(!self || (self == self->sched->idle))
+	{
+		while(ktime_before(ktime_get(), expires));
+		return;
+	}
+	if(!ktime_before(ktime_get(), expires))
+	{
+		task_yield();
+		return;
+	}
+
+	task_timeout_start(&to, expires);
+	while(!to.expired)
+		task_suspend(self);
+	task_timeout_cancel(&to);
+}
+
+void task_sleep(uint64_t ns)
+{
+	task_sleep_until(ktime_add_ns(ktime_get(), ns));
+}
+
 struct task_data_t * task_data_alloc(const char * fb, const char * input, void * data)
 {
 	struct task_data_t * td;
@@ -414,67 +986,133 @@ void task_data_free(struct task_data_t * td)
 
 static void idle_task(struct task_t * task, void * data)
 {
+	struct scheduler_t * sched = task->sched;
+	irq_flags_t flags;
+	uint64_t now;
+
 	while(1)
 	{
+		if(!rb_first_cached(&sched->ready))
+			scheduler_load_balance(sched, 1);
+		/*
+		 * Recheck with irqs masked, a task resumed by an irq after this
+		 * point leaves the irq pending and ends the halt at once.
+		 */
+		local_irq_save(flags);
+		if(!rb_first_cached(&sched->ready))
+		{
+			now = ktime_to_ns(ktime_get());
+			machine_idle();
+			sched->idle_time += ktime_to_ns(ktime_get()) - now;
+			sched->idle_count++;
+		}
+		local_irq_restore(flags);
 		task_yield();
 	}
 }
 
-static void smpboot_entry_func(void)
+static void scheduler_start(struct scheduler_t * sched)
 {
-	machine_smpinit();
-
-	struct scheduler_t * sched = scheduler_self();
 	struct task_t * task = task_create(sched, "idle", idle_task, (void *)(unsigned long)(smp_processor_id()), SZ_8K, 0);
-	spin_lock(&sched->lock);
+	irq_flags_t flags;
+
+	spin_lock_irqsave(&sched->lock, flags);
 	sched->weight -= task->weight;
+	task->pinned = 1;
 	task->nice = 26;
 	task->weight = 3;
 	task->inv_weight = 1431655765;
 	sched->weight += task->weight;
-	spin_unlock(&sched->lock);
+	sched->idle = task;
+	spin_unlock_irqrestore(&sched->lock, flags);
 	task_resume(task);
 
-	struct task_t * next = scheduler_next_ready_task(sched);
+	struct task_t * next = scheduler_pick_next_task(sched);
 	if(next)
 	{
-		sched->running = next;
-		scheduler_dequeue_task(sched, next);
 		next->status = TASK_STATUS_RUNNING;
 		next->start = ktime_to_ns(ktime_get());
 		scheduler_switch_task(sched, next);
 	}
 }
 
+static void smpboot_entry_func(void)
+{
+	machine_smpinit();
+	scheduler_start(scheduler_self());
+}
+
 void scheduler_loop(void)
 {
 	machine_smpboot(smpboot_entry_func);
+	scheduler_start(scheduler_self());
+}
 
-	struct scheduler_t * sched = scheduler_self();
-	struct task_t * task = task_create(sched, "idle", idle_task, (void *)(unsigned long)smp_processor_id(), SZ_8K, 0);
-	spin_lock(&sched->lock);
-	sched->weight -= task->weight;
-	task->nice = 26;
-	task->weight = 3;
-	task->inv_weight = 1431655765;
-	sched->weight += task->weight;
-	spin_unlock(&sched->lock);
-	task_resume(task);
+static struct kobj_t * search_class_scheduler_kobj(void)
+{
+	struct kobj_t * kclass = kobj_search_directory_with_create(kobj_get_root(), "class");
+	return kobj_search_directory_with_create(kclass, "scheduler");
+}
 
-	struct task_t * next = scheduler_next_ready_task(sched);
-	if(next)
-	{
-		sched->running = next;
-		scheduler_dequeue_task(sched, next);
-		next->status = TASK_STATUS_RUNNING;
-		next->start = ktime_to_ns(ktime_get());
-		scheduler_switch_task(sched, next);
-	}
+static ssize_t scheduler_read_balance(struct kobj_t * kobj, void * buf, size_t size)
+{
+	return sprintf(buf, "%d", __balance.enable);
+}
+
+static ssize_t scheduler_write_balance(struct kobj_t * kobj, void * buf, size_t size)
+{
+	__balance.enable = strtol(buf, NULL, 0) ? 1 : 0;
+	return size;
+}
+
+static ssize_t scheduler_read_balance_interval(struct kobj_t * kobj, void * buf, size_t size)
+{
+	return sprintf(buf, "%llu", (unsigned long long)(__balance.interval / 1000));
+}
+
+static ssize_t scheduler_write_balance_interval(struct kobj_t * kobj, void * buf, size_t size)
+{
+	__balance.interval = strtoull(buf, NULL, 0) * 1000;
+	return size;
+}
+
+static ssize_t scheduler_read_balance_imbalance(struct kobj_t * kobj, void * buf, size_t size)
+{
+	return sprintf(buf, "%llu", (unsigned long long)__balance.imbalance);
+}
+
+static ssize_t scheduler_write_balance_imbalance(struct kobj_t * kobj, void * buf, size_t size)
+{
+	__balance.imbalance = strtoull(buf, NULL, 0);
+	return size;
+}
+
+static ssize_t scheduler_read_migrations(struct kobj_t * kobj, void * buf, size_t size)
+{
+	char * p = buf;
+	int len = 0;
+	int i;
+
+	for(i = 0; i < CONFIG_MAX_SMP_CPUS; i++)
+		len += sprintf((char *)(p + len), " cpu%d: %llu\r\n", i, (unsigned long long)__sched[i].migrations);
+	return len;
+}
+
+static ssize_t scheduler_read_idle(struct kobj_t * kobj, void * buf, size_t size)
+{
+	char * p = buf;
+	int len = 0;
+	int i;
+
+	for(i = 0; i < CONFIG_MAX_SMP_CPUS; i++)
+		len += sprintf((char *)(p + len), " cpu%d: %llu %llu\r\n", i, (unsigned long long)__sched[i].idle_time, (unsigned long long)__sched[i].idle_count);
+	return len;
 }
 
 void do_init_sched(void)
 {
 	struct scheduler_t * sched;
+	struct kobj_t * kobj;
 	int i;
 
 	for(i = 0; i < CONFIG_MAX_SMP_CPUS; i++)
@@ -486,8 +1124,20 @@ void do_init_sched(void)
 		sched->ready = RB_ROOT_CACHED;
 		init_list_head(&sched->suspend);
 		sched->running = NULL;
+		sched->idle = NULL;
 		sched->min_vtime = 0;
 		sched->weight = 0;
+		sched->balance = 0;
+		sched->migrations = 0;
+		sched->idle_time = 0;
+		sched->idle_count = 0;
 		spin_unlock(&sched->lock);
 	}
+
+	kobj = search_class_scheduler_kobj();
+	kobj_add_regular(kobj, "balance", scheduler_read_balance, scheduler_write_balance, NULL);
+	kobj_add_regular(kobj, "balance_interval", scheduler_read_balance_interval, scheduler_write_balance_interval, NULL);
+	kobj_add_regular(kobj, "balance_imbalance", scheduler_read_balance_imbalance, scheduler_write_balance_imbalance, NULL);
+	kobj_add_regular(kobj, "migrations", scheduler_read_migrations, NULL, NULL);
+	kobj_add_regular(kobj, "idle", scheduler_read_idle, NULL, NULL);
 }
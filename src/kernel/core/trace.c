@@ -0,0 +1,237 @@
+/*
+ * kernel/core/trace.c
+ *
+ * Copyright(c) 2007-2021 Jianjun Jiang <8192542@qq.com>
+ * Official site: http://xboot.org
+ * Mobile phone: +86-18665388956
+ * QQ: 8192542
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#include <xboot.h>
+#include <xboot/trace.h>
+
+int __trace_enable = 0;
+static struct trace_buffer_t __trace_buffer[CONFIG_MAX_SMP_CPUS];
+
+void __trace_record(enum trace_type_t type, struct task_t * task, void * arg, uint64_t ts, uint64_t dur)
+{
+	struct trace_buffer_t * tb = &__trace_buffer[smp_processor_id()];
+	struct trace_event_t * e;
+	unsigned int idx;
+
+	if(unlikely(!tb->event))
+		return;
+
+	idx = (unsigned int)atomic_inc_return(&tb->head) - 1;
+	e = &tb->event[idx & (tb->size - 1)];
+	e->ts = ts ? ts : ktime_to_ns(ktime_get());
+	e->dur = dur;
+	e->type = type;
+	e->arg = arg;
+	if(task && task->name)
+		strlcpy(e->name, task->name, sizeof(e->name));
+	else
+		e->name[0] = '\0';
+}
+
+void trace_start(void)
+{
+	__trace_enable = 1;
+	smp_wmb();
+}
+
+void trace_stop(void)
+{
+	__trace_enable = 0;
+	smp_wmb();
+}
+
+void trace_clear(void)
+{
+	int i;
+
+	for(i = 0; i < CONFIG_MAX_SMP_CPUS; i++)
+		atomic_set(&__trace_buffer[i].head, 0);
+}
+
+struct trace_writer_t {
+	int fd;
+	int len;
+	int first;
+	char buf[SZ_4K];
+};
+
+static void trace_writer_flush(struct trace_writer_t * w)
+{
+	if(w->len > 0)
+	{
+		vfs_write(w->fd, w->buf, w->len);
+		w->len = 0;
+	}
+}
+
+static void trace_writer_printf(struct trace_writer_t * w, const char * fmt, ...)
+{
+	va_list ap;
+	int len;
+
+	if(w->len > sizeof(w->buf) - 256)
+		trace_writer_flush(w);
+	va_start(ap, fmt);
+	len = vsnprintf(w->buf + w->len, sizeof(w->buf) - w->len, fmt, ap);
+	va_end(ap);
+	if(len > 0)
+		w->len += min(len, (int)(sizeof(w->buf) - w->len - 1));
+}
+
+/*
+ * Copy a task name as a json string body, escaping quotes, backslashes
+ * and control characters
+ */
+static void trace_writer_escape(char * buf, const char * s, int len)
+{
+	int i;
+
+	for(i = 0; (i < len) && s[i]; i++)
+	{
+		if((s[i] == '"') || (s[i] == '\\'))
+		{
+			*buf++ = '\\';
+			*buf++ = s[i];
+		}
+		else if((unsigned char)s[i] < 0x20)
+		{
+			buf += sprintf(buf, "\\u%04x", (unsigned char)s[i]);
+		}
+		else
+		{
+			*buf++ = s[i];
+		}
+	}
+	*buf = '\0';
+}
+
+static void trace_writer_event(struct trace_writer_t * w, const char * name, const char * ph, int cpu, uint64_t ts, uint64_t dur, const char * task, void * arg)
+{
+	char ename[sizeof(((struct trace_event_t *)0)->name) * 6 + 1];
+	char tname[sizeof(((struct trace_event_t *)0)->name) * 6 + 1];
+
+	trace_writer_escape(ename, name, sizeof(((struct trace_event_t *)0)->name));
+	trace_writer_escape(tname, task, sizeof(((struct trace_event_t *)0)->name));
+
+	trace_writer_printf(w, "%s{\"name\":\"%s\",\"ph\":\"%s\",\"pid\":0,\"tid\":%d,\"ts\":%llu.%03u", w->first ? "" : ",\n", ename, ph, cpu, (unsigned long long)(ts / 1000), (unsigned int)(ts % 1000));
+	if(ph[0] == 'X')
+		trace_writer_printf(w, ",\"dur\":%llu.%03u", (unsigned long long)(dur / 1000), (unsigned int)(dur % 1000));
+	else if(ph[0] == 'i')
+		trace_writer_printf(w, ",\"s\":\"t\"");
+	trace_writer_printf(w, ",\"args\":{\"task\":\"%s\",\"arg\":\"%p\"}}", tname, arg);
+	w->first = 0;
+}
+
+int trace_dump(const char * path)
+{
+	struct trace_writer_t * w;
+	struct trace_buffer_t * tb;
+	struct trace_event_t * e, * last;
+	unsigned int head, n, i;
+	int cpu;
+
+	if(!path)
+		return -1;
+
+	w = malloc(sizeof(struct trace_writer_t));
+	if(!w)
+		return -1;
+
+	w->fd = vfs_open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if(w->fd < 0)
+	{
+		free(w);
+		return -1;
+	}
+	w->len = 0;
+	w->first = 1;
+
+	trace_writer_printf(w, "{\"traceEvents\":[\n");
+	for(cpu = 0; cpu < CONFIG_MAX_SMP_CPUS; cpu++)
+	{
+		tb = &__trace_buffer[cpu];
+		if(!tb->event)
+			continue;
+
+		trace_writer_printf(w, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%d,\"args\":{\"name\":\"cpu%d\"}}", w->first ? "" : ",\n", cpu, cpu);
+		w->first = 0;
+
+		head = (unsigned int)atomic_get(&tb->head);
+		n = min(head, tb->size);
+		last = NULL;
+		for(i = head - n; i != head; i++)
+		{
+			e = &tb->event[i & (tb->size - 1)];
+			switch(e->type)
+			{
+			case TRACE_TYPE_SWITCH:
+				if(last)
+					trace_writer_event(w, last->name, "X", cpu, last->ts, e->ts - last->ts, last->name, last->arg);
+				last = e;
+				break;
+			case TRACE_TYPE_SUSPEND:
+				trace_writer_event(w, "suspend", "i", cpu, e->ts, 0, e->name, e->arg);
+				break;
+			case TRACE_TYPE_RESUME:
+				trace_writer_event(w, "resume", "i", cpu, e->ts, 0, e->name, e->arg);
+				break;
+			case TRACE_TYPE_MUTEX:
+				trace_writer_event(w, "mutex wait", "X", cpu, e->ts, e->dur, e->name, e->arg);
+				break;
+			case TRACE_TYPE_TIMER:
+				trace_writer_event(w, "timer", "X", cpu, e->ts, e->dur, e->name, e->arg);
+				break;
+			default:
+				break;
+			}
+		}
+	}
+	trace_writer_printf(w, "\n]}\n");
+	trace_writer_flush(w);
+	vfs_close(w->fd);
+	free(w);
+
+	return 0;
+}
+
+void do_init_trace(void)
+{
+	struct trace_buffer_t * tb;
+	unsigned int size = CONFIG_TRACE_BUFFER_SIZE;
+	int i;
+
+	if(size & (size - 1))
+		size = roundup_pow_of_two(size);
+
+	for(i = 0; i < CONFIG_MAX_SMP_CPUS; i++)
+	{
+		tb = &__trace_buffer[i];
+		tb->event = malloc(sizeof(struct trace_event_t) * size);
+		tb->size = tb->event ? size : 0;
+		atomic_set(&tb->head, 0);
+	}
+}
@@ -31,6 +31,8 @@
 #include <input/keyboard.h>
 #include <xboot/window.h>
 
+static KMEM_CACHE_DEFINE(__window_cache, "window", sizeof(struct window_t), 0, NULL, NULL);
+
 static void fb_dummy_setbl(struct framebuffer_t * fb, int brightness)
 {
 }
@@ -209,7 +211,7 @@ struct window_t * window_alloc(const char * fb, const char * input)
 	if(!wm)
 		return NULL;
 
-	w = malloc(sizeof(struct window_t));
+	w = kmem_cache_alloc(&__window_cache);
 	if(!w)
 		return NULL;
 
@@ -218,6 +220,7 @@ struct window_t * window_alloc(const char * fb, const char * input)
 	w->s = framebuffer_create_surface(w->wm->fb);
 	w->rl = region_list_alloc(0);
 	w->event = fifo_alloc(sizeof(struct event_t) * CONFIG_EVENT_FIFO_SIZE);
+	w->arena = arena_alloc(CONFIG_WINDOW_ARENA_SIZE);
 	w->launcher = 0;
 	if(p)
 	{
@@ -272,10 +275,11 @@ void window_free(struct window_t * w)
 	if(w->wm->wcount <= 0)
 		window_manager_free(w->wm);
 	fifo_free(w->event);
+	arena_free(w->arena);
 	hmap_free(w->map, NULL);
 	framebuffer_destroy_surface(w->wm->fb, w->s);
 	region_list_free(w->rl);
-	free(w);
+	kmem_cache_free(&__window_cache, w);
 }
 
 void window_to_front(struct window_t * w)
@@ -321,6 +325,8 @@ void window_region_list_clear(struct window_t * w)
 void window_present(struct window_t * w, void * o, void (*draw)(struct window_t *, void *))
 {
 	struct surface_t * s = w->s;
+	struct task_t * self = task_self();
+	struct arena_t * arena;
 	struct region_t * r, region;
 	struct matrix_t m;
 	uint32_t * p, * q;
@@ -367,7 +373,19 @@ void window_present(struct window_t * w, void * o, void (*draw)(struct window_t
 			}
 		}
 		if(draw)
-			draw(w, o);
+		{
+			if(self)
+			{
+				arena = self->arena;
+				self->arena = w->arena;
+				draw(w, o);
+				self->arena = arena;
+			}
+			else
+			{
+				draw(w, o);
+			}
+		}
 		if(w->wm->cursor.show)
 		{
 			r = &w->wm->cursor.rn;
@@ -376,6 +394,7 @@ void window_present(struct window_t * w, void * o, void (*draw)(struct window_t
 		}
 	}
 	framebuffer_present_surface(w->wm->fb, w->s, w->rl);
+	arena_reset(w->arena);
 }
 
 void window_exit(struct window_t * w)
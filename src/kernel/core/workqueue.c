@@ -0,0 +1,299 @@
+/*
+ * kernel/core/workqueue.c
+ *
+ * Copyright(c) 2007-2021 Jianjun Jiang <8192542@qq.com>
+ * Official site: http://xboot.org
+ * Mobile phone: +86-18665388956
+ * QQ: 8192542
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#include <xboot.h>
+#include <xboot/workqueue.h>
+
+struct work_flush_waiter_t {
+	struct list_head entry;
+	struct task_t * task;
+	int done;
+};
+
+static struct worker_t __worker[CONFIG_MAX_SMP_CPUS];
+static spinlock_t __work_lock = SPIN_LOCK_INIT();
+
+static inline struct worker_t * work_worker_choice(struct work_t * work, int cpu)
+{
+	/*
+	 * A work that is still running is queued to the same worker again,
+	 * so that one work never runs on two cpus at the same time.
+	 */
+	if((work->state == WORK_STATE_RUNNING) && work->worker)
+		return work->worker;
+	if((cpu < 0) || (cpu >= CONFIG_MAX_SMP_CPUS))
+		cpu = smp_processor_id();
+	return &__worker[cpu];
+}
+
+static inline void work_flush_wakeup(struct worker_t * wk)
+{
+	struct work_flush_waiter_t * w, * n;
+	struct task_t * task;
+
+	list_for_each_entry_safe(w, n, &wk->flush, entry)
+	{
+		list_del_init(&w->entry);
+		task = w->task;
+		smp_wmb();
+		w->done = 1;
+		task_resume(task);
+	}
+}
+
+static int work_timer_function(struct timer_t * timer, void * data)
+{
+	struct work_t * work = (struct work_t *)data;
+	struct worker_t * wk = NULL;
+	irq_flags_t flags;
+
+	spin_lock_irqsave(&__work_lock, flags);
+	if(work->state == WORK_STATE_DELAYED)
+	{
+		wk = work->worker;
+		work->state = WORK_STATE_PENDING;
+		list_add_tail(&work->entry, &wk->head);
+	}
+	spin_unlock_irqrestore(&__work_lock, flags);
+	if(wk)
+		semaphore_up(&wk->sem);
+	return 0;
+}
+
+void work_init(struct work_t * work, work_func_t func, work_func_t done, void * data)
+{
+	if(work)
+	{
+		init_list_head(&work->entry);
+		timer_init(&work->timer, work_timer_function, work);
+		work->worker = NULL;
+		work->state = WORK_STATE_IDLE;
+		work->func = func;
+		work->done = done;
+		work->data = data;
+	}
+}
+
+int work_queue_on(int cpu, struct work_t * work)
+{
+	struct worker_t * wk;
+	irq_flags_t flags;
+
+	if(!work || !work->func)
+		return 0;
+
+	spin_lock_irqsave(&__work_lock, flags);
+	if((work->state == WORK_STATE_PENDING) || (work->state == WORK_STATE_DELAYED))
+	{
+		spin_unlock_irqrestore(&__work_lock, flags);
+		return 0;
+	}
+	wk = work_worker_choice(work, cpu);
+	work->worker = wk;
+	work->state = WORK_STATE_PENDING;
+	list_add_tail(&work->entry, &wk->head);
+	spin_unlock_irqrestore(&__work_lock, flags);
+	semaphore_up(&wk->sem);
+
+	return 1;
+}
+
+int work_queue(struct work_t * work)
+{
+	return work_queue_on(-1, work);
+}
+
+int work_queue_delayed(struct work_t * work, uint64_t ns)
+{
+	irq_flags_t flags;
+
+	if(ns == 0)
+		return work_queue(work);
+	if(!work || !work->func)
+		return 0;
+
+	spin_lock_irqsave(&__work_lock, flags);
+	if((work->state == WORK_STATE_PENDING) || (work->state == WORK_STATE_DELAYED))
+	{
+		spin_unlock_irqrestore(&__work_lock, flags);
+		return 0;
+	}
+	work->worker = work_worker_choice(work, -1);
+	work->state = WORK_STATE_DELAYED;
+	spin_unlock_irqrestore(&__work_lock, flags);
+	timer_start_now(&work->timer, ns_to_ktime(ns));
+
+	return 1;
+}
+
+int work_pending(struct work_t * work)
+{
+	if(work)
+		return (work->state != WORK_STATE_IDLE) ? 1 : 0;
+	return 0;
+}
+
+void work_flush(struct work_t * work)
+{
+	struct work_flush_waiter_t w;
+	struct task_t * self = task_self();
+	irq_flags_t flags;
+	int delayed = 0;
+
+	if(!work || !work->worker)
+		return;
+
+	spin_lock_irqsave(&__work_lock, flags);
+	if(work->state == WORK_STATE_DELAYED)
+	{
+		work->state = WORK_STATE_PENDING;
+		list_add_tail(&work->entry, &work->worker->head);
+		delayed = 1;
+	}
+	spin_unlock_irqrestore(&__work_lock, flags);
+	if(delayed)
+	{
+		timer_cancel(&work->timer);
+		semaphore_up(&work->worker->sem);
+	}
+
+	/*
+	 * Can't wait without a task context, or on the worker which is
+	 * the only one able to finish the work.
+	 */
+	if(!self || (self == work->worker->task))
+		return;
+
+	spin_lock_irqsave(&__work_lock, flags);
+	while(work->state != WORK_STATE_IDLE)
+	{
+		init_list_head(&w.entry);
+		w.task = self;
+		w.done = 0;
+		list_add_tail(&w.entry, &work->worker->flush);
+		spin_unlock_irqrestore(&__work_lock, flags);
+
+		while(!w.done)
+			task_suspend(self);
+		smp_rmb();
+		spin_lock_irqsave(&__work_lock, flags);
+	}
+	spin_unlock_irqrestore(&__work_lock, flags);
+}
+
+int work_cancel(struct work_t * work)
+{
+	irq_flags_t flags;
+	int delayed = 0;
+	int ret = 0;
+
+	if(!work)
+		return 0;
+
+	spin_lock_irqsave(&__work_lock, flags);
+	if(work->state == WORK_STATE_PENDING)
+	{
+		list_del_init(&work->entry);
+		work->state = WORK_STATE_IDLE;
+		ret = 1;
+	}
+	else if(work->state == WORK_STATE_DELAYED)
+	{
+		work->state = WORK_STATE_IDLE;
+		delayed = 1;
+		ret = 1;
+	}
+	spin_unlock_irqrestore(&__work_lock, flags);
+	if(delayed)
+		timer_cancel(&work->timer);
+	if(work->worker)
+		work_flush(work);
+
+	return ret;
+}
+
+static void worker_task(struct task_t * task, void * data)
+{
+	struct worker_t * wk = (struct worker_t *)data;
+	struct work_t * work;
+	work_func_t func, done;
+	void * wdata;
+	irq_flags_t flags;
+
+	while(1)
+	{
+		semaphore_down(&wk->sem);
+
+		spin_lock_irqsave(&__work_lock, flags);
+		if(list_empty(&wk->head))
+		{
+			spin_unlock_irqrestore(&__work_lock, flags);
+			continue;
+		}
+		work = list_first_entry(&wk->head, struct work_t, entry);
+		list_del_init(&work->entry);
+		work->state = WORK_STATE_RUNNING;
+		func = work->func;
+		done = work->done;
+		wdata = work->data;
+		spin_unlock_irqrestore(&__work_lock, flags);
+
+		func(work, wdata);
+
+		/*
+		 * The work is idle again before the completion callback runs,
+		 * so the callback is free to queue it again or release it.
+		 */
+		spin_lock_irqsave(&__work_lock, flags);
+		if(work->state == WORK_STATE_RUNNING)
+			work->state = WORK_STATE_IDLE;
+		work_flush_wakeup(wk);
+		spin_unlock_irqrestore(&__work_lock, flags);
+
+		if(done)
+			done(work, wdata);
+	}
+}
+
+void do_init_workqueue(void)
+{
+	struct worker_t * wk;
+	char name[16];
+	int i;
+
+	for(i = 0; i < CONFIG_MAX_SMP_CPUS; i++)
+	{
+		wk = &__worker[i];
+		init_list_head(&wk->head);
+		init_list_head(&wk->flush);
+		semaphore_init(&wk->sem, 0);
+		sprintf(name, "kworker/%d", i);
+		wk->task = task_create(&__sched[i], name, worker_task, wk, 0, 0);
+		task_set_pinned(wk->task, 1);
+		task_resume(wk->task);
+	}
+}
@@ -30,8 +30,11 @@
 #include <limits.h>
 #include <string.h>
 #include <malloc.h>
+#include <xboot/slab.h>
 #include <graphic/region.h>
 
+static KMEM_CACHE_DEFINE(__region_list_cache, "region_list", sizeof(struct region_list_t), 0, NULL, NULL);
+
 struct region_list_t * region_list_alloc(unsigned int size)
 {
 	struct region_list_t * rl;
@@ -44,7 +47,7 @@ struct region_list_t * region_list_alloc(unsigned int size)
 	if(!r)
 		return NULL;
 
-	rl = malloc(sizeof(struct region_list_t));
+	rl = kmem_cache_alloc(&__region_list_cache);
 	if(!rl)
 	{
 		free(r);
@@ -62,7 +65,7 @@ void region_list_free(struct region_list_t * rl)
 	if(rl)
 	{
 		free(rl->region);
-		free(rl);
+		kmem_cache_free(&__region_list_cache, rl);
 	}
 }
 
@@ -257,15 +257,35 @@ struct xvg_context_t {
 	enum xvg_line_join_t join;
 	enum xvg_line_cap_t cap;
 	enum xvg_fill_rule_t rule;
+	struct arena_t * arena;
+	struct arena_mark_t mark;
 };
 
+/*
+ * Scratch memory lives in the frame arena of the drawing task when there
+ * is one, and is handed back as a whole in xvg_exit.
+ */
+static inline void * xvg_malloc(struct xvg_context_t * ctx, size_t size)
+{
+	if(ctx->arena)
+		return arena_malloc(ctx->arena, size);
+	return malloc(size);
+}
+
+static inline void * xvg_realloc(struct xvg_context_t * ctx, void * ptr, size_t osize, size_t nsize)
+{
+	if(ctx->arena)
+		return arena_realloc(ctx->arena, ptr, osize, nsize);
+	return realloc(ptr, nsize);
+}
+
 static struct xvg_mem_page_t * xvg_next_page(struct xvg_context_t * ctx, struct xvg_mem_page_t * cur)
 {
 	struct xvg_mem_page_t * page;
 
 	if(cur && cur->next)
 		return cur->next;
-	page = malloc(sizeof(struct xvg_mem_page_t));
+	page = xvg_malloc(ctx, sizeof(struct xvg_mem_page_t));
 	if(!page)
 		return NULL;
 	memset(page, 0, sizeof(struct xvg_mem_page_t));
@@ -322,8 +342,8 @@ static void xvg_add_path_point(struct xvg_context_t * ctx, float x, float y, int
 	}
 	if(ctx->npoints + 1 > ctx->cpoints)
 	{
+		ctx->points = xvg_realloc(ctx, ctx->points, sizeof(struct xvg_point_t) * ctx->cpoints, sizeof(struct xvg_point_t) * (ctx->cpoints > 0 ? ctx->cpoints * 2 : 64));
 		ctx->cpoints = ctx->cpoints > 0 ? ctx->cpoints * 2 : 64;
-		ctx->points = realloc(ctx->points, sizeof(struct xvg_point_t) * ctx->cpoints);
 		if(!ctx->points)
 			return;
 	}
@@ -342,8 +362,8 @@ static void xvg_add_edge(struct xvg_context_t * ctx, float x0, float y0, float x
 		return;
 	if(ctx->nedges + 1 > ctx->cedges)
 	{
+		ctx->edges = (struct xvg_edge_t *)xvg_realloc(ctx, ctx->edges, sizeof(struct xvg_edge_t) * ctx->cedges, sizeof(struct xvg_edge_t) * (ctx->cedges > 0 ? ctx->cedges * 2 : 64));
 		ctx->cedges = ctx->cedges > 0 ? ctx->cedges * 2 : 64;
-		ctx->edges = (struct xvg_edge_t *)realloc(ctx->edges, sizeof(struct xvg_edge_t) * ctx->cedges);
 		if(!ctx->edges)
 			return;
 	}
@@ -1011,8 +1031,8 @@ static void xvg_add_point(struct xvg_context_t * ctx, float x, float y)
 {
 	if(ctx->npts + 1 > ctx->cpts)
 	{
+		ctx->pts = xvg_realloc(ctx, ctx->pts, ctx->cpts * 2 * sizeof(float), (ctx->cpts ? ctx->cpts * 2 : 8) * 2 * sizeof(float));
 		ctx->cpts = ctx->cpts ? ctx->cpts * 2 : 8;
-		ctx->pts = realloc(ctx->pts, ctx->cpts * 2 * sizeof(float));
 		if(!ctx->pts)
 			return;
 	}
@@ -1142,8 +1162,11 @@ static void xvg_init(struct xvg_context_t * ctx, struct surface_t * s, struct re
 	ctx->width = s->width;
 	ctx->height = s->height;
 	ctx->stride = s->stride;
+	ctx->arena = task_arena();
+	if(ctx->arena)
+		arena_mark(ctx->arena, &ctx->mark);
 	ctx->cscanline = ctx->width;
-	ctx->scanline = malloc(ctx->cscanline);
+	ctx->scanline = xvg_malloc(ctx, ctx->cscanline);
 	ctx->pts = NULL;
 	ctx->cpts = 0;
 	ctx->npts = 0;
@@ -1168,6 +1191,11 @@ static void xvg_exit(struct xvg_context_t * ctx)
 
 	if(ctx)
 	{
+		if(ctx->arena)
+		{
+			arena_release(ctx->arena, &ctx->mark);
+			return;
+		}
 		p = ctx->pages;
 		while(p)
 		{
@@ -1181,6 +1209,8 @@ static void xvg_exit(struct xvg_context_t * ctx)
 			free(ctx->points);
 		if(ctx->scanline)
 			free(ctx->scanline);
+		if(ctx->pts)
+			free(ctx->pts);
 	}
 }
 
@@ -30,6 +30,7 @@
 #include <time/delay.h>
 #include <xboot/ktime.h>
 #include <xboot/module.h>
+#include <xboot/task.h>
 
 void ndelay(u32_t ns)
 {
@@ -51,3 +52,9 @@ void mdelay(u32_t ms)
 	while(ktime_before(ktime_get(), timeout));
 }
 EXPORT_SYMBOL(mdelay);
+
+void msleep(u32_t ms)
+{
+	task_sleep((uint64_t)ms * 1000000ULL);
+}
+EXPORT_SYMBOL(msleep);
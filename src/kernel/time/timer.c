@@ -29,6 +29,7 @@
 #include <clockevent/clockevent.h>
 #include <clocksource/clocksource.h>
 #include <time/timer.h>
+#include <xboot/trace.h>
 
 static struct timer_base_t __timer_base = {
 	.head = { NULL },
@@ -180,7 +181,16 @@ static void timer_event_handler(struct clockevent_t * ce, void * data)
 
 		del_timer(base, timer);
 		timer->state = TIMER_STATE_CALLBACK;
-		restart = timer->function(timer, timer->data);
+		if(trace_enabled())
+		{
+			uint64_t ts = ktime_to_ns(ktime_get());
+			restart = timer->function(timer, timer->data);
+			trace_record_span(TRACE_TYPE_TIMER, NULL, timer->function, ts, ktime_to_ns(ktime_get()) - ts);
+		}
+		else
+		{
+			restart = timer->function(timer, timer->data);
+		}
 		timer->state = TIMER_STATE_INACTIVE;
 		if(restart)
 			add_timer(base, timer);
@@ -46,80 +46,213 @@ struct cpio_newc_header_t {
 	u8_t c_check[8];
 } __attribute__ ((packed));
 
-static bool_t get_next_token(const char * path, const char * prefix, char * result)
+/*
+ * Node of the path index built at mount time
+ */
+struct cpio_node_t {
+	struct list_head entry;
+	struct list_head children;
+	struct cpio_node_t * parent;
+	char * path;		/* Full path without leading slash */
+	const char * name;	/* Last component of path */
+	u64_t offset;		/* Offset of file data */
+	u32_t size;
+	u32_t mode;
+	u32_t mtime;
+
+	/* Position of the last readdir, for listing in order */
+	struct list_head * cursor;
+	s64_t cursor_off;
+};
+
+struct cpio_index_t {
+	struct cpio_node_t root;
+	struct hmap_t * map;
+};
+
+static inline u32_t cpio_hex(const u8_t * p)
+{
+	u32_t v = 0;
+	int i;
+
+	for(i = 0; i < 8; i++)
+	{
+		if((p[i] >= '0') && (p[i] <= '9'))
+			v = (v << 4) | (p[i] - '0');
+		else if((p[i] >= 'a') && (p[i] <= 'f'))
+			v = (v << 4) | (p[i] - 'a' + 10);
+		else if((p[i] >= 'A') && (p[i] <= 'F'))
+			v = (v << 4) | (p[i] - 'A' + 10);
+		else
+			break;
+	}
+	return v;
+}
+
+static void cpio_node_init(struct cpio_node_t * cn, struct cpio_node_t * parent)
+{
+	init_list_head(&cn->entry);
+	init_list_head(&cn->children);
+	cn->parent = parent;
+	cn->offset = 0;
+	cn->size = 0;
+	cn->mode = 0040755;
+	cn->mtime = 0;
+	cn->cursor = &cn->children;
+	cn->cursor_off = -1;
+}
+
+static struct cpio_node_t * cpio_node_alloc(struct cpio_index_t * idx, const char * path, struct cpio_node_t * parent)
 {
-	const char * p, * q;
-	int l;
+	struct cpio_node_t * cn;
+	const char * p;
+
+	cn = malloc(sizeof(struct cpio_node_t));
+	if(!cn)
+		return NULL;
+
+	cn->path = strdup(path);
+	if(!cn->path)
+	{
+		free(cn);
+		return NULL;
+	}
+	p = strrchr(cn->path, '/');
+	cn->name = p ? p + 1 : cn->path;
+	cpio_node_init(cn, parent);
+	list_add_tail(&cn->entry, &parent->children);
+	hmap_add(idx->map, cn->path, cn);
 
-	if(!path || !prefix || !result)
-		return FALSE;
+	return cn;
+}
 
-	if(*path == '/')
-		path++;
+static void cpio_node_free(struct hmap_entry_t * e)
+{
+	struct cpio_node_t * cn = (struct cpio_node_t *)e->value;
 
-	if(*prefix == '/')
-		prefix++;
+	free(cn->path);
+	free(cn);
+}
 
-	l = strlen(prefix);
-	if(strncmp(path, prefix, l) != 0)
-		return FALSE;
+/*
+ * Find the node of a path, creating it and any missing parent
+ * directory on the way
+ */
+static struct cpio_node_t * cpio_index_node(struct cpio_index_t * idx, char * path)
+{
+	struct cpio_node_t * parent, * cn;
+	char * p;
 
-	p = &path[l];
-	if(*p == '\0')
-		return FALSE;
-	if(*p == '/')
-		p++;
-	if(*p == '\0')
-		return FALSE;
+	cn = hmap_search(idx->map, path);
+	if(cn)
+		return cn;
 
-	q = strchr(p, '/');
-	if(q)
+	p = strrchr(path, '/');
+	if(p)
 	{
-		if (*(q + 1) != '\0')
-			return FALSE;
-		l = q - p;
+		*p = '\0';
+		parent = cpio_index_node(idx, path);
+		*p = '/';
+		if(!parent)
+			return NULL;
 	}
 	else
 	{
-		l = strlen(p);
+		parent = &idx->root;
 	}
-	memcpy(result, p, l);
-	result[l] = '\0';
 
-	return TRUE;
+	return cpio_node_alloc(idx, path, parent);
 }
 
-static bool_t check_path(const char * path, const char * prefix, const char * name)
+static void cpio_index_free(struct cpio_index_t * idx)
 {
-	int l;
+	if(idx)
+	{
+		hmap_free(idx->map, cpio_node_free);
+		free(idx);
+	}
+}
 
-	if(!path || !prefix || !name)
-		return FALSE;
+static struct cpio_index_t * cpio_index_build(struct block_t * blk)
+{
+	struct cpio_newc_header_t * header;
+	struct cpio_index_t * idx;
+	struct cpio_node_t * cn;
+	u8_t buf[sizeof(struct cpio_newc_header_t) + VFS_MAX_PATH];
+	u64_t capacity = block_capacity(blk);
+	u64_t off = 0, data, len;
+	u32_t size, name_size;
+	char * path;
+
+	idx = malloc(sizeof(struct cpio_index_t));
+	if(!idx)
+		return NULL;
+
+	idx->map = hmap_alloc(0);
+	if(!idx->map)
+	{
+		free(idx);
+		return NULL;
+	}
+	idx->root.path = "";
+	idx->root.name = idx->root.path;
+	cpio_node_init(&idx->root, NULL);
 
-	if(path[0] == '/')
-		path++;
+	/* Read header and name of each entry at once */
+	header = (struct cpio_newc_header_t *)buf;
+	while(off + sizeof(struct cpio_newc_header_t) <= capacity)
+	{
+		len = capacity - off;
+		if(len > sizeof(buf))
+			len = sizeof(buf);
+		if(block_read(blk, buf, off, len) != len)
+			break;
 
-	if(prefix[0] == '/')
-		prefix++;
+		if(strncmp((const char *)header->c_magic, "070701", 6) != 0)
+			break;
 
-	l = strlen(prefix);
-	if(l && (strncmp(path, prefix, l) != 0))
-		return FALSE;
+		size = cpio_hex(header->c_filesize);
+		name_size = cpio_hex(header->c_namesize);
+		if((name_size == 0) || (name_size > len - sizeof(struct cpio_newc_header_t)))
+			break;
 
-	path += l;
+		path = (char *)&buf[sizeof(struct cpio_newc_header_t)];
+		path[name_size - 1] = '\0';
+		if(strcmp(path, "TRAILER!!!") == 0)
+			break;
 
-	if(path[0] == '/')
-		path++;
+		data = (off + sizeof(struct cpio_newc_header_t) + name_size + 3) & ~0x3;
+		off = (data + size + 3) & ~0x3;
+
+		/* Index "./a/b/" as "a/b" */
+		while((path[0] == '.') && (path[1] == '/'))
+			path += 2;
+		while(path[0] == '/')
+			path++;
+		while((name_size = strlen(path)) && (path[name_size - 1] == '/'))
+			path[name_size - 1] = '\0';
+		if((path[0] == '\0') || (strcmp(path, ".") == 0))
+			continue;
 
-	if(strcmp(path, name) != 0)
-		return FALSE;
+		cn = cpio_index_node(idx, path);
+		if(!cn)
+		{
+			cpio_index_free(idx);
+			return NULL;
+		}
+		cn->offset = data;
+		cn->size = size;
+		cn->mode = cpio_hex(header->c_mode);
+		cn->mtime = cpio_hex(header->c_mtime);
+	}
 
-	return TRUE;
+	return idx;
 }
 
 static int cpio_mount(struct vfs_mount_t * m, const char * dev)
 {
 	struct cpio_newc_header_t header;
+	struct cpio_index_t * idx;
 	u64_t rd;
 
 	if(dev == NULL)
@@ -135,15 +268,20 @@ static int cpio_mount(struct vfs_mount_t * m, const char * dev)
 	if(strncmp((const char *)header.c_magic, "070701", 6) != 0)
 		return -1;
 
+	idx = cpio_index_build(m->m_dev);
+	if(!idx)
+		return -1;
+
 	m->m_flags |= MOUNT_RO;
-	m->m_root->v_data = NULL;
-	m->m_data = NULL;
+	m->m_root->v_data = &idx->root;
+	m->m_data = idx;
 
 	return 0;
 }
 
 static int cpio_unmount(struct vfs_mount_t * m)
 {
+	cpio_index_free(m->m_data);
 	m->m_data = NULL;
 	return 0;
 }
@@ -165,7 +303,7 @@ static int cpio_vput(struct vfs_mount_t * m, struct vfs_node_t * n)
 
 static u64_t cpio_read(struct vfs_node_t * n, s64_t off, void * buf, u64_t len)
 {
-	u64_t toff;
+	struct cpio_node_t * cn = (struct cpio_node_t *)n->v_data;
 	u64_t sz = 0;
 
 	if(n->v_type != VNT_REG)
@@ -178,8 +316,7 @@ static u64_t cpio_read(struct vfs_node_t * n, s64_t off, void * buf, u64_t len)
 	if((n->v_size - off) < sz)
 		sz = n->v_size - off;
 
-	toff = (u64_t)((unsigned long)(n->v_data));
-	sz = block_read(n->v_mount->m_dev, (u8_t *)buf, (toff + off), sz);
+	sz = block_read(n->v_mount->m_dev, (u8_t *)buf, (cn->offset + off), sz);
 
 	return sz;
 }
@@ -201,57 +338,38 @@ static int cpio_sync(struct vfs_node_t * n)
 
 static int cpio_readdir(struct vfs_node_t * dn, s64_t off, struct vfs_dirent_t * d)
 {
-	struct cpio_newc_header_t header;
-	char path[VFS_MAX_PATH];
-	char name[VFS_MAX_NAME];
-	u32_t size, name_size, mode;
-	u64_t toff = 0, rd;
-	char buf[9];
-	int i = 0;
+	struct cpio_node_t * dcn = (struct cpio_node_t *)dn->v_data;
+	struct cpio_node_t * cn;
+	struct list_head * pos;
+	s64_t i;
+	u32_t mode;
 
-	while(1)
-	{
-		rd = block_read(dn->v_mount->m_dev, (u8_t *)&header, toff, sizeof(struct cpio_newc_header_t));
-		if(rd != sizeof(struct cpio_newc_header_t))
-			return -1;
-
-		if(strncmp((const char *)&header.c_magic, "070701", 6) != 0)
-			return -1;
-
-		buf[8] = '\0';
-
-		memcpy(buf, &header.c_filesize, 8);
-		size = strtoul((const char *)buf, NULL, 16);
-
-		memcpy(buf, &header.c_namesize, 8);
-		name_size = strtoul((const char *)buf, NULL, 16);
-
-		memcpy(buf, &header.c_mode, 8);
-		mode = strtoul((const char *)buf, NULL, 16);
-
-		rd = block_read(dn->v_mount->m_dev, (u8_t *)path, toff + sizeof(struct cpio_newc_header_t), name_size);
-		if(!rd)
-			return -1;
+	if(!dcn || (off < 0))
+		return -1;
 
-		if((size == 0) && (mode == 0) && (name_size == 11) && (strncmp(path, "TRAILER!!!", 10) == 0))
+	/* Go on from the last entry returned when listing in order */
+	if(dcn->cursor_off <= off)
+	{
+		pos = dcn->cursor;
+		i = dcn->cursor_off;
+	}
+	else
+	{
+		pos = &dcn->children;
+		i = -1;
+	}
+	while(i < off)
+	{
+		pos = pos->next;
+		if(pos == &dcn->children)
 			return -1;
-
-		toff += sizeof(struct cpio_newc_header_t);
-		toff += (((name_size + 1) & ~3) + 2) + size;
-		toff = (toff + 3) & ~3;
-
-		if(path[0] == '.')
-			continue;
-
-		if(!get_next_token(path, dn->v_path, name))
-			continue;
-
-		if(i++ == off)
-		{
-			toff = 0;
-			break;
-		}
+		i++;
 	}
+	dcn->cursor = pos;
+	dcn->cursor_off = off;
+
+	cn = list_entry(pos, struct cpio_node_t, entry);
+	mode = cn->mode;
 
 	if((mode & 00170000) == 0140000)
 	{
@@ -286,7 +404,7 @@ static int cpio_readdir(struct vfs_node_t * dn, s64_t off, struct vfs_dirent_t *
 		d->d_type = VDT_REG;
 	}
 
-	strlcpy(d->d_name, name, sizeof(d->d_name));
+	strlcpy(d->d_name, cn->name, sizeof(d->d_name));
 	d->d_off = off;
 	d->d_reclen = 1;
 
@@ -295,53 +413,32 @@ static int cpio_readdir(struct vfs_node_t * dn, s64_t off, struct vfs_dirent_t *
 
 static int cpio_lookup(struct vfs_node_t * dn, const char * name, struct vfs_node_t * n)
 {
-	struct cpio_newc_header_t header;
+	struct cpio_index_t * idx = (struct cpio_index_t *)dn->v_mount->m_data;
+	struct cpio_node_t * dcn = (struct cpio_node_t *)dn->v_data;
+	struct cpio_node_t * cn;
 	char path[VFS_MAX_PATH];
-	u64_t off = 0, rd;
-	u32_t size, name_size, mode, mtime;
-	u8_t buf[9];
-
-	while(1)
-	{
-		rd = block_read(dn->v_mount->m_dev, (u8_t *)&header, off, sizeof(struct cpio_newc_header_t));
-		if(rd != sizeof(struct cpio_newc_header_t))
-			return -1;
-
-		if(strncmp((const char *)header.c_magic, "070701", 6) != 0)
-			return -1;
-
-		buf[8] = '\0';
-
-		memcpy(buf, &header.c_filesize, 8);
-		size = strtoul((const char *)buf, NULL, 16);
-
-		memcpy(buf, &header.c_namesize, 8);
-		name_size = strtoul((const char *)buf, NULL, 16);
-
-		memcpy(buf, &header.c_mode, 8);
-		mode = strtoul((const char *)buf, NULL, 16);
-
-		memcpy(buf, &header.c_mtime, 8);
-		mtime = strtoul((const char *)buf, NULL, 16);
+	u32_t mode;
 
-		rd = block_read(dn->v_mount->m_dev, (u8_t *)path, off + sizeof(struct cpio_newc_header_t), name_size);
-		if(!rd)
-			return -1;
+	if(!idx || !dcn)
+		return -1;
 
-		if((size == 0) && (mode == 0) && (name_size == 11) && (strncmp(path, "TRAILER!!!", 10) == 0))
+	if(dcn->path[0] != '\0')
+	{
+		if(snprintf(path, sizeof(path), "%s/%s", dcn->path, name) >= sizeof(path))
 			return -1;
-
-		if((path[0] != '.') && check_path(path, dn->v_path, name))
-			break;
-
-		off += sizeof(struct cpio_newc_header_t);
-		off += (((name_size + 1) & ~3) + 2) + size;
-		off = (off + 3) & ~0x3;
+		cn = hmap_search(idx->map, path);
 	}
+	else
+	{
+		cn = hmap_search(idx->map, name);
+	}
+	if(!cn)
+		return -1;
 
-	n->v_atime = mtime;
-	n->v_mtime = mtime;
-	n->v_ctime = mtime;
+	mode = cn->mode;
+	n->v_atime = cn->mtime;
+	n->v_mtime = cn->mtime;
+	n->v_ctime = cn->mtime;
 	n->v_mode = 0;
 
 	if((mode & 00170000) == 0140000)
@@ -393,11 +490,8 @@ static int cpio_lookup(struct vfs_node_t * dn, const char * name, struct vfs_nod
 	n->v_mode |= (mode & 00004) ? S_IROTH : 0;
 	n->v_mode |= (mode & 00002) ? S_IWOTH : 0;
 	n->v_mode |= (mode & 00001) ? S_IXOTH : 0;
-	n->v_size = size;
-
-	off += sizeof(struct cpio_newc_header_t);
-	off += (((name_size + 1) & ~3) + 2);
-	n->v_data = (void *)((unsigned long)off);
+	n->v_size = cn->size;
+	n->v_data = (void *)cn;
 
 	return 0;
 }
@@ -424,7 +424,7 @@ int ext4fs_control_init(struct ext4fs_control_t * ctrl, struct block_t * bdev)
 {
 	int rc;
 	u64_t sb_read;
-	u32_t g, blkno, blkoff, desc_per_blk;
+	u32_t i, g, blkno, blkoff, desc_per_blk;
 
 	/* Save underlying block device pointer */
 	ctrl->bdev = bdev;
@@ -450,12 +450,20 @@ int ext4fs_control_init(struct ext4fs_control_t * ctrl, struct block_t * bdev)
 		goto fail;
 	}
 
-	/* Directory indexing not supported so throw warning */
-	if(le32_to_cpu(ctrl->sblock.feature_compatibility) &
-	EXT2_FEAT_COMPAT_DIR_INDEX)
+	/* Directory indexing is used for lookups only */
+	ctrl->dx_enabled = (le32_to_cpu(ctrl->sblock.feature_compatibility) &
+	EXT2_FEAT_COMPAT_DIR_INDEX) ? TRUE : FALSE;
+	ctrl->dx_unsigned = (le32_to_cpu(ctrl->sblock.flags) &
+	EXT2_FLAGS_UNSIGNED_HASH) ? TRUE : FALSE;
+	for(i = 0; i < 4; i++)
 	{
-		LOG("ext4: directory indexing is not available");
+		ctrl->dx_seed[i] = le32_to_cpu(ctrl->sblock.hash_seed[i]);
 	}
+	ctrl->lookup_count = 0;
+	ctrl->lookup_hits = 0;
+	ctrl->lookup_htree = 0;
+	ctrl->lookup_scans = 0;
+	ctrl->lookup_blocks = 0;
 
 	/* Pre-compute frequently required values */
 	ctrl->log2_block_size = le32_to_cpu((ctrl)->sblock.log2_block_size) + 1;
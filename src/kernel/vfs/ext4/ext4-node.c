@@ -215,6 +215,168 @@ int ext4fs_node_sync(struct ext4fs_node_t * node)
 	return 0;
 }
 
+static int ext4fs_node_extent_add(struct ext4fs_node_t * node, u32_t lblk, u32_t pblk, u32_t len)
+{
+	struct ext4fs_extent_t * e;
+	u32_t size;
+
+	if(node->extent_count >= node->extent_size)
+	{
+		size = node->extent_size ? node->extent_size * 2 : 8;
+		e = realloc(node->extents, size * sizeof(struct ext4fs_extent_t));
+		if(!e)
+		{
+			return -1;
+		}
+		node->extents = e;
+		node->extent_size = size;
+	}
+
+	e = &node->extents[node->extent_count++];
+	e->lblk = lblk;
+	e->pblk = pblk;
+	e->len = len;
+
+	return 0;
+}
+
+static int ext4fs_node_extent_walk(struct ext4fs_node_t * node, struct ext4_extent_header_t * eh, u32_t size, u32_t depth)
+{
+	struct ext4fs_control_t *ctrl = node->ctrl;
+	struct ext4_extent_idx_t * ei;
+	struct ext4_extent_t * ex;
+	u32_t i, n, len, pblk;
+	char * blk;
+	int rc = 0;
+
+	/* Extent flags are only valid on filesystems with the feature */
+	if(!(le32_to_cpu(ctrl->sblock.feature_incompat) & EXT4_FEAT_INCOMPAT_EXTENTS) || (depth > EXT4_EXT_MAX_DEPTH))
+	{
+		return -1;
+	}
+
+	n = le16_to_cpu(eh->entries);
+	if((le16_to_cpu(eh->magic) != EXT4_EXT_MAGIC) || (le16_to_cpu(eh->depth) != depth) ||
+		(sizeof(struct ext4_extent_header_t) + n * sizeof(struct ext4_extent_t) > size))
+	{
+		return -1;
+	}
+
+	if(depth == 0)
+	{
+		/* Leaf entries, already sorted by logical block */
+		ex = (struct ext4_extent_t *)(eh + 1);
+		for(i = 0; i < n; i++)
+		{
+			if(ex[i].start_hi)
+			{
+				return -1;
+			}
+			len = le16_to_cpu(ex[i].len);
+			pblk = le32_to_cpu(ex[i].start_lo);
+			if(len > EXT4_EXT_INIT_MAX_LEN)
+			{
+				len -= EXT4_EXT_INIT_MAX_LEN;
+				pblk = 0;
+			}
+			rc = ext4fs_node_extent_add(node, le32_to_cpu(ex[i].block), pblk, len);
+			if(rc)
+			{
+				return rc;
+			}
+		}
+		return 0;
+	}
+
+	blk = malloc(ctrl->block_size);
+	if(!blk)
+	{
+		return -1;
+	}
+	ei = (struct ext4_extent_idx_t *)(eh + 1);
+	for(i = 0; i < n; i++)
+	{
+		if(ei[i].leaf_hi)
+		{
+			rc = -1;
+			break;
+		}
+		rc = ext4fs_devread(ctrl, le32_to_cpu(ei[i].leaf_lo), 0, ctrl->block_size, blk);
+		if(rc)
+		{
+			break;
+		}
+		rc = ext4fs_node_extent_walk(node, (struct ext4_extent_header_t *)blk, ctrl->block_size, depth - 1);
+		if(rc)
+		{
+			break;
+		}
+	}
+	free(blk);
+
+	return rc;
+}
+
+/*
+ * Translate a logical block of an extent mapped inode. The whole tree is
+ * read once into a sorted array, so later lookups are a binary search.
+ * Holes and uninitialized extents map to block zero. The number of blocks
+ * that follow contiguously, with the same mapping, is returned in count.
+ */
+static int ext4fs_node_extent_map(struct ext4fs_node_t * node, u32_t blkpos, u32_t * blkno, u32_t * count)
+{
+	struct ext4fs_extent_t * e;
+	u32_t lo, hi, mid;
+	int rc;
+
+	if(!node->extent_loaded)
+	{
+		node->extent_count = 0;
+		rc = ext4fs_node_extent_walk(node, (struct ext4_extent_header_t *)&node->inode.b, sizeof(node->inode.b),
+			le16_to_cpu(((struct ext4_extent_header_t *)&node->inode.b)->depth));
+		if(rc)
+		{
+			return rc;
+		}
+		node->extent_loaded = TRUE;
+	}
+
+	lo = 0;
+	hi = node->extent_count;
+	while(lo < hi)
+	{
+		mid = (lo + hi) >> 1;
+		if(node->extents[mid].lblk <= blkpos)
+		{
+			lo = mid + 1;
+		}
+		else
+		{
+			hi = mid;
+		}
+	}
+
+	if(lo > 0 && blkpos - node->extents[lo - 1].lblk < node->extents[lo - 1].len)
+	{
+		e = &node->extents[lo - 1];
+		*blkno = e->pblk ? e->pblk + (blkpos - e->lblk) : 0;
+		if(count)
+		{
+			*count = e->len - (blkpos - e->lblk);
+		}
+	}
+	else
+	{
+		*blkno = 0;
+		if(count)
+		{
+			*count = (lo < node->extent_count) ? node->extents[lo].lblk - blkpos : ~blkpos;
+		}
+	}
+
+	return 0;
+}
+
 int ext4fs_node_read_blkno(struct ext4fs_node_t * node, u32_t blkpos, u32_t *blkno)
 {
 	int rc;
@@ -222,6 +384,11 @@ int ext4fs_node_read_blkno(struct ext4fs_node_t * node, u32_t blkpos, u32_t *blk
 	struct ext2_inode_t *inode = &node->inode;
 	struct ext4fs_control_t *ctrl = node->ctrl;
 
+	if(le32_to_cpu(inode->flags) & EXT4_EXTENTS_FL)
+	{
+		return ext4fs_node_extent_map(node, blkpos, blkno, NULL);
+	}
+
 	if(blkpos < ctrl->dir_blklast)
 	{
 		/* Direct blocks.  */
@@ -317,6 +484,12 @@ int ext4fs_node_write_blkno(struct ext4fs_node_t * node, u32_t blkpos, u32_t blk
 	struct ext2_inode_t *inode = &node->inode;
 	struct ext4fs_control_t *ctrl = node->ctrl;
 
+	/* Changing the extent tree is not supported */
+	if(le32_to_cpu(inode->flags) & EXT4_EXTENTS_FL)
+	{
+		return -1;
+	}
+
 	if(blkpos < ctrl->dir_blklast)
 	{
 		/* Direct blocks.  */
@@ -422,14 +595,53 @@ int ext4fs_node_write_blkno(struct ext4fs_node_t * node, u32_t blkpos, u32_t blk
 	return 0;
 }
 
+/*
+ * Map blkpos and count how many of the following blocks, up to max, are
+ * contiguous on disk, or all holes when blkno is zero.
+ */
+static int ext4fs_node_map_blocks(struct ext4fs_node_t * node, u32_t blkpos, u32_t max, u32_t * blkno, u32_t * count)
+{
+	int rc;
+	u32_t n, next;
+
+	if(le32_to_cpu(node->inode.flags) & EXT4_EXTENTS_FL)
+	{
+		rc = ext4fs_node_extent_map(node, blkpos, blkno, &n);
+		if(rc)
+		{
+			return rc;
+		}
+		*count = (n < max) ? n : max;
+		return 0;
+	}
+
+	rc = ext4fs_node_read_blkno(node, blkpos, blkno);
+	if(rc)
+	{
+		return rc;
+	}
+	for(n = 1; n < max; n++)
+	{
+		if(ext4fs_node_read_blkno(node, blkpos + n, &next))
+		{
+			break;
+		}
+		if(next != (*blkno ? *blkno + n : 0))
+		{
+			break;
+		}
+	}
+	*count = n;
+
+	return 0;
+}
+
 /* Note: Node position has to be 64-bit */
 u32_t ext4fs_node_read(struct ext4fs_node_t * node, u64_t pos, u32_t len, char * buf)
 {
 	int rc;
 	u64_t filesize = ext4fs_node_get_size(node);
-	u32_t i, rlen, blkno, blkoff, blklen;
-	u32_t last_blkpos, last_blklen;
-	u32_t first_blkpos, first_blkoff, first_blklen;
+	u32_t n, rlen, blkpos, blkno, blkoff, blklen;
 	struct ext4fs_control_t *ctrl = node->ctrl;
 
 	if(filesize <= pos)
@@ -442,57 +654,69 @@ u32_t ext4fs_node_read(struct ext4fs_node_t * node, u64_t pos, u32_t len, char *
 	}
 
 	/* Note: div result < 32-bit */
-	first_blkpos = udiv64(pos, ctrl->block_size);
-	first_blkoff = pos - (first_blkpos * ctrl->block_size);
-	first_blklen = ctrl->block_size - first_blkoff;
-	if(len < first_blklen)
-	{
-		first_blklen = len;
-	}
-
-	/* Note: div result < 32-bit */
-	last_blkpos = udiv64((len + pos), ctrl->block_size);
-	last_blklen = (len + pos) - (last_blkpos * ctrl->block_size);
+	blkpos = udiv64(pos, ctrl->block_size);
+	blkoff = pos - ((u64_t)blkpos * ctrl->block_size);
 
 	rlen = len;
-	i = first_blkpos;
 	while(rlen)
 	{
-		rc = ext4fs_node_read_blkno(node, i, &blkno);
-		if(rc)
+		if((blkoff == 0) && (rlen >= ctrl->block_size))
 		{
-			goto done;
-		}
+			/* Whole blocks, read each contiguous run straight into the buffer */
+			rc = ext4fs_node_map_blocks(node, blkpos, rlen >> (ctrl->log2_block_size + EXT2_SECTOR_BITS), &blkno, &n);
+			if(rc)
+			{
+				goto done;
+			}
+			blklen = n << (ctrl->log2_block_size + EXT2_SECTOR_BITS);
 
-		if(i == first_blkpos)
-		{
-			/* First block.  */
-			blkoff = first_blkoff;
-			blklen = first_blklen;
-		}
-		else if(i == last_blkpos)
-		{
-			/* Last block.  */
-			blkoff = 0;
-			blklen = last_blklen;
+			if(!blkno)
+			{
+				memset(buf, 0, blklen);
+			}
+			else
+			{
+				if(node->cached_dirty && (node->cached_blkno >= blkno) && (node->cached_blkno - blkno < n))
+				{
+					rc = ext4fs_devwrite(ctrl, node->cached_blkno, 0, ctrl->block_size, (char *)node->cached_block);
+					if(rc)
+					{
+						goto done;
+					}
+					node->cached_dirty = FALSE;
+				}
+				rc = ext4fs_devread(ctrl, blkno, 0, blklen, buf);
+				if(rc)
+				{
+					goto done;
+				}
+			}
 		}
 		else
 		{
-			/* Middle block. */
-			blkoff = 0;
-			blklen = ctrl->block_size;
-		}
-
-		/* Read cached block */
-		rc = ext4fs_node_read_blk(node, blkno, blkoff, blklen, buf);
-		if(rc)
-		{
-			goto done;
+			/* Partial block, go through the cached block */
+			rc = ext4fs_node_read_blkno(node, blkpos, &blkno);
+			if(rc)
+			{
+				goto done;
+			}
+			n = 1;
+			blklen = ctrl->block_size - blkoff;
+			if(rlen < blklen)
+			{
+				blklen = rlen;
+			}
+			rc = ext4fs_node_read_blk(node, blkno, blkoff, blklen, buf);
+			if(rc)
+			{
+				goto done;
+			}
 		}
 
 		buf += blklen;
 		rlen -= blklen;
-		i++;
+		blkpos += n;
+		blkoff = 0;
 	}
 
 	done: return len - rlen;
@@ -526,6 +750,12 @@ u32_t ext4fs_node_write(struct ext4fs_node_t * node, u64_t pos, u32_t len, char
 
 		if(!blkno)
 		{
+			/* Blocks can not be added to extent mapped inodes */
+			if(le32_to_cpu(node->inode.flags) & EXT4_EXTENTS_FL)
+			{
+				goto done;
+			}
+
 			rc = ext4fs_control_alloc_block(ctrl, node->inode_no, &blkno);
 			if(rc)
 			{
@@ -598,6 +828,12 @@ int ext4fs_node_truncate(struct ext4fs_node_t * node, u64_t pos)
 		return 0;
 	}
 
+	/* Changing the extent tree is not supported */
+	if(le32_to_cpu(node->inode.flags) & EXT4_EXTENTS_FL)
+	{
+		return -1;
+	}
+
 	/* Note: div result < 32-bit */
 	first_blkpos = udiv64(pos, ctrl->block_size);
 	first_blkoff = pos - (first_blkpos * ctrl->block_size);
@@ -658,6 +894,27 @@ int ext4fs_node_truncate(struct ext4fs_node_t * node, u64_t pos)
 	return 0;
 }
 
+static void ext4fs_node_free_dindex(struct ext4fs_node_t * dnode)
+{
+	struct ext4fs_dindex_t * pos;
+	struct hlist_node * n;
+	u32_t i;
+
+	if(dnode->dindex)
+	{
+		for(i = 0; i < dnode->dindex_size; i++)
+		{
+			hlist_for_each_entry_safe(pos, n, &dnode->dindex[i], node)
+			{
+				free(pos);
+			}
+		}
+		free(dnode->dindex);
+		dnode->dindex = NULL;
+		dnode->dindex_size = 0;
+	}
+}
+
 int ext4fs_node_load(struct ext4fs_control_t * ctrl, u32_t inode_no, struct ext4fs_node_t * node)
 {
 	int rc;
@@ -688,6 +945,9 @@ int ext4fs_node_load(struct ext4fs_control_t * ctrl, u32_t inode_no, struct ext4
 	node->dindir2_blkno = 0;
 	node->dindir2_dirty = FALSE;
 
+	node->extent_count = 0;
+	node->extent_loaded = FALSE;
+
 	return 0;
 }
 
@@ -714,6 +974,14 @@ int ext4fs_node_init(struct ext4fs_node_t * node)
 	node->dindir2_blkno = 0;
 	node->dindir2_dirty = FALSE;
 
+	node->extents = NULL;
+	node->extent_count = 0;
+	node->extent_size = 0;
+	node->extent_loaded = FALSE;
+
+	node->dindex = NULL;
+	node->dindex_size = 0;
+
 	node->lookup_victim = 0;
 	for(idx = 0; idx < EXT4_NODE_LOOKUP_SIZE; idx++)
 	{
@@ -745,6 +1013,487 @@ int ext4fs_node_exit(struct ext4fs_node_t * node)
 		free(node->dindir2_block);
 	}
 
+	if(node->extents)
+	{
+		free(node->extents);
+	}
+
+	ext4fs_node_free_dindex(node);
+
+	return 0;
+}
+
+/*
+ * Directory hashes of the htree index, as computed by linux
+ */
+#define EXT2_DX_ROL32(x, s)		(((x) << (s)) | ((x) >> (32 - (s))))
+#define EXT2_DX_F(x, y, z)		((z) ^ ((x) & ((y) ^ (z))))
+#define EXT2_DX_G(x, y, z)		(((x) & (y)) + (((x) ^ (y)) & (z)))
+#define EXT2_DX_H(x, y, z)		((x) ^ (y) ^ (z))
+#define EXT2_DX_ROUND(f, a, b, c, d, x, s)	(a += f(b, c, d) + x, a = EXT2_DX_ROL32(a, s))
+#define EXT2_DX_K2				(013240474631UL)
+#define EXT2_DX_K3				(015666365641UL)
+#define EXT2_DX_TEA_DELTA		(0x9E3779B9)
+#define EXT2_DX_HTREE_EOF		(0x7FFFFFFF)
+
+static void ext4fs_dx_half_md4(u32_t * buf, const u32_t * in)
+{
+	u32_t a = buf[0], b = buf[1], c = buf[2], d = buf[3];
+
+	EXT2_DX_ROUND(EXT2_DX_F, a, b, c, d, in[0], 3);
+	EXT2_DX_ROUND(EXT2_DX_F, d, a, b, c, in[1], 7);
+	EXT2_DX_ROUND(EXT2_DX_F, c, d, a, b, in[2], 11);
+	EXT2_DX_ROUND(EXT2_DX_F, b, c, d, a, in[3], 19);
+	EXT2_DX_ROUND(EXT2_DX_F, a, b, c, d, in[4], 3);
+	EXT2_DX_ROUND(EXT2_DX_F, d, a, b, c, in[5], 7);
+	EXT2_DX_ROUND(EXT2_DX_F, c, d, a, b, in[6], 11);
+	EXT2_DX_ROUND(EXT2_DX_F, b, c, d, a, in[7], 19);
+
+	EXT2_DX_ROUND(EXT2_DX_G, a, b, c, d, in[1] + EXT2_DX_K2, 3);
+	EXT2_DX_ROUND(EXT2_DX_G, d, a, b, c, in[3] + EXT2_DX_K2, 5);
+	EXT2_DX_ROUND(EXT2_DX_G, c, d, a, b, in[5] + EXT2_DX_K2, 9);
+	EXT2_DX_ROUND(EXT2_DX_G, b, c, d, a, in[7] + EXT2_DX_K2, 13);
+	EXT2_DX_ROUND(EXT2_DX_G, a, b, c, d, in[0] + EXT2_DX_K2, 3);
+	EXT2_DX_ROUND(EXT2_DX_G, d, a, b, c, in[2] + EXT2_DX_K2, 5);
+	EXT2_DX_ROUND(EXT2_DX_G, c, d, a, b, in[4] + EXT2_DX_K2, 9);
+	EXT2_DX_ROUND(EXT2_DX_G, b, c, d, a, in[6] + EXT2_DX_K2, 13);
+
+	EXT2_DX_ROUND(EXT2_DX_H, a, b, c, d, in[3] + EXT2_DX_K3, 3);
+	EXT2_DX_ROUND(EXT2_DX_H, d, a, b, c, in[7] + EXT2_DX_K3, 9);
+	EXT2_DX_ROUND(EXT2_DX_H, c, d, a, b, in[2] + EXT2_DX_K3, 11);
+	EXT2_DX_ROUND(EXT2_DX_H, b, c, d, a, in[6] + EXT2_DX_K3, 15);
+	EXT2_DX_ROUND(EXT2_DX_H, a, b, c, d, in[1] + EXT2_DX_K3, 3);
+	EXT2_DX_ROUND(EXT2_DX_H, d, a, b, c, in[5] + EXT2_DX_K3, 9);
+	EXT2_DX_ROUND(EXT2_DX_H, c, d, a, b, in[0] + EXT2_DX_K3, 11);
+	EXT2_DX_ROUND(EXT2_DX_H, b, c, d, a, in[4] + EXT2_DX_K3, 15);
+
+	buf[0] += a;
+	buf[1] += b;
+	buf[2] += c;
+	buf[3] += d;
+}
+
+static void ext4fs_dx_tea(u32_t * buf, const u32_t * in)
+{
+	u32_t sum = 0;
+	u32_t b0 = buf[0], b1 = buf[1];
+	u32_t a = in[0], b = in[1], c = in[2], d = in[3];
+	int n;
+
+	for(n = 0; n < 16; n++)
+	{
+		sum += EXT2_DX_TEA_DELTA;
+		b0 += ((b1 << 4) + a) ^ (b1 + sum) ^ ((b1 >> 5) + b);
+		b1 += ((b0 << 4) + c) ^ (b0 + sum) ^ ((b0 >> 5) + d);
+	}
+
+	buf[0] += b0;
+	buf[1] += b1;
+}
+
+static u32_t ext4fs_dx_legacy(const char * name, int len, bool_t unsig)
+{
+	u32_t hash, hash0 = 0x12A3FE2D, hash1 = 0x37ABE8F9;
+	int c;
+
+	while(len--)
+	{
+		c = unsig ? (int)*(const unsigned char *)name : (int)*(const signed char *)name;
+		name++;
+		hash = hash1 + (hash0 ^ (c * 7152373));
+		if(hash & 0x80000000)
+		{
+			hash -= 0x7FFFFFFF;
+		}
+		hash1 = hash0;
+		hash0 = hash;
+	}
+
+	return hash0 << 1;
+}
+
+static void ext4fs_dx_str2hashbuf(const char * name, int len, u32_t * buf, int num, bool_t unsig)
+{
+	u32_t pad, val;
+	int i, c;
+
+	pad = (u32_t)len | ((u32_t)len << 8);
+	pad |= pad << 16;
+	val = pad;
+	if(len > num * 4)
+	{
+		len = num * 4;
+	}
+
+	for(i = 0; i < len; i++)
+	{
+		c = unsig ? (int)((const unsigned char *)name)[i] : (int)((const signed char *)name)[i];
+		val = c + (val << 8);
+		if((i % 4) == 3)
+		{
+			*buf++ = val;
+			val = pad;
+			num--;
+		}
+	}
+
+	if(--num >= 0)
+	{
+		*buf++ = val;
+	}
+	while(--num >= 0)
+	{
+		*buf++ = pad;
+	}
+}
+
+static u32_t ext4fs_dx_hash(struct ext4fs_control_t * ctrl, const char * name, int len, u32_t version)
+{
+	u32_t buf[4], in[8];
+	u32_t hash;
+	bool_t unsig;
+
+	/* An all zero seed means the default one */
+	if(ctrl->dx_seed[0] || ctrl->dx_seed[1] || ctrl->dx_seed[2] || ctrl->dx_seed[3])
+	{
+		memcpy(buf, ctrl->dx_seed, sizeof(buf));
+	}
+	else
+	{
+		buf[0] = 0x67452301;
+		buf[1] = 0xEFCDAB89;
+		buf[2] = 0x98BADCFE;
+		buf[3] = 0x10325476;
+	}
+
+	unsig = (version >= EXT2_HASH_LEGACY_UNSIGNED) ? TRUE : FALSE;
+	switch(version)
+	{
+	case EXT2_HASH_HALF_MD4:
+	case EXT2_HASH_HALF_MD4_UNSIGNED:
+		for(; len > 0; len -= 32, name += 32)
+		{
+			ext4fs_dx_str2hashbuf(name, len, in, 8, unsig);
+			ext4fs_dx_half_md4(buf, in);
+		}
+		hash = buf[1];
+		break;
+	case EXT2_HASH_TEA:
+	case EXT2_HASH_TEA_UNSIGNED:
+		for(; len > 0; len -= 16, name += 16)
+		{
+			ext4fs_dx_str2hashbuf(name, len, in, 4, unsig);
+			ext4fs_dx_tea(buf, in);
+		}
+		hash = buf[0];
+		break;
+	default:
+		hash = ext4fs_dx_legacy(name, len, unsig);
+		break;
+	}
+
+	/* The lowest bit marks hash collisions in index entries */
+	hash &= ~1;
+	if(hash == (EXT2_DX_HTREE_EOF << 1))
+	{
+		hash = (EXT2_DX_HTREE_EOF - 1) << 1;
+	}
+
+	return hash;
+}
+
+static int ext4fs_node_read_dirblk(struct ext4fs_node_t * dnode, u32_t blkpos, u32_t len, u8_t * buf)
+{
+	struct ext4fs_control_t * ctrl = dnode->ctrl;
+
+	ctrl->lookup_blocks++;
+	if(ext4fs_node_read(dnode, (u64_t)blkpos * ctrl->block_size, len, (char *)buf) != len)
+	{
+		return -1;
+	}
+
+	return 0;
+}
+
+static int ext4fs_node_alloc_dindex(struct ext4fs_node_t * dnode, u64_t filesize)
+{
+	u32_t i, size = 16;
+
+	/* About one bucket for every 64 bytes of directory */
+	while((size < 4096) && ((u64_t)size * 64 < filesize))
+	{
+		size <<= 1;
+	}
+
+	dnode->dindex = malloc(sizeof(struct hlist_head) * size);
+	if(!dnode->dindex)
+	{
+		return -1;
+	}
+	for(i = 0; i < size; i++)
+	{
+		init_hlist_head(&dnode->dindex[i]);
+	}
+	dnode->dindex_size = size;
+
+	return 0;
+}
+
+static struct ext4fs_dindex_t * ext4fs_node_search_dindex(struct ext4fs_node_t * dnode, const char * name)
+{
+	struct ext4fs_dindex_t * pos;
+	struct hlist_node * n;
+
+	hlist_for_each_entry_safe(pos, n, &dnode->dindex[shash(name) & (dnode->dindex_size - 1)], node)
+	{
+		if(strcmp(pos->name, name) == 0)
+		{
+			return pos;
+		}
+	}
+
+	return NULL;
+}
+
+static void ext4fs_node_add_dindex(struct ext4fs_node_t * dnode, const char * name, struct ext2_dirent_t * dent)
+{
+	struct ext4fs_dindex_t * e;
+	u32_t len;
+
+	if(!dnode->dindex || ext4fs_node_search_dindex(dnode, name))
+	{
+		return;
+	}
+
+	len = strlen(name);
+	e = malloc(sizeof(struct ext4fs_dindex_t) + len + 1);
+	if(!e)
+	{
+		/* A partial index would report missing entries */
+		ext4fs_node_free_dindex(dnode);
+		return;
+	}
+
+	memcpy(&e->dent, dent, sizeof(e->dent));
+	e->name = (char *)(e + 1);
+	memcpy(e->name, name, len + 1);
+	init_hlist_node(&e->node);
+	hlist_add_head(&e->node, &dnode->dindex[shash(e->name) & (dnode->dindex_size - 1)]);
+}
+
+static void ext4fs_node_del_dindex(struct ext4fs_node_t * dnode, const char * name)
+{
+	struct ext4fs_dindex_t * e;
+
+	if(dnode->dindex)
+	{
+		e = ext4fs_node_search_dindex(dnode, name);
+		if(e)
+		{
+			hlist_del(&e->node);
+			free(e);
+		}
+	}
+}
+
+/*
+ * Search one directory block for name, adding every entry seen to the
+ * directory index when it is being built. Returns 1 when found, 0 when
+ * not found and -1 for a corrupted block.
+ */
+static int ext4fs_node_scan_dirblk(struct ext4fs_node_t * dnode, u8_t * buf, u32_t len, const char * name, struct ext2_dirent_t * dent)
+{
+	struct ext2_dirent_t * d;
+	char filename[VFS_MAX_NAME];
+	u32_t off, direntlen, namelen = strlen(name);
+	int found = 0;
+
+	for(off = 0; off + sizeof(struct ext2_dirent_t) <= len; off += direntlen)
+	{
+		d = (struct ext2_dirent_t *)(buf + off);
+		direntlen = le16_to_cpu(d->direntlen);
+		if((direntlen < sizeof(struct ext2_dirent_t)) || (off + direntlen > len) ||
+			(sizeof(struct ext2_dirent_t) + d->namelen > direntlen))
+		{
+			return -1;
+		}
+
+		/* Skip unused entries */
+		if(d->inode == 0)
+		{
+			continue;
+		}
+
+		if(!found && (d->namelen == namelen) && !memcmp(buf + off + sizeof(struct ext2_dirent_t), name, namelen))
+		{
+			memcpy(dent, d, sizeof(struct ext2_dirent_t));
+			found = 1;
+			if(!dnode->dindex)
+			{
+				break;
+			}
+		}
+
+		if(dnode->dindex && (d->namelen < VFS_MAX_NAME))
+		{
+			memcpy(filename, buf + off + sizeof(struct ext2_dirent_t), d->namelen);
+			filename[d->namelen] = '\0';
+			if((strcmp(filename, ".") != 0) && (strcmp(filename, "..") != 0))
+			{
+				ext4fs_node_add_dindex(dnode, filename, d);
+			}
+		}
+	}
+
+	return found;
+}
+
+static struct ext2_dx_entry_t * ext4fs_node_dx_entries(struct ext4fs_node_t * dnode, u8_t * buf, u32_t offset, u32_t * count)
+{
+	struct ext2_dx_countlimit_t * cl = (struct ext2_dx_countlimit_t *)(buf + offset);
+	u32_t limit = le16_to_cpu(cl->limit);
+
+	*count = le16_to_cpu(cl->count);
+	if((*count == 0) || (*count > limit) ||
+		(offset + limit * sizeof(struct ext2_dx_entry_t) > dnode->ctrl->block_size))
+	{
+		return NULL;
+	}
+
+	return (struct ext2_dx_entry_t *)buf + offset / sizeof(struct ext2_dx_entry_t);
+}
+
+/*
+ * Look name up through the htree index of a directory. Returns 1 when
+ * found, 0 when not found and -1 when the index can not be used.
+ */
+static int ext4fs_node_dx_find_dirent(struct ext4fs_node_t * dnode, const char * name, struct ext2_dirent_t * dent, u8_t * buf)
+{
+	struct ext4fs_control_t * ctrl = dnode->ctrl;
+	struct ext2_dx_root_info_t * info;
+	struct ext2_dx_entry_t * entries;
+	u32_t blk[EXT2_DX_MAX_LEVELS], at[EXT2_DX_MAX_LEVELS], cnt[EXT2_DX_MAX_LEVELS], hnext[EXT2_DX_MAX_LEVELS];
+	u32_t levels, version, rootoff, hash, count, next, lo, hi, mid, l, top;
+	int rc;
+
+	if(ext4fs_node_get_size(dnode) < ctrl->block_size)
+	{
+		return -1;
+	}
+
+	/* Walk down to the leaf, keeping the path for hash collisions */
+	for(l = 0, levels = 1, blk[0] = 0; l < levels; l++)
+	{
+		if(ext4fs_node_read_dirblk(dnode, blk[l], ctrl->block_size, buf))
+		{
+			return -1;
+		}
+
+		if(l == 0)
+		{
+			/* The root info follows the "." and ".." entries */
+			info = (struct ext2_dx_root_info_t *)(buf + 24);
+			if((info->reserved_zero != 0) || (info->unused_flags & 0x1) ||
+				(info->info_length < sizeof(struct ext2_dx_root_info_t)) ||
+				(info->indirect_levels >= EXT2_DX_MAX_LEVELS))
+			{
+				return -1;
+			}
+			version = info->hash_version;
+			if((version <= EXT2_HASH_TEA) && ctrl->dx_unsigned)
+			{
+				version += EXT2_HASH_LEGACY_UNSIGNED;
+			}
+			if(version > EXT2_HASH_TEA_UNSIGNED)
+			{
+				return -1;
+			}
+			levels = info->indirect_levels + 1;
+			rootoff = 24 + info->info_length;
+			hash = ext4fs_dx_hash(ctrl, name, strlen(name), version);
+		}
+
+		entries = ext4fs_node_dx_entries(dnode, buf, (l == 0) ? rootoff : 8, &count);
+		if(!entries)
+		{
+			return -1;
+		}
+
+		/* Last entry whose hash is not above ours, the first one has none */
+		lo = 1;
+		hi = count - 1;
+		while(lo <= hi)
+		{
+			mid = (lo + hi) / 2;
+			if(le32_to_cpu(entries[mid].hash) > hash)
+			{
+				hi = mid - 1;
+			}
+			else
+			{
+				lo = mid + 1;
+			}
+		}
+		at[l] = lo - 1;
+		cnt[l] = count;
+		hnext[l] = (lo < count) ? le32_to_cpu(entries[lo].hash) : 0;
+		next = le32_to_cpu(entries[at[l]].block) & 0x0FFFFFFF;
+		if(l + 1 < levels)
+		{
+			blk[l + 1] = next;
+		}
+	}
+
+	while(1)
+	{
+		if(ext4fs_node_read_dirblk(dnode, next, ctrl->block_size, buf))
+		{
+			return -1;
+		}
+		rc = ext4fs_node_scan_dirblk(dnode, buf, ctrl->block_size, name, dent);
+		if(rc != 0)
+		{
+			return rc;
+		}
+
+		/* Go on with the next leaf only if it continues our hash */
+		for(l = levels; l > 0; l--)
+		{
+			if(at[l - 1] + 1 < cnt[l - 1])
+			{
+				break;
+			}
+		}
+		if((l == 0) || ((hnext[l - 1] & ~1) != hash))
+		{
+			return 0;
+		}
+		for(top = --l; l < levels; l++)
+		{
+			if(ext4fs_node_read_dirblk(dnode, blk[l], ctrl->block_size, buf))
+			{
+				return -1;
+			}
+			entries = ext4fs_node_dx_entries(dnode, buf, (l == 0) ? rootoff : 8, &count);
+			if(!entries)
+			{
+				return -1;
+			}
+			at[l] = (l == top) ? at[l] + 1 : 0;
+			if(at[l] >= count)
+			{
+				return -1;
+			}
+			cnt[l] = count;
+			hnext[l] = (at[l] + 1 < count) ? le32_to_cpu(entries[at[l] + 1].hash) : 0;
+			next = le32_to_cpu(entries[at[l]].block) & 0x0FFFFFFF;
+			if(l + 1 < levels)
+			{
+				blk[l + 1] = next;
+			}
+		}
+	}
+
 	return 0;
 }
 
@@ -862,7 +1611,7 @@ int ext4fs_node_read_dirent(struct ext4fs_node_t * dnode, s64_t off, struct vfs_
 		d->d_reclen += le16_to_cpu(dent.direntlen);
 		fileoff += le16_to_cpu(dent.direntlen);
 
-		if((strcmp(d->d_name, ".") == 0) || (strcmp(d->d_name, "..") == 0))
+		if((dent.inode == 0) || (strcmp(d->d_name, ".") == 0) || (strcmp(d->d_name, "..") == 0))
 		{
 			continue;
 		}
@@ -908,62 +1657,115 @@ int ext4fs_node_read_dirent(struct ext4fs_node_t * dnode, s64_t off, struct vfs_
 	return 0;
 }
 
-int ext4fs_node_find_dirent(struct ext4fs_node_t * dnode, const char * name, struct ext2_dirent_t * dent)
+/*
+ * Scan every block of a directory for name. Returns 1 when found, 0 when
+ * not found and -1 on error. Directories of more than one block get their
+ * index built on the way, so this happens once per directory.
+ */
+static int ext4fs_node_scan_find_dirent(struct ext4fs_node_t * dnode, const char * name, struct ext2_dirent_t * dent, u8_t * buf)
 {
-	bool_t found;
-	u32_t rlen;
-	char filename[VFS_MAX_NAME];
+	struct ext4fs_control_t * ctrl = dnode->ctrl;
 	u64_t off, filesize = ext4fs_node_get_size(dnode);
+	u32_t blkpos, len;
+	int rc, found = 0;
 
-	/* Try to find in lookup table */
-	if(ext4fs_node_find_lookup_dirent(dnode, name, dent) > -1)
+	if(!dnode->dindex && (filesize > ctrl->block_size))
 	{
-		return 0;
+		ext4fs_node_alloc_dindex(dnode, filesize);
 	}
 
-	/* Find desired directoy entry such that we ignore
-	 * "." and ".." in search process
-	 */
-	off = 0;
-	found = FALSE;
-	while(off < filesize)
+	for(blkpos = 0, off = 0; off < filesize; blkpos++, off += ctrl->block_size)
 	{
-		rlen = ext4fs_node_read(dnode, off, sizeof(struct ext2_dirent_t), (char *)dent);
-		if(rlen != sizeof(struct ext2_dirent_t))
-		{
-			return -1;
-		}
-
-		if(dent->namelen > (VFS_MAX_NAME - 1))
+		len = (filesize - off < ctrl->block_size) ? (u32_t)(filesize - off) : ctrl->block_size;
+		rc = ext4fs_node_read_dirblk(dnode, blkpos, len, buf);
+		if(rc == 0)
 		{
-			dent->namelen = (VFS_MAX_NAME - 1);
+			rc = ext4fs_node_scan_dirblk(dnode, buf, len, name, dent);
 		}
-		rlen = ext4fs_node_read(dnode, off + sizeof(struct ext2_dirent_t), dent->namelen, filename);
-		if(rlen != dent->namelen)
+		if(rc < 0)
 		{
+			ext4fs_node_free_dindex(dnode);
 			return -1;
 		}
-		filename[dent->namelen] = '\0';
-
-		if((strcmp(filename, ".") != 0) && (strcmp(filename, "..") != 0))
+		if(rc > 0)
 		{
-			if(strcmp(filename, name) == 0)
+			found = 1;
+			if(!dnode->dindex)
 			{
-				found = TRUE;
 				break;
 			}
 		}
+	}
 
-		off += le16_to_cpu(dent->direntlen);
+	return found;
+}
+
+int ext4fs_node_find_dirent(struct ext4fs_node_t * dnode, const char * name, struct ext2_dirent_t * dent)
+{
+	struct ext4fs_control_t * ctrl = dnode->ctrl;
+	struct ext4fs_dindex_t * e;
+	u8_t * buf;
+	int rc;
+
+	ctrl->lookup_count++;
+
+	/* Try to find in lookup table */
+	if(ext4fs_node_find_lookup_dirent(dnode, name, dent) > -1)
+	{
+		ctrl->lookup_hits++;
+		return 0;
 	}
 
-	if(!found)
+	/* Try to find in directory index, which holds every entry */
+	if(dnode->dindex)
+	{
+		ctrl->lookup_hits++;
+		e = ext4fs_node_search_dindex(dnode, name);
+		if(!e)
+		{
+			return -1;
+		}
+		memcpy(dent, &e->dent, sizeof(*dent));
+		goto done;
+	}
+
+	/* Ignore "." and ".." in search process */
+	if((name[0] == '\0') || (strcmp(name, ".") == 0) || (strcmp(name, "..") == 0))
 	{
 		return -1;
 	}
 
+	buf = malloc(ctrl->block_size);
+	if(!buf)
+	{
+		return -1;
+	}
+
+	/* Walk the htree of indexed directories, scan all others */
+	rc = -1;
+	if(ctrl->dx_enabled && (le32_to_cpu(dnode->inode.flags) & EXT2_INDEX_FL))
+	{
+		rc = ext4fs_node_dx_find_dirent(dnode, name, dent, buf);
+		if(rc >= 0)
+		{
+			ctrl->lookup_htree++;
+		}
+	}
+	if(rc < 0)
+	{
+		ctrl->lookup_scans++;
+		rc = ext4fs_node_scan_find_dirent(dnode, name, dent, buf);
+	}
+	free(buf);
+
+	if(rc <= 0)
+	{
+		return -1;
+	}
+
+done:
 	/* Add dent to lookup table */
-	ext4fs_node_add_lookup_dirent(dnode, filename, dent);
+	ext4fs_node_add_lookup_dirent(dnode, name, dent);
 
 	return 0;
 }
@@ -984,6 +1786,13 @@ int ext4fs_node_add_dirent(struct ext4fs_node_t * dnode, const char * name, u32_
 		return -1;
 	}
 
+	/* Entries are added without updating the htree, so stop using it */
+	if(le32_to_cpu(dnode->inode.flags) & EXT2_INDEX_FL)
+	{
+		dnode->inode.flags = le32_to_cpu(le32_to_cpu(dnode->inode.flags) & ~EXT2_INDEX_FL);
+		dnode->inode_dirty = TRUE;
+	}
+
 	/* Compute size of directory entry required */
 	direntlen = sizeof(struct ext2_dirent_t) + strlen(name);
 
@@ -1076,6 +1885,9 @@ int ext4fs_node_add_dirent(struct ext4fs_node_t * dnode, const char * name, u32_
 		return -1;
 	}
 
+	/* Add dent to directory index */
+	ext4fs_node_add_dindex(dnode, filename, &dent);
+
 	/* Increment nlinks field of inode */
 	dnode->inode.nlinks = le16_to_cpu(le16_to_cpu(dnode->inode.nlinks) + 1);
 	dnode->inode_dirty = TRUE;
@@ -1099,6 +1911,7 @@ int ext4fs_node_del_dirent(struct ext4fs_node_t * dnode, const char * name)
 
 	/* Delete dent from lookup table */
 	ext4fs_node_del_lookup_dirent(dnode, name);
+	ext4fs_node_del_dindex(dnode, name);
 
 	/* Initialize perivous entry and previous offset */
 	poff = 0;
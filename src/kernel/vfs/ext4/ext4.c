@@ -30,12 +30,26 @@
 #include <vfs/ext4/ext4-node.h>
 #include <vfs/ext4/ext4.h>
 
+static ssize_t ext4fs_read_lookupstat(struct kobj_t * kobj, void * buf, size_t size)
+{
+	struct ext4fs_control_t * ctrl = (struct ext4fs_control_t *)kobj->priv;
+	int len = 0;
+
+	len += sprintf((char *)buf + len, "lookup: %lld\r\n", ctrl->lookup_count);
+	len += sprintf((char *)buf + len, "hit: %lld\r\n", ctrl->lookup_hits);
+	len += sprintf((char *)buf + len, "htree: %lld\r\n", ctrl->lookup_htree);
+	len += sprintf((char *)buf + len, "scan: %lld\r\n", ctrl->lookup_scans);
+	len += sprintf((char *)buf + len, "block: %lld\r\n", ctrl->lookup_blocks);
+	return len;
+}
+
 int ext4fs_mount(struct vfs_mount_t * m, const char * dev)
 {
 	int rc;
 	u16_t rootmode;
 	struct ext4fs_control_t *ctrl;
 	struct ext4fs_node_t *root;
+	struct filesystem_t *fs;
 
 	if(dev == NULL)
 		return -1;
@@ -121,6 +135,12 @@ int ext4fs_mount(struct vfs_mount_t * m, const char * dev)
 
 	m->m_root->v_size = ext4fs_node_get_size(root);
 
+	/* Export lookup statistics of this mount */
+	fs = search_filesystem("ext4");
+	ctrl->kobj = kobj_alloc_directory(ctrl->bdev->name);
+	kobj_add_regular(ctrl->kobj, "lookupstat", ext4fs_read_lookupstat, NULL, ctrl);
+	kobj_add(fs->kobj, ctrl->kobj);
+
 	/* Save control as mount point data */
 	m->m_data = ctrl;
 	return 0;
@@ -140,6 +160,9 @@ static int ext4fs_unmount(struct vfs_mount_t * m)
 		return -1;
 	}
 
+	kobj_remove(search_filesystem("ext4")->kobj, ctrl->kobj);
+	kobj_remove_self(ctrl->kobj);
+
 	rc = ext4fs_control_exit(ctrl);
 
 	free(ctrl);
@@ -28,152 +28,163 @@
 
 #include <vfs/fat/fat-control.h>
 
-static int __fatfs_control_flush_fat_cache(struct fatfs_control_t * ctrl, u32_t index)
+static inline u32_t __fatfs_control_fat_cache_hash(u32_t sect_num)
 {
-	u32_t i, sect_num;
+	return (sect_num / FAT_TABLE_CACHE_SECTORS) & (FAT_TABLE_CACHE_HASH - 1);
+}
+
+static inline u32_t __fatfs_control_fat_cache_len(struct fatfs_control_t * ctrl, u32_t sect_num)
+{
+	u32_t n = ctrl->sectors_per_fat - sect_num;
+
+	if(n > FAT_TABLE_CACHE_SECTORS)
+		n = FAT_TABLE_CACHE_SECTORS;
+	return n * ctrl->bytes_per_sector;
+}
+
+static int __fatfs_control_flush_fat_cache(struct fatfs_control_t * ctrl, struct fatfs_fat_cache_t * fc)
+{
+	u32_t i, n;
 	u64_t fat_base, len;
 
-	if(!ctrl->fat_cache_dirty[index])
+	if(!fc->valid || !fc->dirty)
 		return 0;
 
+	n = __fatfs_control_fat_cache_len(ctrl, fc->sect_num);
 	for(i = 0; i < ctrl->number_of_fat; i++)
 	{
-		fat_base = ((u64_t)ctrl->first_fat_sector + (i * ctrl->sectors_per_fat)) * ctrl->bytes_per_sector;
-		sect_num = ctrl->fat_cache_num[index];
-		len = block_write(ctrl->bdev, &ctrl->fat_cache_buf[index * ctrl->bytes_per_sector], fat_base + sect_num * ctrl->bytes_per_sector,
-		        ctrl->bytes_per_sector);
-		if(len != ctrl->bytes_per_sector)
+		fat_base = ((u64_t)ctrl->first_fat_sector + (i * ctrl->sectors_per_fat) + fc->sect_num) * ctrl->bytes_per_sector;
+		len = block_write(ctrl->bdev, fc->buf, fat_base, n);
+		if(len != n)
 			return -1;
 	}
-	ctrl->fat_cache_dirty[index] = FALSE;
+	fc->dirty = FALSE;
 
 	return 0;
 }
 
-static int __fatfs_control_find_fat_cache(struct fatfs_control_t * ctrl, u32_t sect_num)
+static struct fatfs_fat_cache_t * __fatfs_control_find_fat_cache(struct fatfs_control_t * ctrl, u32_t sect_num)
 {
-	int index;
+	struct fatfs_fat_cache_t * fc;
 
-	for(index = 0; index < FAT_TABLE_CACHE_SIZE; index++)
+	hlist_for_each_entry(fc, &ctrl->fat_cache_hash[__fatfs_control_fat_cache_hash(sect_num)], node)
 	{
-		if(ctrl->fat_cache_num[index] == sect_num)
-			return index;
+		if(fc->sect_num == sect_num)
+			return fc;
 	}
-	return -1;
+	return NULL;
 }
 
-static int __fatfs_control_load_fat_cache(struct fatfs_control_t * ctrl, u32_t sect_num)
+static struct fatfs_fat_cache_t * __fatfs_control_load_fat_cache(struct fatfs_control_t * ctrl, u32_t sect_num)
 {
-	int rc;
-	u32_t index;
+	struct fatfs_fat_cache_t * fc;
 	u64_t fat_base, len;
+	u32_t n;
 
-	if(-1 < __fatfs_control_find_fat_cache(ctrl, sect_num))
-		return 0;
-
-	index = ctrl->fat_cache_victim;
-	ctrl->fat_cache_victim++;
-	if(ctrl->fat_cache_victim == FAT_TABLE_CACHE_SIZE)
-		ctrl->fat_cache_victim = 0;
-
-	rc = __fatfs_control_flush_fat_cache(ctrl, index);
-	if(rc)
-		return rc;
+	sect_num -= sect_num % FAT_TABLE_CACHE_SECTORS;
+	fc = __fatfs_control_find_fat_cache(ctrl, sect_num);
+	if(!fc)
+	{
+		/* Recycle the least recently used window */
+		fc = list_last_entry(&ctrl->fat_cache_lru, struct fatfs_fat_cache_t, entry);
+		if(__fatfs_control_flush_fat_cache(ctrl, fc))
+			return NULL;
+		if(fc->valid)
+		{
+			hlist_del(&fc->node);
+			fc->valid = FALSE;
+		}
 
-	fat_base = (u64_t) ctrl->first_fat_sector * ctrl->bytes_per_sector;
-	len = block_read(ctrl->bdev, &ctrl->fat_cache_buf[index * ctrl->bytes_per_sector], fat_base + sect_num * ctrl->bytes_per_sector, ctrl->bytes_per_sector);
-	if(len != ctrl->bytes_per_sector)
-		return -1;
-	ctrl->fat_cache_num[index] = sect_num;
+		n = __fatfs_control_fat_cache_len(ctrl, sect_num);
+		fat_base = ((u64_t)ctrl->first_fat_sector + sect_num) * ctrl->bytes_per_sector;
+		len = block_read(ctrl->bdev, fc->buf, fat_base, n);
+		if(len != n)
+			return NULL;
+		fc->sect_num = sect_num;
+		fc->valid = TRUE;
+		hlist_add_head(&fc->node, &ctrl->fat_cache_hash[__fatfs_control_fat_cache_hash(sect_num)]);
+	}
+	list_move(&fc->entry, &ctrl->fat_cache_lru);
 
-	return 0;
+	return fc;
 }
 
-static u32_t __fatfs_control_read_fat_cache(struct fatfs_control_t * ctrl, u8_t * buf, u32_t pos)
+/*
+ * Return a pointer to the cached FAT byte at pos, and how many bytes follow
+ * it in the same window. Entries may straddle two windows.
+ */
+static u8_t * __fatfs_control_fat_cache_ptr(struct fatfs_control_t * ctrl, u32_t pos, bool_t dirty, u32_t * avail)
 {
-	int rc, index;
-	u32_t ret, sect_num, sect_off;
-
-	if((ctrl->sectors_per_fat * ctrl->bytes_per_sector) <= pos)
-		return 0;
-
-	sect_num = udiv32(pos, ctrl->bytes_per_sector);
-	sect_off = pos - (sect_num * ctrl->bytes_per_sector);
-
-	rc = __fatfs_control_load_fat_cache(ctrl, sect_num);
-	if(rc)
-		return 0;
-
-	index = __fatfs_control_find_fat_cache(ctrl, sect_num);
-	if(index < 0)
-		return 0;
-
-	index = (index * ctrl->bytes_per_sector) + sect_off;
+	struct fatfs_fat_cache_t * fc;
+	u32_t off;
+
+	fc = __fatfs_control_load_fat_cache(ctrl, udiv32(pos, ctrl->bytes_per_sector));
+	if(!fc)
+		return NULL;
+	if(dirty)
+		fc->dirty = TRUE;
+
+	off = pos - fc->sect_num * ctrl->bytes_per_sector;
+	if(avail)
+		*avail = __fatfs_control_fat_cache_len(ctrl, fc->sect_num) - off;
+	return &fc->buf[off];
+}
 
+static u32_t __fatfs_control_fat_entry_len(struct fatfs_control_t * ctrl)
+{
 	switch(ctrl->type)
 	{
 	case FAT_TYPE_12:
 	case FAT_TYPE_16:
-		ret = 2;
-		buf[0] = ctrl->fat_cache_buf[index + 0];
-		buf[1] = ctrl->fat_cache_buf[index + 1];
-		break;
+		return 2;
 	case FAT_TYPE_32:
-		ret = 4;
-		buf[0] = ctrl->fat_cache_buf[index + 0];
-		buf[1] = ctrl->fat_cache_buf[index + 1];
-		buf[2] = ctrl->fat_cache_buf[index + 2];
-		buf[3] = ctrl->fat_cache_buf[index + 3];
-		break;
+		return 4;
 	default:
-		ret = 0;
 		break;
 	};
-
-	return ret;
+	return 0;
 }
 
-static u32_t __fatfs_control_write_fat_cache(struct fatfs_control_t * ctrl, u8_t * buf, u32_t pos)
+static u32_t __fatfs_control_read_fat_cache(struct fatfs_control_t * ctrl, u8_t * buf, u32_t pos)
 {
-	int rc, index, cache_buf_index;
-	u32_t ret, sect_num, sect_off;
+	u32_t ret, i, n;
+	u8_t * p;
 
-	if((ctrl->sectors_per_fat * ctrl->bytes_per_sector) <= pos)
+	ret = __fatfs_control_fat_entry_len(ctrl);
+	if((ctrl->sectors_per_fat * ctrl->bytes_per_sector) < pos + ret)
 		return 0;
 
-	sect_num = udiv32(pos, ctrl->bytes_per_sector);
-	sect_off = pos - (sect_num * ctrl->bytes_per_sector);
+	for(i = 0; i < ret; i += n)
+	{
+		p = __fatfs_control_fat_cache_ptr(ctrl, pos + i, FALSE, &n);
+		if(!p)
+			return 0;
+		if(n > ret - i)
+			n = ret - i;
+		memcpy(&buf[i], p, n);
+	}
 
-	rc = __fatfs_control_load_fat_cache(ctrl, sect_num);
-	if(rc)
-		return 0;
+	return ret;
+}
 
-	index = __fatfs_control_find_fat_cache(ctrl, sect_num);
-	if(index < 0)
-		return 0;
+static u32_t __fatfs_control_write_fat_cache(struct fatfs_control_t * ctrl, u8_t * buf, u32_t pos)
+{
+	u32_t ret, i, n;
+	u8_t * p;
 
-	cache_buf_index = (index * ctrl->bytes_per_sector) + sect_off;
+	ret = __fatfs_control_fat_entry_len(ctrl);
+	if((ctrl->sectors_per_fat * ctrl->bytes_per_sector) < pos + ret)
+		return 0;
 
-	switch(ctrl->type)
+	for(i = 0; i < ret; i += n)
 	{
-	case FAT_TYPE_12:
-	case FAT_TYPE_16:
-		ret = 2;
-		ctrl->fat_cache_buf[cache_buf_index + 0] = buf[0];
-		ctrl->fat_cache_buf[cache_buf_index + 1] = buf[1];
-		break;
-	case FAT_TYPE_32:
-		ret = 4;
-		ctrl->fat_cache_buf[cache_buf_index + 0] = buf[0];
-		ctrl->fat_cache_buf[cache_buf_index + 1] = buf[1];
-		ctrl->fat_cache_buf[cache_buf_index + 2] = buf[2];
-		ctrl->fat_cache_buf[cache_buf_index + 3] = buf[3];
-		break;
-	default:
-		ret = 0;
-		break;
-	};
-	ctrl->fat_cache_dirty[index] = TRUE;
+		p = __fatfs_control_fat_cache_ptr(ctrl, pos + i, TRUE, &n);
+		if(!p)
+			return 0;
+		if(n > ret - i)
+			n = ret - i;
+		memcpy(p, &buf[i], n);
+	}
 
 	return ret;
 }
@@ -232,6 +243,39 @@ static bool_t __fatfs_control_valid_cluster(struct fatfs_control_t * ctrl, u32_t
 	return TRUE;
 }
 
+static inline u32_t __fatfs_control_max_cluster(struct fatfs_control_t * ctrl)
+{
+	u32_t last = __fatfs_control_last_valid_cluster(ctrl);
+
+	return (ctrl->data_clusters + 1 < last) ? ctrl->data_clusters + 1 : last;
+}
+
+static inline bool_t __fatfs_control_free_map_used(struct fatfs_control_t * ctrl, u32_t clust)
+{
+	u32_t i = clust - 2;
+
+	return (ctrl->free_map[i >> 5] & (1 << (i & 0x1f))) ? TRUE : FALSE;
+}
+
+static inline void __fatfs_control_free_map_mark(struct fatfs_control_t * ctrl, u32_t clust, bool_t used)
+{
+	u32_t i = clust - 2;
+	u32_t mask = 1 << (i & 0x1f);
+
+	if(clust > __fatfs_control_max_cluster(ctrl))
+		return;
+	if(used && !(ctrl->free_map[i >> 5] & mask))
+	{
+		ctrl->free_map[i >> 5] |= mask;
+		ctrl->free_count--;
+	}
+	else if(!used && (ctrl->free_map[i >> 5] & mask))
+	{
+		ctrl->free_map[i >> 5] &= ~mask;
+		ctrl->free_count++;
+	}
+}
+
 static int __fatfs_control_get_next_cluster(struct fatfs_control_t * ctrl, u32_t clust, u32_t * next)
 {
 	u8_t fat_entry_b[4] = { 0 };
@@ -341,6 +385,13 @@ static int __fatfs_control_set_next_cluster(struct fatfs_control_t * ctrl, u32_t
 	if(len != fat_len)
 		return -1;
 
+	/* Keep free cluster bitmap and counter in step with the table */
+	if(ctrl->free_map_valid)
+		__fatfs_control_free_map_mark(ctrl, clust, next ? TRUE : FALSE);
+	else
+		ctrl->free_count = FAT32_FSINFO_UNKNOWN;
+	ctrl->fsinfo_dirty = TRUE;
+
 	return 0;
 }
 
@@ -396,84 +447,218 @@ static int __fatfs_control_nth_cluster(struct fatfs_control_t * ctrl, u32_t clus
 	return 0;
 }
 
-static int __fatfs_control_alloc_cluster(struct fatfs_control_t * ctrl, u32_t clust, u32_t * newclust)
+static int __fatfs_control_truncate_clusters(struct fatfs_control_t *ctrl, u32_t clust)
 {
 	int rc;
-	bool_t found;
-	u32_t current, next, first, last;
+	u32_t current, next = clust;
 
-	found = FALSE;
+	while(__fatfs_control_valid_cluster(ctrl, next))
+	{
+		current = next;
 
-	if(__fatfs_control_valid_cluster(ctrl, clust))
+		rc = __fatfs_control_get_next_cluster(ctrl, current, &next);
+		if(rc)
+			return rc;
+
+		rc = __fatfs_control_set_next_cluster(ctrl, current, 0x0);
+		if(rc)
+			return rc;
+	}
+
+	return 0;
+}
+
+/*
+ * Scan the whole table once and build the free cluster bitmap. This is done
+ * on the first allocation after mount.
+ */
+static int __fatfs_control_build_free_map(struct fatfs_control_t * ctrl)
+{
+	u32_t clust, last, next, i, n;
+	u8_t * p;
+
+	if(ctrl->free_map_valid)
+		return 0;
+
+	last = __fatfs_control_max_cluster(ctrl);
+	if(!ctrl->free_map)
 	{
-		first = clust;
+		ctrl->free_map = calloc((last + 32 - 1) >> 5, sizeof(u32_t));
+		if(!ctrl->free_map)
+			return -1;
 	}
 	else
 	{
-		first = __fatfs_control_first_valid_cluster(ctrl);
+		memset(ctrl->free_map, 0, ((last + 32 - 1) >> 5) * sizeof(u32_t));
 	}
 
-	last = __fatfs_control_last_valid_cluster(ctrl);
-	for(current = first; current <= last; current++)
+	ctrl->free_count = 0;
+	for(clust = 2; clust <= last; clust += n)
 	{
-		rc = __fatfs_control_get_next_cluster(ctrl, current, &next);
-		if(rc)
-			return rc;
-
-		if(next == 0x0)
+		if(ctrl->type == FAT_TYPE_32)
+		{
+			/* Decode a whole cache window at a time */
+			p = __fatfs_control_fat_cache_ptr(ctrl, clust * 4, FALSE, &n);
+			if(!p)
+				return -1;
+			n >>= 2;
+			if(n > last - clust + 1)
+				n = last - clust + 1;
+			for(i = 0; i < n; i++, p += 4)
+			{
+				if(p[0] | p[1] | p[2] | (p[3] & 0x0f))
+					ctrl->free_map[(clust + i - 2) >> 5] |= 1 << ((clust + i - 2) & 0x1f);
+				else
+					ctrl->free_count++;
+			}
+		}
+		else
 		{
-			found = TRUE;
-			break;
+			n = 1;
+			if(__fatfs_control_get_next_cluster(ctrl, clust, &next))
+				return -1;
+			if(next)
+				ctrl->free_map[(clust - 2) >> 5] |= 1 << ((clust - 2) & 0x1f);
+			else
+				ctrl->free_count++;
 		}
 	}
-
-	if(!found)
-		return -1;
-
-	rc = __fatfs_control_set_last_cluster(ctrl, current);
-	if(rc)
-		return rc;
-
-	if(newclust)
-		*newclust = current;
+	ctrl->free_map_valid = TRUE;
+	ctrl->fsinfo_dirty = TRUE;
 
 	return 0;
 }
 
-static int __fatfs_control_append_free_cluster(struct fatfs_control_t *ctrl, u32_t clust, u32_t *newclust)
+/*
+ * Find a run of up to count free clusters starting the search at start and
+ * wrapping around. The first run long enough is returned, else the longest.
+ */
+static u32_t __fatfs_control_find_free(struct fatfs_control_t * ctrl, u32_t start, u32_t count, u32_t * len)
 {
-	int rc;
+	u32_t first, last, clust, total, scanned;
+	u32_t next, run, best = 0, bestlen = 0;
 
-	rc = __fatfs_control_alloc_cluster(ctrl, clust, newclust);
-	if(rc)
-		return rc;
+	first = __fatfs_control_first_valid_cluster(ctrl);
+	last = __fatfs_control_max_cluster(ctrl);
+	if((start < first) || (start > last))
+		start = first;
+	total = last - first + 1;
 
-	rc = __fatfs_control_set_next_cluster(ctrl, clust, *newclust);
-	if(rc)
-		return rc;
+	/* Without a bitmap fall back to probing table entries one by one */
+	if(!ctrl->free_map_valid)
+	{
+		for(clust = start, scanned = 0; scanned < total; scanned++)
+		{
+			if(__fatfs_control_get_next_cluster(ctrl, clust, &next))
+				return 0;
+			if(next == 0x0)
+			{
+				*len = 1;
+				return clust;
+			}
+			if(++clust > last)
+				clust = first;
+		}
+		return 0;
+	}
 
-	return 0;
+	for(clust = start, scanned = 0; scanned < total;)
+	{
+		if(!((clust - 2) & 0x1f) && (clust + 31 <= last) && (ctrl->free_map[(clust - 2) >> 5] == 0xffffffff))
+		{
+			clust += 32;
+			scanned += 32;
+		}
+		else if(__fatfs_control_free_map_used(ctrl, clust))
+		{
+			clust++;
+			scanned++;
+		}
+		else
+		{
+			for(run = 1; (run < count) && (clust + run <= last) && !__fatfs_control_free_map_used(ctrl, clust + run); run++);
+			if(run >= count)
+			{
+				*len = count;
+				return clust;
+			}
+			if(run > bestlen)
+			{
+				best = clust;
+				bestlen = run;
+			}
+			clust += run;
+			scanned += run;
+		}
+		if(clust > last)
+			clust = first;
+	}
+
+	*len = bestlen;
+	return best;
 }
 
-static int __fatfs_control_truncate_clusters(struct fatfs_control_t *ctrl, u32_t clust)
+/*
+ * Allocate a chain of count clusters, linked after clust when it is valid.
+ * Appends are placed right after clust and large requests are served from
+ * contiguous runs where possible. On failure nothing is allocated.
+ */
+static int __fatfs_control_alloc_clusters(struct fatfs_control_t * ctrl, u32_t clust, u32_t count, u32_t * newclust)
 {
-	int rc;
-	u32_t current, next = clust;
+	u32_t prev, start, first, c, n, i;
+	int rc = -1;
 
-	while(__fatfs_control_valid_cluster(ctrl, next))
+	if(count == 0)
+		return -1;
+
+	/* The bitmap is an optimization, keep going without it */
+	__fatfs_control_build_free_map(ctrl);
+
+	prev = __fatfs_control_valid_cluster(ctrl, clust) ? clust : 0;
+	first = 0;
+	while(count > 0)
 	{
-		current = next;
+		start = prev ? prev + 1 : ctrl->next_free;
+		c = __fatfs_control_find_free(ctrl, start, count, &n);
+		if(!c)
+			goto fail;
 
-		rc = __fatfs_control_get_next_cluster(ctrl, current, &next);
+		if(prev)
+		{
+			rc = __fatfs_control_set_next_cluster(ctrl, prev, c);
+			if(rc)
+				goto fail;
+		}
+		if(!first)
+			first = c;
+		for(i = 0; i < n - 1; i++)
+		{
+			rc = __fatfs_control_set_next_cluster(ctrl, c + i, c + i + 1);
+			if(rc)
+				goto fail;
+		}
+		rc = __fatfs_control_set_last_cluster(ctrl, c + n - 1);
 		if(rc)
-			return rc;
+			goto fail;
 
-		rc = __fatfs_control_set_next_cluster(ctrl, current, 0x0);
-		if(rc)
-			return rc;
+		prev = c + n - 1;
+		count -= n;
+		ctrl->next_free = (prev < __fatfs_control_max_cluster(ctrl)) ? prev + 1 : __fatfs_control_first_valid_cluster(ctrl);
 	}
 
+	if(newclust)
+		*newclust = first;
+
 	return 0;
+
+fail:
+	if(first)
+	{
+		__fatfs_control_truncate_clusters(ctrl, first);
+		if(__fatfs_control_valid_cluster(ctrl, clust))
+			__fatfs_control_set_last_cluster(ctrl, clust);
+	}
+	return rc ? rc : -1;
 }
 
 static s64_t fatfs_wallclock_mktime(unsigned int year, unsigned int mon, unsigned int day, unsigned int hour, unsigned int min, unsigned int sec)
@@ -548,6 +733,65 @@ void fatfs_timestamp(time_t *t, u32_t * year, u32_t * mon, u32_t * day, u32_t *
 		*sec = ti->tm_sec;
 }
 
+static void __fatfs_control_load_fsinfo(struct fatfs_control_t * ctrl)
+{
+	struct fat_fsinfo_t fsinfo;
+	u32_t next_free;
+	u64_t len;
+
+	ctrl->free_count = FAT32_FSINFO_UNKNOWN;
+	ctrl->next_free = __fatfs_control_first_valid_cluster(ctrl);
+	ctrl->fsinfo_dirty = FALSE;
+
+	if(ctrl->type != FAT_TYPE_32)
+		return;
+
+	ctrl->fsinfo_sector = le16_to_cpu(ctrl->bsec.ext.e32.fs_info_sector);
+	if((ctrl->fsinfo_sector == 0) || (ctrl->fsinfo_sector >= ctrl->first_fat_sector))
+	{
+		ctrl->fsinfo_sector = 0;
+		return;
+	}
+
+	len = block_read(ctrl->bdev, (u8_t *)&fsinfo, (u64_t)ctrl->fsinfo_sector * ctrl->bytes_per_sector, sizeof(struct fat_fsinfo_t));
+	if((len != sizeof(struct fat_fsinfo_t)) ||
+		(le32_to_cpu(fsinfo.lead_signature) != FAT32_FSINFO_LEAD_SIGNATURE) ||
+		(le32_to_cpu(fsinfo.struct_signature) != FAT32_FSINFO_STRUCT_SIGNATURE))
+	{
+		ctrl->fsinfo_sector = 0;
+		return;
+	}
+
+	/* Both fields are only hints, ignore values out of range */
+	if(le32_to_cpu(fsinfo.free_count) <= ctrl->data_clusters)
+		ctrl->free_count = le32_to_cpu(fsinfo.free_count);
+	next_free = le32_to_cpu(fsinfo.next_free);
+	if((next_free >= __fatfs_control_first_valid_cluster(ctrl)) && (next_free <= __fatfs_control_max_cluster(ctrl)))
+		ctrl->next_free = next_free;
+}
+
+static int __fatfs_control_sync_fsinfo(struct fatfs_control_t * ctrl)
+{
+	struct fat_fsinfo_t fsinfo;
+	u64_t off, len;
+
+	if(!ctrl->fsinfo_sector || !ctrl->fsinfo_dirty)
+		return 0;
+
+	off = (u64_t)ctrl->fsinfo_sector * ctrl->bytes_per_sector;
+	len = block_read(ctrl->bdev, (u8_t *)&fsinfo, off, sizeof(struct fat_fsinfo_t));
+	if(len != sizeof(struct fat_fsinfo_t))
+		return -1;
+	fsinfo.free_count = cpu_to_le32(ctrl->free_count);
+	fsinfo.next_free = cpu_to_le32(ctrl->next_free);
+	len = block_write(ctrl->bdev, (u8_t *)&fsinfo, off, sizeof(struct fat_fsinfo_t));
+	if(len != sizeof(struct fat_fsinfo_t))
+		return -1;
+	ctrl->fsinfo_dirty = FALSE;
+
+	return 0;
+}
+
 bool_t fatfs_control_valid_cluster(struct fatfs_control_t * ctrl, u32_t clust)
 {
 	return __fatfs_control_valid_cluster(ctrl, clust);
@@ -580,7 +824,7 @@ int fatfs_control_alloc_first_cluster(struct fatfs_control_t * ctrl, u32_t * new
 	int rc;
 
 	mutex_lock(&ctrl->fat_cache_lock);
-	rc = __fatfs_control_alloc_cluster(ctrl, 0, newclust);
+	rc = __fatfs_control_alloc_clusters(ctrl, 0, 1, newclust);
 	mutex_unlock(&ctrl->fat_cache_lock);
 
 	return rc;
@@ -591,7 +835,18 @@ int fatfs_control_append_free_cluster(struct fatfs_control_t * ctrl, u32_t clust
 	int rc;
 
 	mutex_lock(&ctrl->fat_cache_lock);
-	rc = __fatfs_control_append_free_cluster(ctrl, clust, newclust);
+	rc = __fatfs_control_alloc_clusters(ctrl, clust, 1, newclust);
+	mutex_unlock(&ctrl->fat_cache_lock);
+
+	return rc;
+}
+
+int fatfs_control_alloc_clusters(struct fatfs_control_t * ctrl, u32_t clust, u32_t count, u32_t * newclust)
+{
+	int rc;
+
+	mutex_lock(&ctrl->fat_cache_lock);
+	rc = __fatfs_control_alloc_clusters(ctrl, clust, count, newclust);
 	mutex_unlock(&ctrl->fat_cache_lock);
 
 	return rc;
@@ -610,20 +865,24 @@ int fatfs_control_truncate_clusters(struct fatfs_control_t * ctrl, u32_t clust)
 
 int fatfs_control_sync(struct fatfs_control_t * ctrl)
 {
-	int rc, index;
+	struct fatfs_fat_cache_t * fc;
+	int rc;
 
 	/* Flush entire FAT sector cache */
 	mutex_lock(&ctrl->fat_cache_lock);
-	for(index = 0; index < FAT_TABLE_CACHE_SIZE; index++)
+	list_for_each_entry(fc, &ctrl->fat_cache_lru, entry)
 	{
-		rc = __fatfs_control_flush_fat_cache(ctrl, index);
+		rc = __fatfs_control_flush_fat_cache(ctrl, fc);
 		if(rc)
 		{
 			mutex_unlock(&ctrl->fat_cache_lock);
 			return rc;
 		}
 	}
+	rc = __fatfs_control_sync_fsinfo(ctrl);
 	mutex_unlock(&ctrl->fat_cache_lock);
+	if(rc)
+		return rc;
 
 	/* Flush cached data in device request queue */
 	block_sync(ctrl->bdev);
@@ -720,30 +979,33 @@ int fatfs_control_init(struct fatfs_control_t * ctrl, struct block_t * bdev)
 
 	/* Initialize fat cache */
 	mutex_init(&ctrl->fat_cache_lock);
-	ctrl->fat_cache_victim = 0;
-	for(i = 0; i < FAT_TABLE_CACHE_SIZE; i++)
-	{
-		ctrl->fat_cache_dirty[i] = FALSE;
-		ctrl->fat_cache_num[i] = i;
-	}
-	ctrl->fat_cache_buf = calloc(1, FAT_TABLE_CACHE_SIZE * ctrl->bytes_per_sector);
+	init_list_head(&ctrl->fat_cache_lru);
+	for(i = 0; i < FAT_TABLE_CACHE_HASH; i++)
+		init_hlist_head(&ctrl->fat_cache_hash[i]);
+	ctrl->fat_cache_buf = calloc(FAT_TABLE_CACHE_SIZE * FAT_TABLE_CACHE_SECTORS, ctrl->bytes_per_sector);
 	if(!ctrl->fat_cache_buf)
 		return -1;
-
-	/* Load fat cache */
-	rlen = block_read(ctrl->bdev, ctrl->fat_cache_buf, ctrl->first_fat_sector * ctrl->bytes_per_sector,
-	FAT_TABLE_CACHE_SIZE * ctrl->bytes_per_sector);
-	if(rlen != (FAT_TABLE_CACHE_SIZE * ctrl->bytes_per_sector))
+	for(i = 0; i < FAT_TABLE_CACHE_SIZE; i++)
 	{
-		free(ctrl->fat_cache_buf);
-		return -1;
+		init_hlist_node(&ctrl->fat_cache[i].node);
+		ctrl->fat_cache[i].sect_num = 0;
+		ctrl->fat_cache[i].valid = FALSE;
+		ctrl->fat_cache[i].dirty = FALSE;
+		ctrl->fat_cache[i].buf = &ctrl->fat_cache_buf[i * FAT_TABLE_CACHE_SECTORS * ctrl->bytes_per_sector];
+		list_add_tail(&ctrl->fat_cache[i].entry, &ctrl->fat_cache_lru);
 	}
 
+	/* Free cluster bitmap is built on first allocation */
+	ctrl->free_map = NULL;
+	ctrl->free_map_valid = FALSE;
+	__fatfs_control_load_fsinfo(ctrl);
+
 	return 0;
 }
 
 int fatfs_control_exit(struct fatfs_control_t * ctrl)
 {
+	free(ctrl->free_map);
 	free(ctrl->fat_cache_buf);
 	return 0;
 }
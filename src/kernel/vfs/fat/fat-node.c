@@ -167,6 +167,113 @@ static int fatfs_node_clear_cluster(struct fatfs_node_t * node, u32_t clust)
 
 	/* init cluster */
 	memset(node->cached_data, 0, ctrl->bytes_per_cluster);
+	node->cached_dirty = TRUE;
+	return 0;
+}
+
+static void fatfs_node_extent_reset(struct fatfs_node_t * node)
+{
+	node->extent_count = 0;
+	node->extent_clusters = 0;
+	node->extent_first = node->first_cluster;
+	node->extent_eof = FALSE;
+}
+
+/*
+ * Append the next cluster of the chain to the extent map, either growing
+ * the last run or starting a new one.
+ */
+static int fatfs_node_extent_grow(struct fatfs_node_t * node)
+{
+	struct fatfs_control_t * ctrl = node->ctrl;
+	struct fatfs_extent_t * e;
+	u32_t next, size;
+
+	if(node->extent_eof)
+		return -1;
+	if(node->extent_count == 0)
+	{
+		next = node->first_cluster;
+		if(!fatfs_control_valid_cluster(ctrl, next))
+		{
+			node->extent_eof = TRUE;
+			return -1;
+		}
+	}
+	else
+	{
+		e = &node->extents[node->extent_count - 1];
+		if(fatfs_control_nth_cluster(ctrl, e->cluster + e->count - 1, 1, &next))
+		{
+			node->extent_eof = TRUE;
+			return -1;
+		}
+		if(next == e->cluster + e->count)
+		{
+			e->count++;
+			node->extent_clusters++;
+			return 0;
+		}
+	}
+	if(node->extent_count >= node->extent_size)
+	{
+		size = node->extent_size ? node->extent_size * 2 : 8;
+		e = realloc(node->extents, sizeof(struct fatfs_extent_t) * size);
+		if(!e)
+			return -1;
+		node->extents = e;
+		node->extent_size = size;
+	}
+	e = &node->extents[node->extent_count++];
+	e->index = node->extent_clusters;
+	e->cluster = next;
+	e->count = 1;
+	node->extent_clusters++;
+	return 0;
+}
+
+/*
+ * Translate a file cluster index to a disk cluster, also returning how many
+ * clusters are contiguous from there. The chain is only walked once, past
+ * the mapped part, and the result is kept as a sorted array of runs.
+ */
+static int fatfs_node_extent_map(struct fatfs_node_t * node, u32_t index, u32_t * clust, u32_t * count)
+{
+	struct fatfs_extent_t * e;
+	u32_t lo, hi, mid;
+
+	if(node->extent_first != node->first_cluster)
+		fatfs_node_extent_reset(node);
+
+	while(index >= node->extent_clusters)
+	{
+		if(fatfs_node_extent_grow(node))
+			return -1;
+	}
+
+	lo = 0;
+	hi = node->extent_count - 1;
+	while(lo < hi)
+	{
+		mid = (lo + hi + 1) >> 1;
+		if(node->extents[mid].index <= index)
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+
+	/* Make sure the run length of the last extent is complete */
+	while((lo == node->extent_count - 1) && !node->extent_eof)
+	{
+		if(fatfs_node_extent_grow(node))
+			break;
+	}
+
+	e = &node->extents[lo];
+	if(clust)
+		*clust = e->cluster + (index - e->index);
+	if(count)
+		*count = e->count - (index - e->index);
 	return 0;
 }
 
@@ -203,6 +310,7 @@ static int fatfs_node_auto_alloc_next_cluster(struct fatfs_node_t * node, u32_t
 
 	if(rc)
 		return rc;
+	node->extent_eof = FALSE;
 
 	rc = fatfs_node_clear_cluster(node, *next);
 
@@ -212,6 +320,57 @@ static int fatfs_node_auto_alloc_next_cluster(struct fatfs_node_t * node, u32_t
 	return 0;
 }
 
+/*
+ * Extend the chain to cover [pos, pos + len) with one allocation. Clusters
+ * not completely overwritten by the caller are cleared. On failure the
+ * caller falls back to appending one cluster at a time.
+ */
+static int fatfs_node_alloc_clusters(struct fatfs_node_t * node, u32_t pos, u32_t len)
+{
+	struct fatfs_control_t * ctrl = node->ctrl;
+	u32_t need, have, last, first, clust, i;
+	int rc;
+
+	need = udiv32(pos + len + ctrl->bytes_per_cluster - 1, ctrl->bytes_per_cluster);
+	if(!fatfs_node_extent_map(node, need - 1, NULL, NULL))
+		return 0;
+	if(!node->extent_eof)
+		return -1;
+
+	have = node->extent_clusters;
+	last = 0;
+	if((have > 0) && fatfs_node_extent_map(node, have - 1, &last, NULL))
+		return -1;
+
+	rc = fatfs_control_alloc_clusters(ctrl, last, need - have, &first);
+	if(rc)
+		return rc;
+	node->extent_eof = FALSE;
+
+	if(have == 0)
+	{
+		node->first_cluster = first;
+		node->cur_cluster = node->first_cluster;
+		node->cur_pos = 0;
+
+		/* Mark node directory entry as dirty */
+		node->parent_dent_dirty = TRUE;
+	}
+
+	for(i = have; i < need; i++)
+	{
+		if(((u64_t)i * ctrl->bytes_per_cluster >= pos) && ((u64_t)(i + 1) * ctrl->bytes_per_cluster <= (u64_t)pos + len))
+			continue;
+		if(fatfs_node_extent_map(node, i, &clust, NULL))
+			return -1;
+		rc = fatfs_node_clear_cluster(node, clust);
+		if(rc)
+			return rc;
+	}
+
+	return 0;
+}
+
 static void fatfs_node_fast_jump_cluster(struct fatfs_node_t * node, u32_t pos, u32_t * cl_pos, u32_t * cl_num)
 {
 	struct fatfs_control_t *ctrl = node->ctrl;
@@ -236,8 +395,8 @@ static void fatfs_node_fast_jump_cluster(struct fatfs_node_t * node, u32_t pos,
 u32_t fatfs_node_read(struct fatfs_node_t * node, u32_t pos, u32_t len, u8_t * buf)
 {
 	u64_t roff, rlen;
-	u32_t r, rstartcl;
-	u32_t cl_off, cl_num, cl_len;
+	u32_t r, n;
+	u32_t cl_off, cl_num, cl_cnt, cl_len;
 	struct fatfs_control_t *ctrl = node->ctrl;
 
 	if(!node->parent && ctrl->type != FAT_TYPE_32)
@@ -254,36 +413,49 @@ u32_t fatfs_node_read(struct fatfs_node_t * node, u32_t pos, u32_t len, u8_t * b
 		return block_read(ctrl->bdev, (u8_t *) buf, roff, rlen);
 	}
 
-	fatfs_node_fast_jump_cluster(node, pos, &rstartcl, &cl_num);
-
-	if(fatfs_node_nth_cluster(node, cl_num, rstartcl, &cl_num))
-		return 0;
-
 	r = 0;
-	cl_off = umod32(pos + r, ctrl->bytes_per_cluster);
-	do
+	while(r < len)
 	{
-		/* Current cluster info */
-		cl_len = ctrl->bytes_per_cluster - cl_off;
-		cl_len = (len - r < cl_len) ? len - r : cl_len;
-
-		/* Update current cluster */
-		node->cur_cluster = cl_num;
-		node->cur_pos = pos + r;
-
-		/* Read from cached cluster */
-		rlen = fatfs_node_read_cluster(node, cl_num, buf, cl_off, cl_len);
+		cl_off = umod32(pos + r, ctrl->bytes_per_cluster);
+		if(fatfs_node_extent_map(node, udiv32(pos + r, ctrl->bytes_per_cluster), &cl_num, &cl_cnt))
+			break;
 
-		if(rlen != cl_len)
+		if((cl_off == 0) && (len - r >= ctrl->bytes_per_cluster))
 		{
-			break;
+			/* Read whole contiguous clusters with one request */
+			n = udiv32(len - r, ctrl->bytes_per_cluster);
+			if(n > cl_cnt)
+				n = cl_cnt;
+			if(node->cached_dirty && (node->cached_clust >= cl_num) && (node->cached_clust < cl_num + n))
+			{
+				if(fatfs_node_sync_cached_cluster(node))
+					break;
+			}
+			cl_len = n * ctrl->bytes_per_cluster;
+			roff = (u64_t) ctrl->first_data_sector * ctrl->bytes_per_sector;
+			roff += (u64_t) (cl_num - 2) * ctrl->bytes_per_cluster;
+			rlen = block_read(ctrl->bdev, buf, roff, cl_len);
+			if(rlen != cl_len)
+				break;
+			node->cur_cluster = cl_num + n - 1;
+			node->cur_pos = pos + r + cl_len - ctrl->bytes_per_cluster;
+		}
+		else
+		{
+			/* Read from cached cluster */
+			cl_len = ctrl->bytes_per_cluster - cl_off;
+			cl_len = (len - r < cl_len) ? len - r : cl_len;
+			rlen = fatfs_node_read_cluster(node, cl_num, buf, cl_off, cl_len);
+			if(rlen != cl_len)
+				break;
+			node->cur_cluster = cl_num;
+			node->cur_pos = pos + r;
 		}
 
 		/* Update iteration */
 		r += cl_len;
 		buf += cl_len;
-		cl_off -= cl_off;
-	} while(r < len && !fatfs_node_next_cluster(node, cl_num, &cl_num));
+	}
 
 	return r;
 }
@@ -292,7 +464,7 @@ u32_t fatfs_node_write(struct fatfs_node_t * node, u32_t pos, u32_t len, u8_t *
 {
 	int rc;
 	u64_t woff, wlen;
-	u32_t w = 0, wstartcl;
+	u32_t w = 0, wstartcl, i;
 	u32_t cl_off, cl_num, cl_len;
 	struct fatfs_control_t *ctrl = node->ctrl;
 
@@ -303,11 +475,17 @@ u32_t fatfs_node_write(struct fatfs_node_t * node, u32_t pos, u32_t len, u8_t *
 			return 0;
 		if((pos + len) > wlen)
 			wlen = wlen - pos;
+		else
+			wlen = len;
 		woff = (u64_t) ctrl->first_root_sector * ctrl->bytes_per_sector;
 		woff += pos;
 		return block_write(ctrl->bdev, (u8_t *) buf, woff, wlen);
 	}
 
+	/* Allocate all missing clusters at once, so that they can be contiguous */
+	if(len > 0)
+		fatfs_node_alloc_clusters(node, pos, len);
+
 	/* If first cluster is zero then allocate first cluster */
 	if(node->first_cluster == 0)
 	{
@@ -323,14 +501,18 @@ u32_t fatfs_node_write(struct fatfs_node_t * node, u32_t pos, u32_t len, u8_t *
 		node->parent_dent_dirty = TRUE;
 	}
 
-	fatfs_node_fast_jump_cluster(node, pos, &wstartcl, &cl_num);
-
-	/* Make room for new data by appending free clusters */
-	for(int i = 0; i < wstartcl; i++)
+	wstartcl = udiv32(pos, ctrl->bytes_per_cluster);
+	if(fatfs_node_extent_map(node, wstartcl, &cl_num, NULL))
 	{
-		rc = fatfs_node_auto_alloc_next_cluster(node, cl_num, &cl_num);
-		if(rc)
+		/* Make room for new data by appending free clusters */
+		if(!node->extent_clusters || fatfs_node_extent_map(node, node->extent_clusters - 1, &cl_num, NULL))
 			return 0;
+		for(i = node->extent_clusters - 1; i < wstartcl; i++)
+		{
+			rc = fatfs_node_auto_alloc_next_cluster(node, cl_num, &cl_num);
+			if(rc)
+				return 0;
+		}
 	}
 
 	w = 0;
@@ -365,6 +547,18 @@ u32_t fatfs_node_write(struct fatfs_node_t * node, u32_t pos, u32_t len, u8_t *
 	return w;
 }
 
+static bool_t fatfs_node_cluster_in_chain(struct fatfs_control_t * ctrl, u32_t clust, u32_t target)
+{
+	while(fatfs_control_valid_cluster(ctrl, clust))
+	{
+		if(clust == target)
+			return TRUE;
+		if(fatfs_control_nth_cluster(ctrl, clust, 1, &clust))
+			break;
+	}
+	return FALSE;
+}
+
 int fatfs_node_truncate(struct fatfs_node_t * node, u32_t pos)
 {
 	int rc;
@@ -385,6 +579,13 @@ int fatfs_node_truncate(struct fatfs_node_t * node, u32_t pos)
 	if(rc)
 		return rc;
 
+	/* Drop the cached cluster if it is freed, a kept one stays dirty */
+	if(fatfs_control_valid_cluster(ctrl, node->cached_clust) && fatfs_node_cluster_in_chain(ctrl, cl_num, node->cached_clust))
+	{
+		node->cached_clust = 0;
+		node->cached_dirty = FALSE;
+	}
+
 	/* Remove all clusters after last cluster */
 	rc = fatfs_control_truncate_clusters(ctrl, cl_num);
 	if(rc)
@@ -414,6 +615,7 @@ int fatfs_node_truncate(struct fatfs_node_t * node, u32_t pos)
 	node->parent_dent_dirty = TRUE;
 	node->cur_cluster = node->first_cluster;
 	node->cur_pos = 0;
+	fatfs_node_extent_reset(node);
 	return 0;
 }
 
@@ -448,6 +650,9 @@ int fatfs_node_init(struct fatfs_control_t * ctrl, struct fatfs_node_t * node)
 	node->cached_data = NULL;
 	node->cached_dirty = FALSE;
 
+	node->extents = NULL;
+	node->extent_size = 0;
+	fatfs_node_extent_reset(node);
 
 	return 0;
 }
@@ -461,6 +666,13 @@ int fatfs_node_exit(struct fatfs_node_t * node)
 		node->cached_data = NULL;
 		node->cached_dirty = FALSE;
 	}
+	if(node->extents)
+	{
+		free(node->extents);
+		node->extents = NULL;
+		node->extent_size = 0;
+	}
+	fatfs_node_extent_reset(node);
 
 	return 0;
 }
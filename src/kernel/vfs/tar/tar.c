@@ -94,88 +94,317 @@ struct tar_header_t
 	int8_t reserver[12];
 } __attribute__ ((packed));
 
-static bool_t get_next_token(const char * path, const char * perfix, char * result)
-{
-	char full_path[VFS_MAX_PATH];
-	char *p, *q;
-	s32_t l;
+/*
+ * Entry of the index built at mount time. Names live in one string
+ * table and entries refer to each other by position, entry 0 is root
+ */
+struct tar_node_t {
+	u32_t name;			/* Offset of name in string table */
+	u32_t parent;
+	u32_t child;		/* First child, 0 if none */
+	u32_t last;			/* Last child */
+	u32_t next;			/* Next sibling */
+	u32_t hnext;		/* Next entry in hash bucket */
+	u32_t hash;			/* Hash of full path */
+	u32_t mode;
+	u32_t mtime;
+	u8_t filetype;
+
+	/* Position of the last readdir, for listing in order */
+	u32_t cursor;
+	u32_t cursor_off;
+
+	u64_t offset;		/* Offset of file data */
+	u64_t size;
+};
 
-	if(!path || !perfix || !result)
-		return FALSE;
+struct tar_index_t {
+	struct tar_node_t * node;
+	u32_t nnode;
+	u32_t maxnode;
 
-	full_path[0] = '\0';
+	char * strtab;
+	u32_t nstrtab;
+	u32_t maxstrtab;
 
-	if(path[0] != '/')
-		strcpy(full_path, (const char *)("/"));
-	strlcat(full_path, path, sizeof(full_path));
+	u32_t * hash;
+	u32_t hsize;
 
-	l = strlen(perfix);
-	if(memcmp(full_path, perfix, l) != 0)
-		return FALSE;
+	/* Archive contents when the device is memory resident */
+	u8_t * image;
+};
 
-	p = &full_path[l];
-	if(*p == '\0')
-		return FALSE;
-	if(*p == '/')
-		p++;
-	if(*p == '\0')
-		return FALSE;
+static inline u32_t tar_hash(u32_t v, const char * s)
+{
+	v = (v << 5) + v + '/';
+	while(*s)
+		v = (v << 5) + v + (*s++);
+	return v;
+}
 
-	q = strchr(p, '/');
-	if(q)
+static inline u64_t tar_number(const int8_t * p, int len)
+{
+	u64_t v = 0;
+	int i = 0;
+
+	/* Base-256 encoding of large values */
+	if(p[0] & 0x80)
 	{
-		if(*(q+1) != '\0')
-			return FALSE;
-		*q = 0;
+		v = p[0] & 0x3f;
+		for(i = 1; i < len; i++)
+			v = (v << 8) | (u8_t)p[i];
+		return v;
 	}
+	while((i < len) && (p[i] == ' '))
+		i++;
+	for(; (i < len) && (p[i] >= '0') && (p[i] <= '7'); i++)
+		v = (v << 3) | (p[i] - '0');
+	return v;
+}
 
-	strcpy(result, p);
+static inline struct tar_node_t * tar_index_search(struct tar_index_t * idx, u32_t parent, const char * name)
+{
+	struct tar_node_t * tn;
+	u32_t hash = tar_hash(idx->node[parent].hash, name);
+	u32_t i;
 
+	for(i = idx->hash[hash & (idx->hsize - 1)]; i; i = tn->hnext)
+	{
+		tn = &idx->node[i];
+		if((tn->hash == hash) && (tn->parent == parent) && (strcmp(&idx->strtab[tn->name], name) == 0))
+			return tn;
+	}
+	return NULL;
+}
+
+static bool_t tar_index_grow(struct tar_index_t * idx, u32_t len)
+{
+	struct tar_node_t * node;
+	u32_t * hash;
+	char * strtab;
+	u32_t size, i, h;
+
+	if(idx->nnode >= idx->maxnode)
+	{
+		size = idx->maxnode << 1;
+		node = realloc(idx->node, sizeof(struct tar_node_t) * size);
+		if(!node)
+			return FALSE;
+		idx->node = node;
+		idx->maxnode = size;
+	}
+	if(idx->nstrtab + len > idx->maxstrtab)
+	{
+		size = idx->maxstrtab << 1;
+		while(idx->nstrtab + len > size)
+			size <<= 1;
+		strtab = realloc(idx->strtab, size);
+		if(!strtab)
+			return FALSE;
+		idx->strtab = strtab;
+		idx->maxstrtab = size;
+	}
+	if(idx->nnode >= idx->hsize)
+	{
+		size = idx->hsize << 1;
+		hash = malloc(sizeof(u32_t) * size);
+		if(!hash)
+			return FALSE;
+		memset(hash, 0, sizeof(u32_t) * size);
+		for(i = 1; i < idx->nnode; i++)
+		{
+			h = idx->node[i].hash & (size - 1);
+			idx->node[i].hnext = hash[h];
+			hash[h] = i;
+		}
+		free(idx->hash);
+		idx->hash = hash;
+		idx->hsize = size;
+	}
 	return TRUE;
 }
 
-static bool_t check_path(const char * path, const char * perfix, const char * name)
+static struct tar_node_t * tar_index_add(struct tar_index_t * idx, u32_t parent, const char * name)
 {
-	char path1[VFS_MAX_PATH];
-	char path2[VFS_MAX_PATH];
-	char *p;
-	s32_t l;
+	struct tar_node_t * tn;
+	u32_t len = strlen(name) + 1;
+	u32_t i, h;
+
+	if(!tar_index_grow(idx, len))
+		return NULL;
+
+	i = idx->nnode++;
+	tn = &idx->node[i];
+	memset(tn, 0, sizeof(struct tar_node_t));
+	tn->name = idx->nstrtab;
+	memcpy(&idx->strtab[idx->nstrtab], name, len);
+	idx->nstrtab += len;
+	tn->parent = parent;
+	tn->hash = tar_hash(idx->node[parent].hash, name);
+	tn->mode = 0755;
+	tn->filetype = FILE_TYPE_DIRECTORY;
+
+	h = tn->hash & (idx->hsize - 1);
+	tn->hnext = idx->hash[h];
+	idx->hash[h] = i;
+
+	if(idx->node[parent].last)
+		idx->node[idx->node[parent].last].next = i;
+	else
+		idx->node[parent].child = i;
+	idx->node[parent].last = i;
+
+	return tn;
+}
 
-	if(!path || !perfix || !name)
-		return FALSE;
+/*
+ * Find the entry of a path, creating it and any missing parent
+ * directory on the way, "" and "." give the root
+ */
+static struct tar_node_t * tar_index_node(struct tar_index_t * idx, char * path)
+{
+	struct tar_node_t * tn;
+	char * p, * q;
+	u32_t i = 0;
 
-	path1[0] = path2[0] = '\0';
+	for(p = path; p; p = q)
+	{
+		q = strchr(p, '/');
+		if(q)
+			*q++ = '\0';
+		if((p[0] == '\0') || (strcmp(p, ".") == 0))
+			continue;
+		tn = tar_index_search(idx, i, p);
+		if(!tn && !(tn = tar_index_add(idx, i, p)))
+			return NULL;
+		i = tn - idx->node;
+	}
+	return &idx->node[i];
+}
 
-	if(path[0] != '/')
-		strcpy(path1, (const char *)("/"));
-	strlcat(path1, path, sizeof(path1));
+static void tar_index_free(struct tar_index_t * idx)
+{
+	if(idx)
+	{
+		free(idx->node);
+		free(idx->strtab);
+		free(idx->hash);
+		free(idx);
+	}
+}
 
-	if(perfix[0] != '/')
-		strcpy(path2, (const char *)("/"));
-	strlcat(path2, perfix, sizeof(path2));
+static struct tar_index_t * tar_index_build(struct block_t * blk)
+{
+	struct tar_header_t * header, h;
+	struct tar_index_t * idx;
+	struct tar_node_t * tn;
+	char path[VFS_MAX_PATH];
+	u64_t capacity = block_capacity(blk);
+	u64_t off = 0, size;
+	bool_t longname = FALSE;
+	int l;
+
+	idx = malloc(sizeof(struct tar_index_t));
+	if(!idx)
+		return NULL;
+
+	idx->maxnode = 64;
+	idx->maxstrtab = 1024;
+	idx->hsize = 64;
+	idx->node = malloc(sizeof(struct tar_node_t) * idx->maxnode);
+	idx->strtab = malloc(idx->maxstrtab);
+	idx->hash = malloc(sizeof(u32_t) * idx->hsize);
+	if(!idx->node || !idx->strtab || !idx->hash)
+	{
+		tar_index_free(idx);
+		return NULL;
+	}
+	memset(idx->hash, 0, sizeof(u32_t) * idx->hsize);
+	memset(&idx->node[0], 0, sizeof(struct tar_node_t));
+	idx->node[0].hash = 5381;
+	idx->node[0].mode = 0755;
+	idx->node[0].filetype = FILE_TYPE_DIRECTORY;
+	idx->strtab[0] = '\0';
+	idx->nstrtab = 1;
+	idx->nnode = 1;
+	idx->image = block_mmap(blk, 0, capacity);
+
+	/* Walk the headers once, reading them in place if possible */
+	while(off + sizeof(struct tar_header_t) <= capacity)
+	{
+		if(idx->image)
+			header = (struct tar_header_t *)(idx->image + off);
+		else if(block_read(blk, (u8_t *)&h, off, sizeof(struct tar_header_t)) == sizeof(struct tar_header_t))
+			header = &h;
+		else
+			break;
 
-	if(path2[strlen(path2) - 1] != '/')
-		strlcat(path2, (const char *)"/", sizeof(path2));
-	strlcat(path2, (const char *)name, sizeof(path2));
+		if((header->name[0] == '\0') || (strncmp((const char *)(header->magic), "ustar", 5) != 0))
+			break;
+
+		size = tar_number(header->size, sizeof(header->size));
+		off += sizeof(struct tar_header_t);
+
+		/* Keep the data of a truncated archive inside the device */
+		if(size > capacity - off)
+			size = capacity - off;
 
-	l = strlen(path2);
-	if(memcmp(path1, path2, l) != 0)
-		return FALSE;
+		/* GNU long name, the data is the name of next entry */
+		if(header->filetype == 'L')
+		{
+			l = min(size, (u64_t)(sizeof(path) - 1));
+			if(idx->image)
+				memcpy(path, idx->image + off, l);
+			else if(block_read(blk, (u8_t *)path, off, l) != l)
+				break;
+			path[l] = '\0';
+			longname = TRUE;
+		}
+		else if((header->filetype != 'K') && (header->filetype != 'x') && (header->filetype != 'g'))
+		{
+			if(!longname)
+			{
+				if(header->prefix[0] != '\0')
+				{
+					l = strnlen((const char *)header->prefix, sizeof(header->prefix));
+					memcpy(path, header->prefix, l);
+					path[l++] = '/';
+				}
+				else
+				{
+					l = 0;
+				}
+				memcpy(&path[l], header->name, sizeof(header->name));
+				path[l + strnlen((const char *)header->name, sizeof(header->name))] = '\0';
+			}
+			longname = FALSE;
+
+			tn = tar_index_node(idx, path);
+			if(!tn)
+			{
+				tar_index_free(idx);
+				return NULL;
+			}
+			if(tn != &idx->node[0])
+			{
+				tn->offset = off;
+				tn->size = size;
+				tn->mode = tar_number(header->mode, sizeof(header->mode));
+				tn->mtime = tar_number(header->mtime, sizeof(header->mtime));
+				tn->filetype = header->filetype;
+			}
+		}
 
-	p = &path1[l];
-	if(*p == '\0')
-		return TRUE;
-	if(*p == '/')
-		p++;
-	if(*p == '\0')
-		return TRUE;
+		off += (size + 511) & ~511;
+	}
 
-	return FALSE;
+	return idx;
 }
 
 static int tar_mount(struct vfs_mount_t * m, const char * dev)
 {
 	struct tar_header_t header;
+	struct tar_index_t * idx;
 	u64_t rd;
 
 	if(dev == NULL)
@@ -191,15 +420,20 @@ static int tar_mount(struct vfs_mount_t * m, const char * dev)
 	if(strncmp((const char *)(header.magic), "ustar", 5) != 0)
 		return -1;
 
+	idx = tar_index_build(m->m_dev);
+	if(!idx)
+		return -1;
+
 	m->m_flags |= MOUNT_RO;
-	m->m_root->v_data = NULL;
-	m->m_data = NULL;
+	m->m_root->v_data = &idx->node[0];
+	m->m_data = idx;
 
 	return 0;
 }
 
 static int tar_unmount(struct vfs_mount_t * m)
 {
+	tar_index_free(m->m_data);
 	m->m_data = NULL;
 	return 0;
 }
@@ -221,7 +455,8 @@ static int tar_vput(struct vfs_mount_t * m, struct vfs_node_t * n)
 
 static u64_t tar_read(struct vfs_node_t * n, s64_t off, void * buf, u64_t len)
 {
-	u64_t toff;
+	struct tar_index_t * idx = (struct tar_index_t *)n->v_mount->m_data;
+	struct tar_node_t * tn = (struct tar_node_t *)n->v_data;
 	u64_t sz = 0;
 
 	if(n->v_type != VNT_REG)
@@ -234,8 +469,10 @@ static u64_t tar_read(struct vfs_node_t * n, s64_t off, void * buf, u64_t len)
 	if((n->v_size - off) < sz)
 		sz = n->v_size - off;
 
-	toff = (u64_t)((unsigned long)(n->v_data));
-	sz = block_read(n->v_mount->m_dev, (u8_t *)buf, (toff + off), sz);
+	if(idx->image)
+		memcpy(buf, &idx->image[tn->offset + off], sz);
+	else
+		sz = block_read(n->v_mount->m_dev, (u8_t *)buf, (tn->offset + off), sz);
 
 	return sz;
 }
@@ -257,40 +494,35 @@ static int tar_sync(struct vfs_node_t * n)
 
 static int tar_readdir(struct vfs_node_t * dn, s64_t off, struct vfs_dirent_t * d)
 {
-	struct tar_header_t header;
-	char name[VFS_MAX_NAME];
-	u64_t toff = 0, size, rd;
-	int i = 0;
-
-	while(1)
-	{
-		rd = block_read(dn->v_mount->m_dev, (u8_t *)&header, toff, sizeof(struct tar_header_t));
-		if(rd != sizeof(struct tar_header_t))
-			return -1;
-
-		if(strncmp((const char *)(header.magic), "ustar", 5) != 0)
-			return -1;
+	struct tar_index_t * idx = (struct tar_index_t *)dn->v_mount->m_data;
+	struct tar_node_t * dtn = (struct tar_node_t *)dn->v_data;
+	struct tar_node_t * tn;
+	u32_t i;
+	s64_t o;
 
-		size = strtoull((const char *)(header.size), NULL, 0);
-		if(size < 0)
-			return -1;
-
-		if(size == 0)
-			toff += sizeof(struct tar_header_t);
-		else
-			toff += sizeof(struct tar_header_t) + (((size + 512) >> 9) << 9);
-
-		if(!get_next_token((const char *)header.name, dn->v_path, name))
-			continue;
+	if(!idx || !dtn || (off < 0))
+		return -1;
 
-		if(i++ == off)
-		{
-			toff = 0;
-			break;
-		}
+	/* Go on from the last entry returned when listing in order */
+	if(dtn->cursor && (dtn->cursor_off <= off))
+	{
+		i = dtn->cursor;
+		o = dtn->cursor_off;
+	}
+	else
+	{
+		i = dtn->child;
+		o = 0;
 	}
+	for(; i && (o < off); o++)
+		i = idx->node[i].next;
+	if(!i)
+		return -1;
+	dtn->cursor = i;
+	dtn->cursor_off = off;
+	tn = &idx->node[i];
 
-	switch(header.filetype)
+	switch(tn->filetype)
 	{
 	case FILE_TYPE_NORMAL:
 		d->d_type = VDT_REG;
@@ -320,7 +552,7 @@ static int tar_readdir(struct vfs_node_t * dn, s64_t off, struct vfs_dirent_t *
 		d->d_type = VDT_REG;
 		break;
 	}
-	strlcpy(d->d_name, name, sizeof(d->d_name));
+	strlcpy(d->d_name, &idx->strtab[tn->name], sizeof(d->d_name));
 	d->d_off = off;
 	d->d_reclen = 1;
 
@@ -329,41 +561,24 @@ static int tar_readdir(struct vfs_node_t * dn, s64_t off, struct vfs_dirent_t *
 
 static int tar_lookup(struct vfs_node_t * dn, const char * name, struct vfs_node_t * n)
 {
-	struct tar_header_t header;
-	u64_t off = 0, size, rd;
-	u64_t mtime;
+	struct tar_index_t * idx = (struct tar_index_t *)dn->v_mount->m_data;
+	struct tar_node_t * dtn = (struct tar_node_t *)dn->v_data;
+	struct tar_node_t * tn;
 	u32_t mode;
-	char buf[9];
-
-	while(1)
-	{
-		rd = block_read(dn->v_mount->m_dev, (u8_t *)&header, off, sizeof(struct tar_header_t));
-		if(rd != sizeof(struct tar_header_t))
-			return -1;
-
-		if(strncmp((const char *)(header.magic), "ustar", 5) != 0)
-			return -1;
-
-		size = strtoull((const char *)(header.size), NULL, 0);
-		if(size < 0)
-			return -1;
 
-		if(check_path((const char *)(header.name), dn->v_path, name))
-			break;
+	if(!idx || !dtn)
+		return -1;
 
-		if(size == 0)
-			off += sizeof(struct tar_header_t);
-		else
-			off += sizeof(struct tar_header_t) + (((size + 512) >> 9) << 9);
-	}
+	tn = tar_index_search(idx, dtn - idx->node, name);
+	if(!tn)
+		return -1;
 
-	mtime = strtoull((const char *)(header.mtime), NULL, 0);
-	n->v_atime = mtime;
-	n->v_mtime = mtime;
-	n->v_ctime = mtime;
+	n->v_atime = tn->mtime;
+	n->v_mtime = tn->mtime;
+	n->v_ctime = tn->mtime;
 	n->v_mode = 0;
 
-	switch(header.filetype)
+	switch(tn->filetype)
 	{
 	case FILE_TYPE_NORMAL:
 		n->v_type = VNT_REG;
@@ -403,9 +618,7 @@ static int tar_lookup(struct vfs_node_t * dn, const char * name, struct vfs_node
 		break;
 	}
 
-	buf[8] = '\0';
-	memcpy(buf, (const char *)(header.mode), 8);
-	mode = strtoul(buf, NULL, 8);
+	mode = tn->mode;
 
 	if(mode & 00400)
 		n->v_mode |= S_IRUSR;
@@ -426,8 +639,8 @@ static int tar_lookup(struct vfs_node_t * dn, const char * name, struct vfs_node
 	if(mode & 00001)
 		n->v_mode |= S_IXOTH;
 
-	n->v_size = size;
-	n->v_data = (void *)((unsigned long)(off + sizeof(struct tar_header_t)));
+	n->v_size = tn->size;
+	n->v_data = (void *)tn;
 
 	return 0;
 }
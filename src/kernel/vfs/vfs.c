@@ -100,11 +100,33 @@ struct vfs_file_t {
 };
 
 static struct list_head mnt_list;
-static struct mutex_t mnt_list_lock;
+static struct rwlock_t mnt_list_lock;
 static struct vfs_file_t fd_file[VFS_MAX_FD];
 static struct mutex_t fd_file_lock;
 struct list_head node_list[VFS_NODE_HASH_SIZE];
-static struct mutex_t node_list_lock[VFS_NODE_HASH_SIZE];
+static struct rwlock_t node_list_lock[VFS_NODE_HASH_SIZE];
+
+/*
+ * Result of an earlier path walk. A node keeps the references taken by
+ * its walk, so the walk finds it again in node_list, and no node marks
+ * a path known not to exist
+ */
+struct vfs_dentry_t {
+	struct hlist_node d_hash;
+	struct list_head d_lru;
+	struct vfs_mount_t * d_mount;
+	struct vfs_node_t * d_node;
+	char d_path[];
+};
+
+static struct hlist_head dentry_hash[VFS_NODE_HASH_SIZE];
+static struct list_head dentry_lru;
+static struct mutex_t dentry_lock;
+static u64_t dentry_count;
+static atomic_t dentry_hit;
+static atomic_t dentry_miss;
+static atomic_t dentry_negative;
+static u64_t dentry_evict;
 
 static int count_match(const char * path, char * mount_root)
 {
@@ -139,7 +161,7 @@ static int vfs_findroot(const char * path, struct vfs_mount_t ** mp, char ** roo
 	if(!path || !mp || !root)
 		return -1;
 
-	mutex_lock(&mnt_list_lock);
+	rwlock_read_lock(&mnt_list_lock);
 	list_for_each_entry(pos, &mnt_list, m_link)
 	{
 		len = count_match(path, pos->m_path);
@@ -149,7 +171,7 @@ static int vfs_findroot(const char * path, struct vfs_mount_t ** mp, char ** roo
 			m = pos;
 		}
 	}
-	mutex_unlock(&mnt_list_lock);
+	rwlock_read_unlock(&mnt_list_lock);
 
 	if(!m)
 		return -1;
@@ -216,13 +238,15 @@ static u32_t vfs_node_hash(struct vfs_mount_t * m, const char * path)
 	return (val ^ (u32_t)((unsigned long)m)) & (VFS_NODE_HASH_SIZE - 1);
 }
 
+static KMEM_CACHE_DEFINE(__vfs_node_cache, "vfs_node", sizeof(struct vfs_node_t), 0, NULL, NULL);
+
 static struct vfs_node_t * vfs_node_get(struct vfs_mount_t * m, const char * path)
 {
 	struct vfs_node_t * n;
 	u32_t hash = vfs_node_hash(m, path);
 	int err;
 
-	if(!(n = calloc(1, sizeof(struct vfs_node_t))))
+	if(!(n = kmem_cache_zalloc(&__vfs_node_cache)))
 		return NULL;
 
 	init_list_head(&n->v_link);
@@ -231,7 +255,7 @@ static struct vfs_node_t * vfs_node_get(struct vfs_mount_t * m, const char * pat
 	atomic_set(&n->v_refcnt, 1);
 	if(strlcpy(n->v_path, path, sizeof(n->v_path)) >= sizeof(n->v_path))
 	{
-		free(n);
+		kmem_cache_free(&__vfs_node_cache, n);
 		return NULL;
 	}
 
@@ -240,14 +264,14 @@ static struct vfs_node_t * vfs_node_get(struct vfs_mount_t * m, const char * pat
 	mutex_unlock(&m->m_lock);
 	if(err)
 	{
-		free(n);
+		kmem_cache_free(&__vfs_node_cache, n);
 		return NULL;
 	}
 
 	atomic_add(&m->m_refcnt, 1);
-	mutex_lock(&node_list_lock[hash]);
+	rwlock_write_lock(&node_list_lock[hash]);
 	list_add(&n->v_link, &node_list[hash]);
-	mutex_unlock(&node_list_lock[hash]);
+	rwlock_write_unlock(&node_list_lock[hash]);
 
 	return n;
 }
@@ -258,7 +282,7 @@ static struct vfs_node_t * vfs_node_lookup(struct vfs_mount_t * m, const char *
 	u32_t hash = vfs_node_hash(m, path);
 	int found = 0;
 
-	mutex_lock(&node_list_lock[hash]);
+	rwlock_read_lock(&node_list_lock[hash]);
 	list_for_each_entry(n, &node_list[hash], v_link)
 	{
 		if((n->v_mount == m) && (!strncmp(n->v_path, path, VFS_MAX_PATH)))
@@ -267,7 +291,7 @@ static struct vfs_node_t * vfs_node_lookup(struct vfs_mount_t * m, const char *
 			break;
 		}
 	}
-	mutex_unlock(&node_list_lock[hash]);
+	rwlock_read_unlock(&node_list_lock[hash]);
 
 	if(!found)
 		return NULL;
@@ -289,16 +313,16 @@ static void vfs_node_put(struct vfs_node_t * n)
 		return;
 
 	hash = vfs_node_hash(n->v_mount, n->v_path);
-	mutex_lock(&node_list_lock[hash]);
+	rwlock_write_lock(&node_list_lock[hash]);
 	list_del(&n->v_link);
-	mutex_unlock(&node_list_lock[hash]);
+	rwlock_write_unlock(&node_list_lock[hash]);
 
 	mutex_lock(&n->v_mount->m_lock);
 	n->v_mount->m_fs->vput(n->v_mount, n);
 	mutex_unlock(&n->v_mount->m_lock);
 
 	atomic_sub(&n->v_mount->m_refcnt, 1);
-	free(n);
+	kmem_cache_free(&__vfs_node_cache, n);
 }
 
 static int vfs_node_stat(struct vfs_node_t * n, struct vfs_stat_t * st)
@@ -420,6 +444,164 @@ static void vfs_node_release(struct vfs_node_t * n)
 	vfs_node_put(m->m_root);
 }
 
+static struct vfs_dentry_t * vfs_dentry_search(struct vfs_mount_t * m, const char * path)
+{
+	struct vfs_dentry_t * d;
+
+	hlist_for_each_entry(d, &dentry_hash[vfs_node_hash(m, path)], d_hash)
+	{
+		if((d->d_mount == m) && !strcmp(d->d_path, path))
+			return d;
+	}
+	return NULL;
+}
+
+static void vfs_dentry_unlink(struct vfs_dentry_t * d, struct list_head * head)
+{
+	hlist_del(&d->d_hash);
+	list_move(&d->d_lru, head);
+	dentry_count--;
+}
+
+/*
+ * Free unlinked entries, called without dentry_lock as dropping a
+ * node goes down to the filesystem
+ */
+static void vfs_dentry_free(struct list_head * head)
+{
+	struct vfs_dentry_t * d, * n;
+
+	list_for_each_entry_safe(d, n, head, d_lru)
+	{
+		list_del(&d->d_lru);
+		if(d->d_node)
+			vfs_node_release(d->d_node);
+		free(d);
+	}
+}
+
+static void vfs_dentry_add(struct vfs_mount_t * m, const char * path, struct vfs_node_t * n)
+{
+	struct vfs_dentry_t * d;
+	struct list_head victim;
+	int len = strlen(path) + 1;
+
+	if(m->m_fs->flags & FS_NOCACHE)
+	{
+		if(n)
+			vfs_node_release(n);
+		return;
+	}
+
+	init_list_head(&victim);
+	mutex_lock(&dentry_lock);
+	if((d = vfs_dentry_search(m, path)))
+	{
+		list_move(&d->d_lru, &dentry_lru);
+		if(!d->d_node)
+		{
+			d->d_node = n;
+			n = NULL;
+		}
+	}
+	else if((d = malloc(sizeof(struct vfs_dentry_t) + len)))
+	{
+		d->d_mount = m;
+		d->d_node = n;
+		memcpy(d->d_path, path, len);
+		init_hlist_node(&d->d_hash);
+		hlist_add_head(&d->d_hash, &dentry_hash[vfs_node_hash(m, path)]);
+		list_add(&d->d_lru, &dentry_lru);
+		n = NULL;
+		if(++dentry_count > VFS_DENTRY_MAX)
+		{
+			vfs_dentry_unlink(list_last_entry(&dentry_lru, struct vfs_dentry_t, d_lru), &victim);
+			dentry_evict++;
+		}
+	}
+	mutex_unlock(&dentry_lock);
+
+	if(n)
+		vfs_node_release(n);
+	vfs_dentry_free(&victim);
+}
+
+static bool_t vfs_dentry_lookup(struct vfs_mount_t * m, const char * path)
+{
+	struct vfs_dentry_t * d;
+	bool_t negative = FALSE;
+
+	if(m->m_fs->flags & FS_NOCACHE)
+		return FALSE;
+
+	mutex_lock(&dentry_lock);
+	if((d = vfs_dentry_search(m, path)) && !d->d_node)
+	{
+		list_move(&d->d_lru, &dentry_lru);
+		negative = TRUE;
+	}
+	mutex_unlock(&dentry_lock);
+	atomic_add(negative ? &dentry_negative : &dentry_miss, 1);
+
+	return negative;
+}
+
+/*
+ * Drop the entries of a path and of everything below it, the root of
+ * a mount drops the whole mount
+ */
+static void vfs_dentry_purge(struct vfs_node_t * dn, const char * name)
+{
+	struct vfs_mount_t * m = dn->v_mount;
+	struct vfs_dentry_t * d, * n;
+	struct list_head victim;
+	char path[VFS_MAX_PATH];
+	int len;
+
+	if(name)
+		snprintf(path, sizeof(path), "%s/%s", (dn == m->m_root) ? "" : dn->v_path, name);
+	else
+		strlcpy(path, (dn == m->m_root) ? "" : dn->v_path, sizeof(path));
+	len = strlen(path);
+
+	init_list_head(&victim);
+	mutex_lock(&dentry_lock);
+	list_for_each_entry_safe(d, n, &dentry_lru, d_lru)
+	{
+		if((d->d_mount == m) && !strncmp(d->d_path, path, len) && ((d->d_path[len] == '\0') || (d->d_path[len] == '/')))
+			vfs_dentry_unlink(d, &victim);
+	}
+	mutex_unlock(&dentry_lock);
+
+	vfs_dentry_free(&victim);
+}
+
+/*
+ * Release a node after a successful walk, keeping it for the next walk
+ */
+static void vfs_dentry_release(struct vfs_node_t * n)
+{
+	if(n == n->v_mount->m_root)
+		vfs_node_release(n);
+	else
+		vfs_dentry_add(n->v_mount, n->v_path, n);
+}
+
+static ssize_t vfs_read_dentrystat(struct kobj_t * kobj, void * buf, size_t size)
+{
+	int len = 0;
+
+	len += sprintf((char *)buf + len, "hit: %d\r\n", atomic_get(&dentry_hit));
+	len += sprintf((char *)buf + len, "miss: %d\r\n", atomic_get(&dentry_miss));
+	len += sprintf((char *)buf + len, "negative: %d\r\n", atomic_get(&dentry_negative));
+	mutex_lock(&dentry_lock);
+	len += sprintf((char *)buf + len, "evict: %lld\r\n", dentry_evict);
+	len += sprintf((char *)buf + len, "entries: %lld/%d\r\n", dentry_count, VFS_DENTRY_MAX);
+	mutex_unlock(&dentry_lock);
+
+	return len;
+}
+
 static int vfs_node_acquire(const char * path, struct vfs_node_t ** np)
 {
 	struct vfs_mount_t * m;
@@ -460,6 +642,12 @@ static int vfs_node_acquire(const char * path, struct vfs_node_t ** np)
 		n = vfs_node_lookup(m, node);
 		if(n == NULL)
 		{
+			if(vfs_dentry_lookup(m, node))
+			{
+				vfs_dentry_release(dn);
+				return -1;
+			}
+
 			n = vfs_node_get(m, node);
 			if(n == NULL)
 			{
@@ -470,14 +658,27 @@ static int vfs_node_acquire(const char * path, struct vfs_node_t ** np)
 			mutex_lock(&n->v_lock);
 			mutex_lock(&dn->v_lock);
 			err = dn->v_mount->m_fs->lookup(dn, &node[j], n);
+			/* Creating a name purges under dn->v_lock, so this can not go stale */
+			if(err)
+				vfs_dentry_add(m, node, NULL);
 			mutex_unlock(&dn->v_lock);
 			mutex_unlock(&n->v_lock);
-			if(err || (*p == '/' && n->v_type != VNT_DIR))
+			if(err)
 			{
-				vfs_node_release(n);
+				vfs_node_put(n);
+				vfs_dentry_release(dn);
 				return err;
 			}
 		}
+		else
+		{
+			atomic_add(&dentry_hit, 1);
+		}
+		if((*p == '/') && (n->v_type != VNT_DIR))
+		{
+			vfs_dentry_release(n);
+			return -1;
+		}
 		dn = n;
 	}
 	*np = n;
@@ -508,6 +709,7 @@ void vfs_force_unmount(struct vfs_mount_t * m)
 		vfs_force_unmount(tm);
 	}
 	list_del(&m->m_link);
+	vfs_dentry_purge(m->m_root, NULL);
 
 	mutex_lock(&fd_file_lock);
 	for(i = 0; i < VFS_MAX_FD; i++)
@@ -525,7 +727,7 @@ void vfs_force_unmount(struct vfs_mount_t * m)
 
 	for(i = 0; i < VFS_NODE_HASH_SIZE; i++)
 	{
-		mutex_lock(&node_list_lock[i]);
+		rwlock_write_lock(&node_list_lock[i]);
 		while(1)
 		{
 			found = 0;
@@ -544,9 +746,9 @@ void vfs_force_unmount(struct vfs_mount_t * m)
 			mutex_lock(&n->v_mount->m_lock);
 			n->v_mount->m_fs->vput(n->v_mount, n);
 			mutex_unlock(&n->v_mount->m_lock);
-			free(n);
+			kmem_cache_free(&__vfs_node_cache, n);
 		}
-		mutex_unlock(&node_list_lock[i]);
+		rwlock_write_unlock(&node_list_lock[i]);
 	}
 
 	mutex_lock(&m->m_lock);
@@ -644,12 +846,12 @@ int vfs_mount(const char * dev, const char * dir, const char * fsname, u32_t fla
 	if(m->m_flags & MOUNT_RO)
 		m->m_root->v_mode &= ~(S_IWUSR|S_IWGRP|S_IWOTH);
 
-	mutex_lock(&mnt_list_lock);
+	rwlock_write_lock(&mnt_list_lock);
 	list_for_each_entry(tm, &mnt_list, m_link)
 	{
 		if(!strcmp(tm->m_path, dir) || ((dev != NULL) && (tm->m_dev == bdev)))
 		{
-			mutex_unlock(&mnt_list_lock);
+			rwlock_write_unlock(&mnt_list_lock);
 			mutex_lock(&m->m_lock);
 			m->m_fs->unmount(m);
 			mutex_unlock(&m->m_lock);
@@ -661,7 +863,7 @@ int vfs_mount(const char * dev, const char * dir, const char * fsname, u32_t fla
 		}
 	}
 	list_add(&m->m_link, &mnt_list);
-	mutex_unlock(&mnt_list_lock);
+	rwlock_write_unlock(&mnt_list_lock);
 
 	return 0;
 }
@@ -672,7 +874,7 @@ int vfs_unmount(const char * path)
 	int found;
 	int err;
 
-	mutex_lock(&mnt_list_lock);
+	rwlock_write_lock(&mnt_list_lock);
 	found = 0;
 	list_for_each_entry(m, &mnt_list, m_link)
 	{
@@ -684,16 +886,17 @@ int vfs_unmount(const char * path)
 	}
 	if(!found)
 	{
-		mutex_unlock(&mnt_list_lock);
+		rwlock_write_unlock(&mnt_list_lock);
 		return -1;
 	}
+	vfs_dentry_purge(m->m_root, NULL);
 	if(atomic_get(&m->m_refcnt) > 1)
 	{
-		mutex_unlock(&mnt_list_lock);
+		rwlock_write_unlock(&mnt_list_lock);
 		return -1;
 	}
 	list_del(&m->m_link);
-	mutex_unlock(&mnt_list_lock);
+	rwlock_write_unlock(&mnt_list_lock);
 
 	mutex_lock(&m->m_lock);
 	err = m->m_fs->msync(m);
@@ -714,14 +917,14 @@ int vfs_sync(void)
 {
 	struct vfs_mount_t * m;
 
-	mutex_lock(&mnt_list_lock);
+	rwlock_read_lock(&mnt_list_lock);
 	list_for_each_entry(m, &mnt_list, m_link)
 	{
 		mutex_lock(&m->m_lock);
 		m->m_fs->msync(m);
 		mutex_unlock(&m->m_lock);
 	}
-	mutex_unlock(&mnt_list_lock);
+	rwlock_read_unlock(&mnt_list_lock);
 
 	return 0;
 }
@@ -734,7 +937,7 @@ struct vfs_mount_t * vfs_mount_get(int index)
 	if(index < 0)
 		return NULL;
 
-	mutex_lock(&mnt_list_lock);
+	rwlock_read_lock(&mnt_list_lock);
 	list_for_each_entry(m, &mnt_list, m_link)
 	{
 		if(!index)
@@ -744,7 +947,7 @@ struct vfs_mount_t * vfs_mount_get(int index)
 		}
 		index--;
 	}
-	mutex_unlock(&mnt_list_lock);
+	rwlock_read_unlock(&mnt_list_lock);
 
 	if(!found)
 		return NULL;
@@ -756,12 +959,12 @@ int vfs_mount_count(void)
 	struct vfs_mount_t * m;
 	int ret = 0;
 
-	mutex_lock(&mnt_list_lock);
+	rwlock_read_lock(&mnt_list_lock);
 	list_for_each_entry(m, &mnt_list, m_link)
 	{
 		ret++;
 	}
-	mutex_unlock(&mnt_list_lock);
+	rwlock_read_unlock(&mnt_list_lock);
 
 	return ret;
 }
@@ -837,6 +1040,7 @@ int vfs_open(const char * path, u32_t flags, u32_t mode)
 			err = dn->v_mount->m_fs->create(dn, filename, mode);
 			if(!err)
 				err = dn->v_mount->m_fs->sync(dn);
+			vfs_dentry_purge(dn, filename);
 			mutex_unlock(&dn->v_lock);
 			vfs_node_release(dn);
 			if(err)
@@ -936,7 +1140,7 @@ int vfs_close(int fd)
 		mutex_unlock(&f->f_lock);
 		return err;
 	}
-	vfs_node_release(n);
+	vfs_dentry_release(n);
 	mutex_unlock(&f->f_lock);
 
 	vfs_fd_free(fd);
@@ -1331,6 +1535,7 @@ int vfs_mkdir(const char * path, u32_t mode)
 	err = dn->v_mount->m_fs->sync(dn);
 
 fail:
+	vfs_dentry_purge(dn, name);
 	mutex_unlock(&dn->v_lock);
 	vfs_node_release(dn);
 
@@ -1379,6 +1584,7 @@ int vfs_rmdir(const char * path)
 	if((err = vfs_node_acquire(path, &n)))
 		return err;
 
+	vfs_dentry_purge(n, NULL);
 	if((n->v_flags == VNF_ROOT) || (atomic_get(&n->v_refcnt) >= 2))
 	{
 		vfs_node_release(n);
@@ -1440,6 +1646,7 @@ int vfs_rename(const char * src, const char * dst)
 	if((err = vfs_node_access(n1, W_OK)))
 		goto fail1;
 
+	vfs_dentry_purge(n1, NULL);
 	if(atomic_get(&n1->v_refcnt) >= 2)
 	{
 		err = -1;
@@ -1484,6 +1691,7 @@ int vfs_rename(const char * src, const char * dst)
 		err = dn->v_mount->m_fs->sync(dn);
 
 fail4:
+	vfs_dentry_purge(dn, dname);
 	if(dn != sn)
 		mutex_unlock(&dn->v_lock);
 	mutex_unlock(&sn->v_lock);
@@ -1516,6 +1724,7 @@ int vfs_unlink(const char * path)
 		return -1;
 	}
 
+	vfs_dentry_purge(n, NULL);
 	if((n->v_flags == VNF_ROOT) || (atomic_get(&n->v_refcnt) >= 2))
 	{
 		vfs_node_release(n);
@@ -1571,7 +1780,7 @@ int vfs_access(const char * path, u32_t mode)
 		return err;
 
 	err = vfs_node_access(n, mode);
-	vfs_node_release(n);
+	vfs_dentry_release(n);
 
 	return err;
 }
@@ -1613,7 +1822,7 @@ int vfs_stat(const char * path, struct vfs_stat_t * st)
 	if((err = vfs_node_acquire(path, &n)))
 		return err;
 	err = vfs_node_stat(n, st);
-	vfs_node_release(n);
+	vfs_dentry_release(n);
 
 	return err;
 }
@@ -1623,7 +1832,7 @@ void do_init_vfs(void)
 	int i;
 
 	init_list_head(&mnt_list);
-	mutex_init(&mnt_list_lock);
+	rwlock_init(&mnt_list_lock);
 
 	for(i = 0; i < VFS_MAX_FD; i++)
 	{
@@ -1637,6 +1846,12 @@ void do_init_vfs(void)
 	for(i = 0; i < VFS_NODE_HASH_SIZE; i++)
 	{
 		init_list_head(&node_list[i]);
-		mutex_init(&node_list_lock[i]);
+		rwlock_init(&node_list_lock[i]);
 	}
+
+	for(i = 0; i < VFS_NODE_HASH_SIZE; i++)
+		init_hlist_head(&dentry_hash[i]);
+	init_list_head(&dentry_lru);
+	mutex_init(&dentry_lock);
+	kobj_add_regular(search_class_filesystem_kobj(), "dentrystat", vfs_read_dentrystat, NULL, NULL);
 }
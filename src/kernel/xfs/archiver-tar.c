@@ -137,7 +137,7 @@ static struct fhandle_tar_t * search_fhandle(struct mhandle_tar_t * m, const cha
 static struct mhandle_tar_t * alloc_mhandle(int fd)
 {
 	struct mhandle_tar_t * m;
-	struct fhandle_tar_t * f;
+	struct fhandle_tar_t * f, * n;
 	struct tar_header_t header;
 	int64_t off;
 	int64_t size;
@@ -145,46 +145,14 @@ static struct mhandle_tar_t * alloc_mhandle(int fd)
 	int i, l;
 	char * p;
 
-	off = 0;
-	while(1)
-	{
-		vfs_lseek(fd, off, VFS_SEEK_SET);
-		if(vfs_read(fd, &header, sizeof(struct tar_header_t)) != sizeof(struct tar_header_t))
-			break;
-		if(strncmp((const char *)(header.magic), "ustar", 5) != 0)
-			break;
-
-		size = strtoll((const char *)(header.size), NULL, 0);
-		if(size < 0)
-			break;
-
-		if((header.filetype == FILE_TYPE_NORMAL) || (header.filetype == FILE_TYPE_DIRECTORY))
-			hsize++;
-
-		if(size == 0)
-			off += sizeof(struct tar_header_t);
-		else
-			off += sizeof(struct tar_header_t) + (((size + 512) >> 9) << 9);
-	}
-	if(hsize == 0)
-		return NULL;
-
 	m = malloc(sizeof(struct mhandle_tar_t));
 	if(!m)
 		return NULL;
 
-	m->hsize = hsize * 2;
 	m->fd = fd;
-	m->hash = malloc(sizeof(struct hlist_head) * m->hsize);
-	if(!m->hash)
-	{
-		free(m);
-		return NULL;
-	}
 	init_list_head(&m->list);
-	for(i = 0; i < m->hsize; i++)
-		init_hlist_head(&m->hash[i]);
 
+	/* Collect the entries in one pass, the hash is sized afterwards */
 	off = 0;
 	while(1)
 	{
@@ -218,15 +186,29 @@ static struct mhandle_tar_t * alloc_mhandle(int fd)
 			init_list_head(&f->head);
 			list_add_tail(&f->head, &m->list);
 			init_hlist_node(&f->node);
-			hlist_add_head(&f->node, fhandle_hash(m, f->name));
+			hsize++;
 		}
 
-		if(size == 0)
-			off += sizeof(struct tar_header_t);
-		else
-			off += sizeof(struct tar_header_t) + (((size + 512) >> 9) << 9);
+		off += sizeof(struct tar_header_t) + ((size + 511) & ~511);
 	}
 
+	m->hsize = hsize * 2;
+	m->hash = (hsize > 0) ? malloc(sizeof(struct hlist_head) * m->hsize) : NULL;
+	if(!m->hash)
+	{
+		list_for_each_entry_safe(f, n, &m->list, head)
+		{
+			free(f->name);
+			free(f);
+		}
+		free(m);
+		return NULL;
+	}
+	for(i = 0; i < m->hsize; i++)
+		init_hlist_head(&m->hash[i]);
+	list_for_each_entry(f, &m->list, head)
+		hlist_add_head(&f->node, fhandle_hash(m, f->name));
+
 	return m;
 }
 
@@ -5,9 +5,14 @@
 #include <xconfigs.h>
 #include <assert.h>
 #include <spinlock.h>
+#include <irqflags.h>
+#include <smp.h>
 #include <string.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <malloc.h>
+#include <xboot/ktime.h>
+#include <clocksource/clocksource.h>
 #include <xboot/kobj.h>
 #include <xboot/module.h>
 
@@ -820,19 +825,547 @@ void mm_info(void * mm, size_t * mused, size_t * mfree)
 static void * __heap_pool = NULL;
 static spinlock_t __heap_lock = SPIN_LOCK_INIT();
 
-static void * __malloc(size_t size)
+#if defined(CONFIG_MALLOC_CACHE) && (CONFIG_MALLOC_CACHE > 0)
+/*
+ * Per cpu magazines of small blocks in front of the heap. Cached blocks are
+ * still used blocks for tlsf, they are refilled and drained in batches so
+ * that the heap lock is taken once per batch instead of once per call.
+ * The magazine lock is only contended when the heap runs dry and another
+ * cpu reclaims it.
+ */
+#define MALLOC_CACHE_CLASSES	(11)
+#define MALLOC_CACHE_MAX		(1024)
+#define MALLOC_CACHE_DEPTH		(CONFIG_MALLOC_CACHE_DEPTH)
+#define MALLOC_CACHE_BATCH		(CONFIG_MALLOC_CACHE_DEPTH / 2)
+
+struct malloc_cache_t {
+	spinlock_t lock;
+	void * objs[MALLOC_CACHE_CLASSES][MALLOC_CACHE_DEPTH];
+	int count[MALLOC_CACHE_CLASSES];
+	size_t cached;
+	u64_t hit;
+	u64_t miss;
+	u64_t refill;
+	u64_t drain;
+};
+
+static const size_t malloc_cache_size[MALLOC_CACHE_CLASSES] = {
+	32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024,
+};
+static signed char malloc_cache_alloc_index[(MALLOC_CACHE_MAX >> 4) + 1];
+static signed char malloc_cache_free_index[(MALLOC_CACHE_MAX >> 4) + 1];
+static struct malloc_cache_t __malloc_cache[CONFIG_MAX_SMP_CPUS];
+
+static void malloc_cache_init(void)
+{
+	int i, c;
+
+	for(i = 0; i <= (MALLOC_CACHE_MAX >> 4); i++)
+	{
+		malloc_cache_alloc_index[i] = -1;
+		for(c = 0; c < MALLOC_CACHE_CLASSES; c++)
+		{
+			if(malloc_cache_size[c] >= (i << 4))
+			{
+				malloc_cache_alloc_index[i] = c;
+				break;
+			}
+		}
+		malloc_cache_free_index[i] = -1;
+		for(c = MALLOC_CACHE_CLASSES - 1; c >= 0; c--)
+		{
+			if(malloc_cache_size[c] <= (i << 4))
+			{
+				malloc_cache_free_index[i] = c;
+				break;
+			}
+		}
+	}
+	memset(__malloc_cache, 0, sizeof(__malloc_cache));
+	for(i = 0; i < CONFIG_MAX_SMP_CPUS; i++)
+		spin_lock_init(&__malloc_cache[i].lock);
+}
+
+static inline int malloc_cache_refill(struct malloc_cache_t * mc, int c)
+{
+	void * m;
+	int i;
+
+	spin_lock(&__heap_lock);
+	for(i = 0; i < MALLOC_CACHE_BATCH; i++)
+	{
+		m = tlsf_malloc(__heap_pool, malloc_cache_size[c]);
+		if(!m)
+			break;
+		mc->objs[c][mc->count[c]++] = m;
+		mc->cached += block_get_size(block_from_ptr(m));
+	}
+	spin_unlock(&__heap_lock);
+	mc->refill++;
+
+	return i;
+}
+
+static inline void malloc_cache_drain(struct malloc_cache_t * mc, int c, int n)
+{
+	void * m;
+	int i;
+
+	if(n > mc->count[c])
+		n = mc->count[c];
+	spin_lock(&__heap_lock);
+	for(i = 0; i < n; i++)
+	{
+		m = mc->objs[c][i];
+		mc->cached -= block_get_size(block_from_ptr(m));
+		tlsf_free(__heap_pool, m);
+	}
+	spin_unlock(&__heap_lock);
+	mc->count[c] -= n;
+	if(mc->count[c] > 0)
+		memmove(&mc->objs[c][0], &mc->objs[c][n], mc->count[c] * sizeof(void *));
+	mc->drain++;
+}
+
+static void * malloc_cache_alloc(size_t size)
+{
+	struct malloc_cache_t * mc;
+	irq_flags_t flags;
+	void * m = NULL;
+	int c;
+
+	c = malloc_cache_alloc_index[(size + 15) >> 4];
+	if(c < 0)
+		return NULL;
+	local_irq_save(flags);
+	mc = &__malloc_cache[smp_processor_id()];
+	spin_lock(&mc->lock);
+	if(mc->count[c] > 0)
+		mc->hit++;
+	else
+	{
+		mc->miss++;
+		malloc_cache_refill(mc, c);
+	}
+	if(mc->count[c] > 0)
+	{
+		m = mc->objs[c][--mc->count[c]];
+		mc->cached -= block_get_size(block_from_ptr(m));
+	}
+	spin_unlock(&mc->lock);
+	local_irq_restore(flags);
+
+	return m;
+}
+
+static int malloc_cache_free(void * ptr)
+{
+	struct malloc_cache_t * mc;
+	irq_flags_t flags;
+	size_t size = block_get_size(block_from_ptr(ptr));
+	int c;
+
+	if(size > MALLOC_CACHE_MAX)
+		return 0;
+	c = malloc_cache_free_index[size >> 4];
+	if(c < 0)
+		return 0;
+	local_irq_save(flags);
+	mc = &__malloc_cache[smp_processor_id()];
+	spin_lock(&mc->lock);
+	if(mc->count[c] >= MALLOC_CACHE_DEPTH)
+		malloc_cache_drain(mc, c, MALLOC_CACHE_BATCH);
+	mc->objs[c][mc->count[c]++] = ptr;
+	mc->cached += size;
+	spin_unlock(&mc->lock);
+	local_irq_restore(flags);
+
+	return 1;
+}
+
+/*
+ * Give every cached block back to the heap, only used when the heap is
+ * exhausted, so this cpu drains the magazines of the others too under
+ * their magazine lock.
+ */
+static int malloc_cache_reclaim(void)
+{
+	struct malloc_cache_t * mc;
+	irq_flags_t flags;
+	int n = 0;
+	int i, c;
+
+	for(i = 0; i < CONFIG_MAX_SMP_CPUS; i++)
+	{
+		mc = &__malloc_cache[i];
+		spin_lock_irqsave(&mc->lock, flags);
+		for(c = 0; c < MALLOC_CACHE_CLASSES; c++)
+		{
+			if(mc->count[c] > 0)
+			{
+				n += mc->count[c];
+				malloc_cache_drain(mc, c, mc->count[c]);
+			}
+		}
+		spin_unlock_irqrestore(&mc->lock, flags);
+	}
+	return n;
+}
+
+static size_t malloc_cache_cached(void)
+{
+	size_t cached = 0;
+	int i;
+
+	for(i = 0; i < CONFIG_MAX_SMP_CPUS; i++)
+		cached += __malloc_cache[i].cached;
+	return cached;
+}
+#endif
+
+#if defined(CONFIG_MALLOC_PROFILE) && (CONFIG_MALLOC_PROFILE > 0)
+/*
+ * Heap profiling keeps a record of every live block in a hash table keyed
+ * by address. Records, site tables and snapshots are taken straight from
+ * tlsf, so the profiler never profiles itself.
+ */
+#define MALLOC_PROFILE_HASH_SIZE	(4096)
+#define MALLOC_PROFILE_CHUNK		(256)
+#define MALLOC_PROFILE_SITES		(1024)
+#define MALLOC_PROFILE_SNAPSHOTS	(4)
+
+struct malloc_record_t {
+	struct malloc_record_t * next;
+	void * ptr;
+	void * caller;
+	size_t size;
+	u64_t ts;
+};
+
+struct malloc_snapshot_t {
+	struct malloc_site_t * sites;
+	int nsites;
+};
+
+static struct malloc_record_t ** __malloc_profile_hash = NULL;
+static struct malloc_record_t * __malloc_profile_free = NULL;
+static struct malloc_snapshot_t __malloc_profile_snapshot[MALLOC_PROFILE_SNAPSHOTS];
+static spinlock_t __malloc_profile_lock = SPIN_LOCK_INIT();
+
+static inline u32_t malloc_profile_hash(void * ptr)
+{
+	unsigned long v = (unsigned long)ptr >> ALIGN_SIZE_LOG2;
+	return (u32_t)((v ^ (v >> 12)) & (MALLOC_PROFILE_HASH_SIZE - 1));
+}
+
+static void * malloc_profile_raw_alloc(size_t size)
+{
+	void * m;
+
+	spin_lock(&__heap_lock);
+	m = tlsf_malloc(__heap_pool, size);
+	spin_unlock(&__heap_lock);
+	return m;
+}
+
+static void malloc_profile_raw_free(void * m)
+{
+	spin_lock(&__heap_lock);
+	tlsf_free(__heap_pool, m);
+	spin_unlock(&__heap_lock);
+}
+
+static void malloc_profile_add(void * ptr, size_t size, void * caller)
+{
+	struct malloc_record_t * r;
+	u32_t h;
+	int i;
+
+	if(!ptr || !__malloc_profile_hash)
+		return;
+
+	spin_lock(&__malloc_profile_lock);
+	if(!__malloc_profile_free)
+	{
+		r = malloc_profile_raw_alloc(sizeof(struct malloc_record_t) * MALLOC_PROFILE_CHUNK);
+		if(r)
+		{
+			for(i = 0; i < MALLOC_PROFILE_CHUNK; i++)
+			{
+				r[i].next = __malloc_profile_free;
+				__malloc_profile_free = &r[i];
+			}
+		}
+	}
+	r = __malloc_profile_free;
+	if(r)
+	{
+		__malloc_profile_free = r->next;
+		h = malloc_profile_hash(ptr);
+		r->ptr = ptr;
+		r->caller = caller;
+		r->size = size;
+		r->ts = ktime_to_ns(ktime_get());
+		r->next = __malloc_profile_hash[h];
+		__malloc_profile_hash[h] = r;
+	}
+	spin_unlock(&__malloc_profile_lock);
+}
+
+static void malloc_profile_del(void * ptr)
+{
+	struct malloc_record_t ** pr, * r;
+
+	if(!ptr || !__malloc_profile_hash)
+		return;
+
+	spin_lock(&__malloc_profile_lock);
+	for(pr = &__malloc_profile_hash[malloc_profile_hash(ptr)]; (r = *pr); pr = &r->next)
+	{
+		if(r->ptr == ptr)
+		{
+			*pr = r->next;
+			r->next = __malloc_profile_free;
+			__malloc_profile_free = r;
+			break;
+		}
+	}
+	spin_unlock(&__malloc_profile_lock);
+}
+
+static void malloc_profile_retag(void * ptr, void * caller)
+{
+	struct malloc_record_t * r;
+
+	if(!ptr || !__malloc_profile_hash)
+		return;
+
+	spin_lock(&__malloc_profile_lock);
+	for(r = __malloc_profile_hash[malloc_profile_hash(ptr)]; r; r = r->next)
+	{
+		if(r->ptr == ptr)
+		{
+			r->caller = caller;
+			break;
+		}
+	}
+	spin_unlock(&__malloc_profile_lock);
+}
+
+static int malloc_site_compare(const void * a, const void * b)
+{
+	const struct malloc_site_t * sa = a;
+	const struct malloc_site_t * sb = b;
+	ssize_t x = (sa->bytes < 0) ? -sa->bytes : sa->bytes;
+	ssize_t y = (sb->bytes < 0) ? -sb->bytes : sb->bytes;
+
+	if(x > y)
+		return -1;
+	else if(x < y)
+		return 1;
+	return 0;
+}
+
+/*
+ * Group the live records by call site into a table sorted by bytes, sites
+ * that don't fit are folded into a last entry with a null caller.
+ */
+static struct malloc_site_t * malloc_profile_collect(int * nsites)
+{
+	struct malloc_site_t * sites, * st, other;
+	struct malloc_record_t * r;
+	unsigned long h;
+	int used = 0, n = 0;
+	int i;
+
+	sites = malloc_profile_raw_alloc(sizeof(struct malloc_site_t) * (MALLOC_PROFILE_SITES + 1));
+	if(!sites)
+		return NULL;
+	memset(sites, 0, sizeof(struct malloc_site_t) * (MALLOC_PROFILE_SITES + 1));
+	memset(&other, 0, sizeof(struct malloc_site_t));
+	other.oldest = ~0ULL;
+
+	spin_lock(&__malloc_profile_lock);
+	for(i = 0; i < MALLOC_PROFILE_HASH_SIZE; i++)
+	{
+		for(r = __malloc_profile_hash[i]; r; r = r->next)
+		{
+			h = ((unsigned long)r->caller >> 2) & (MALLOC_PROFILE_SITES - 1);
+			while(sites[h].count && (sites[h].caller != r->caller))
+				h = (h + 1) & (MALLOC_PROFILE_SITES - 1);
+			st = &sites[h];
+			if(!st->count)
+			{
+				if(used >= MALLOC_PROFILE_SITES - MALLOC_PROFILE_SITES / 8)
+					st = &other;
+				else
+				{
+					st->caller = r->caller;
+					st->oldest = r->ts;
+					used++;
+				}
+			}
+			st->count++;
+			st->bytes += r->size;
+			if(r->ts < st->oldest)
+				st->oldest = r->ts;
+		}
+	}
+	spin_unlock(&__malloc_profile_lock);
+
+	for(i = 0; i < MALLOC_PROFILE_SITES; i++)
+	{
+		if(sites[i].count)
+			sites[n++] = sites[i];
+	}
+	qsort(sites, n, sizeof(struct malloc_site_t), malloc_site_compare);
+	if(other.count)
+		sites[n++] = other;
+	*nsites = n;
+	return sites;
+}
+
+int malloc_profile_top(struct malloc_site_t * sites, int n)
+{
+	struct malloc_site_t * all;
+	int nsites;
+
+	if(!sites || (n <= 0) || !(all = malloc_profile_collect(&nsites)))
+		return 0;
+	if(n > nsites)
+		n = nsites;
+	memcpy(sites, all, sizeof(struct malloc_site_t) * n);
+	malloc_profile_raw_free(all);
+	return n;
+}
+
+int malloc_profile_snapshot(int slot)
+{
+	struct malloc_snapshot_t * ss;
+	struct malloc_site_t * sites;
+	int nsites;
+
+	if((slot < 0) || (slot >= MALLOC_PROFILE_SNAPSHOTS))
+		return -1;
+	if(!(sites = malloc_profile_collect(&nsites)))
+		return -1;
+	ss = &__malloc_profile_snapshot[slot];
+	if(ss->sites)
+		malloc_profile_raw_free(ss->sites);
+	ss->sites = sites;
+	ss->nsites = nsites;
+	return nsites;
+}
+
+/*
+ * Compare two snapshots site by site, sites that grow between them are
+ * the usual suspects of a leak.
+ */
+int malloc_profile_diff(int a, int b, struct malloc_site_t * sites, int n)
+{
+	struct malloc_snapshot_t * sa, * sb;
+	struct malloc_site_t * d;
+	int nd = 0;
+	int i, j, found;
+
+	if((a < 0) || (a >= MALLOC_PROFILE_SNAPSHOTS) || (b < 0) || (b >= MALLOC_PROFILE_SNAPSHOTS))
+		return -1;
+	sa = &__malloc_profile_snapshot[a];
+	sb = &__malloc_profile_snapshot[b];
+	if(!sa->sites || !sb->sites || !sites || (n <= 0))
+		return -1;
+	if(!(d = malloc_profile_raw_alloc(sizeof(struct malloc_site_t) * (sa->nsites + sb->nsites))))
+		return -1;
+
+	for(i = 0; i < sb->nsites; i++)
+	{
+		d[nd] = sb->sites[i];
+		for(j = 0; j < sa->nsites; j++)
+		{
+			if(sa->sites[j].caller == sb->sites[i].caller)
+			{
+				d[nd].count -= sa->sites[j].count;
+				d[nd].bytes -= sa->sites[j].bytes;
+				break;
+			}
+		}
+		if(d[nd].count || d[nd].bytes)
+			nd++;
+	}
+	for(j = 0; j < sa->nsites; j++)
+	{
+		for(i = 0, found = 0; i < sb->nsites; i++)
+		{
+			if(sa->sites[j].caller == sb->sites[i].caller)
+			{
+				found = 1;
+				break;
+			}
+		}
+		if(!found)
+		{
+			d[nd] = sa->sites[j];
+			d[nd].count = -d[nd].count;
+			d[nd].bytes = -d[nd].bytes;
+			nd++;
+		}
+	}
+	qsort(d, nd, sizeof(struct malloc_site_t), malloc_site_compare);
+	if(n > nd)
+		n = nd;
+	memcpy(sites, d, sizeof(struct malloc_site_t) * n);
+	malloc_profile_raw_free(d);
+	return n;
+}
+
+static void malloc_profile_init(void)
+{
+	int i;
+
+	__malloc_profile_hash = malloc_profile_raw_alloc(sizeof(struct malloc_record_t *) * MALLOC_PROFILE_HASH_SIZE);
+	if(__malloc_profile_hash)
+	{
+		for(i = 0; i < MALLOC_PROFILE_HASH_SIZE; i++)
+			__malloc_profile_hash[i] = NULL;
+	}
+	memset(__malloc_profile_snapshot, 0, sizeof(__malloc_profile_snapshot));
+}
+#endif
+
+static inline void * __malloc_nocaller(size_t size)
 {
 	void * m;
 
 	if(__heap_pool)
 	{
+#if defined(CONFIG_MALLOC_CACHE) && (CONFIG_MALLOC_CACHE > 0)
+		if((size > 0) && (size <= MALLOC_CACHE_MAX) && (m = malloc_cache_alloc(size)))
+			return m;
+#endif
 		spin_lock(&__heap_lock);
 		m = tlsf_malloc(__heap_pool, size);
 		spin_unlock(&__heap_lock);
+#if defined(CONFIG_MALLOC_CACHE) && (CONFIG_MALLOC_CACHE > 0)
+		if(!m && malloc_cache_reclaim())
+		{
+			spin_lock(&__heap_lock);
+			m = tlsf_malloc(__heap_pool, size);
+			spin_unlock(&__heap_lock);
+		}
+#endif
 		return m;
 	}
 	return NULL;
 }
+
+static void * __malloc(size_t size)
+{
+	void * m = __malloc_nocaller(size);
+#if defined(CONFIG_MALLOC_PROFILE) && (CONFIG_MALLOC_PROFILE > 0)
+	malloc_profile_add(m, size, __builtin_return_address(0));
+#endif
+	return m;
+}
 extern __typeof(__malloc) malloc __attribute__((weak, alias("__malloc")));
 
 static void * __memalign(size_t align, size_t size)
@@ -844,6 +1377,17 @@ static void * __memalign(size_t align, size_t size)
 		spin_lock(&__heap_lock);
 		m = tlsf_memalign(__heap_pool, align, size);
 		spin_unlock(&__heap_lock);
+#if defined(CONFIG_MALLOC_CACHE) && (CONFIG_MALLOC_CACHE > 0)
+		if(!m && malloc_cache_reclaim())
+		{
+			spin_lock(&__heap_lock);
+			m = tlsf_memalign(__heap_pool, align, size);
+			spin_unlock(&__heap_lock);
+		}
+#endif
+#if defined(CONFIG_MALLOC_PROFILE) && (CONFIG_MALLOC_PROFILE > 0)
+		malloc_profile_add(m, size, __builtin_return_address(0));
+#endif
 		return m;
 	}
 	return NULL;
@@ -856,9 +1400,26 @@ static void * __realloc(void * ptr, size_t size)
 
 	if(__heap_pool)
 	{
+#if defined(CONFIG_MALLOC_PROFILE) && (CONFIG_MALLOC_PROFILE > 0)
+		malloc_profile_del(ptr);
+#endif
 		spin_lock(&__heap_lock);
 		m = tlsf_realloc(__heap_pool, ptr, size);
 		spin_unlock(&__heap_lock);
+#if defined(CONFIG_MALLOC_CACHE) && (CONFIG_MALLOC_CACHE > 0)
+		if(!m && (size > 0) && malloc_cache_reclaim())
+		{
+			spin_lock(&__heap_lock);
+			m = tlsf_realloc(__heap_pool, ptr, size);
+			spin_unlock(&__heap_lock);
+		}
+#endif
+#if defined(CONFIG_MALLOC_PROFILE) && (CONFIG_MALLOC_PROFILE > 0)
+		if(m)
+			malloc_profile_add(m, size, __builtin_return_address(0));
+		else if(ptr && (size > 0))
+			malloc_profile_add(ptr, block_get_size(block_from_ptr(ptr)), __builtin_return_address(0));
+#endif
 		return m;
 	}
 	return NULL;
@@ -870,7 +1431,12 @@ static void * __calloc(size_t nmemb, size_t size)
 	void * m;
 
 	if((m = malloc(nmemb * size)))
+	{
 		memset(m, 0, nmemb * size);
+#if defined(CONFIG_MALLOC_PROFILE) && (CONFIG_MALLOC_PROFILE > 0)
+		malloc_profile_retag(m, __builtin_return_address(0));
+#endif
+	}
 	return m;
 }
 extern __typeof(__calloc) calloc __attribute__((weak, alias("__calloc")));
@@ -879,6 +1445,13 @@ static void __free(void * ptr)
 {
 	if(__heap_pool)
 	{
+#if defined(CONFIG_MALLOC_PROFILE) && (CONFIG_MALLOC_PROFILE > 0)
+		malloc_profile_del(ptr);
+#endif
+#if defined(CONFIG_MALLOC_CACHE) && (CONFIG_MALLOC_CACHE > 0)
+		if(ptr && malloc_cache_free(ptr))
+			return;
+#endif
 		spin_lock(&__heap_lock);
 		tlsf_free(__heap_pool, ptr);
 		spin_unlock(&__heap_lock);
@@ -888,14 +1461,67 @@ extern __typeof(__free) free __attribute__((weak, alias("__free")));
 
 static void __meminfo(size_t * mused, size_t * mfree)
 {
+#if defined(CONFIG_MALLOC_CACHE) && (CONFIG_MALLOC_CACHE > 0)
+	size_t cached;
+#endif
+
 	if(__heap_pool)
 	{
 		if(mused && mfree)
+		{
+			spin_lock(&__heap_lock);
 			tlsf_info(mm_get(__heap_pool), mused, mfree);
+			spin_unlock(&__heap_lock);
+#if defined(CONFIG_MALLOC_CACHE) && (CONFIG_MALLOC_CACHE > 0)
+			cached = malloc_cache_cached();
+			*mused -= cached;
+			*mfree += cached;
+#endif
+		}
 	}
 }
 extern __typeof(__meminfo) meminfo __attribute__((weak, alias("__meminfo")));
 
+static void __malloc_frag(struct malloc_frag_t * f)
+{
+	control_t * control;
+	block_header_t * block;
+	size_t size;
+	int fl, sl, i;
+
+	if(!f)
+		return;
+	memset(f, 0, sizeof(struct malloc_frag_t));
+	if(__heap_pool)
+	{
+		control = tlsf_cast(control_t *, __heap_pool);
+		spin_lock(&__heap_lock);
+		for(fl = 0; fl < FL_INDEX_COUNT; fl++)
+		{
+			for(sl = 0; sl < SL_INDEX_COUNT; sl++)
+			{
+				for(block = control->blocks[fl][sl]; block && (block != &control->block_null); block = block->next_free)
+				{
+					size = block_get_size(block);
+					i = tlsf_fls_sizet(size);
+					if(i < 0)
+						i = 0;
+					else if(i >= MALLOC_FRAG_BUCKETS)
+						i = MALLOC_FRAG_BUCKETS - 1;
+					f->count[i]++;
+					f->bytes[i] += size;
+					f->nfree++;
+					f->tfree += size;
+					if(size > f->largest)
+						f->largest = size;
+				}
+			}
+		}
+		spin_unlock(&__heap_lock);
+	}
+}
+extern __typeof(__malloc_frag) malloc_frag __attribute__((weak, alias("__malloc_frag")));
+
 static struct kobj_t * search_class_memory_kobj(void)
 {
 	struct kobj_t * kclass = kobj_search_directory_with_create(kobj_get_root(), "class");
@@ -915,6 +1541,33 @@ static ssize_t memory_read_meminfo(struct kobj_t * kobj, void * buf, size_t size
 	return len;
 }
 
+#if defined(CONFIG_MALLOC_CACHE) && (CONFIG_MALLOC_CACHE > 0)
+static ssize_t memory_read_cache(struct kobj_t * kobj, void * buf, size_t size)
+{
+	struct malloc_cache_t * mc;
+	u64_t hit = 0, miss = 0, refill = 0, drain = 0;
+	char * p = buf;
+	int len = 0;
+	int i;
+
+	for(i = 0; i < CONFIG_MAX_SMP_CPUS; i++)
+	{
+		mc = &__malloc_cache[i];
+		hit += mc->hit;
+		miss += mc->miss;
+		refill += mc->refill;
+		drain += mc->drain;
+	}
+	len += sprintf((char *)(p + len), " cache hit: %llu\r\n", (unsigned long long)hit);
+	len += sprintf((char *)(p + len), " cache miss: %llu\r\n", (unsigned long long)miss);
+	len += sprintf((char *)(p + len), " cache hit rate: %llu%%\r\n", (hit + miss) ? (unsigned long long)(hit * 100 / (hit + miss)) : 0ULL);
+	len += sprintf((char *)(p + len), " cache refill: %llu\r\n", (unsigned long long)refill);
+	len += sprintf((char *)(p + len), " cache drain: %llu\r\n", (unsigned long long)drain);
+	len += sprintf((char *)(p + len), " cache cached: %ld\r\n", malloc_cache_cached());
+	return len;
+}
+#endif
+
 void do_init_mem(void)
 {
 #ifndef __SANDBOX__
@@ -922,6 +1575,16 @@ void do_init_mem(void)
 	extern unsigned char __heap_end[];
 	spin_lock_init(&__heap_lock);
 	__heap_pool = mm_create((void *)__heap_start, (size_t)(__heap_end - __heap_start));
+#endif
+#if defined(CONFIG_MALLOC_CACHE) && (CONFIG_MALLOC_CACHE > 0)
+	malloc_cache_init();
+#endif
+#if defined(CONFIG_MALLOC_PROFILE) && (CONFIG_MALLOC_PROFILE > 0)
+	if(__heap_pool)
+		malloc_profile_init();
 #endif
 	kobj_add_regular(search_class_memory_kobj(), "meminfo", memory_read_meminfo, NULL, NULL);
+#if defined(CONFIG_MALLOC_CACHE) && (CONFIG_MALLOC_CACHE > 0)
+	kobj_add_regular(search_class_memory_kobj(), "cache", memory_read_cache, NULL, NULL);
+#endif
 }
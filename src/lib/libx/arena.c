@@ -0,0 +1,184 @@
+/*
+ * libx/arena.c
+ */
+
+#include <stddef.h>
+#include <string.h>
+#include <malloc.h>
+#include <arena.h>
+#include <xboot/module.h>
+
+#define ARENA_ALIGN(x)	(((x) + 15) & ~((size_t)15))
+
+static struct arena_chunk_t * arena_chunk_alloc(size_t size)
+{
+	struct arena_chunk_t * c;
+
+	c = malloc(sizeof(struct arena_chunk_t) + size);
+	if(!c)
+		return NULL;
+	c->next = NULL;
+	c->size = size;
+	c->used = 0;
+	return c;
+}
+
+struct arena_t * arena_alloc(size_t chunksz)
+{
+	struct arena_t * a;
+
+	a = malloc(sizeof(struct arena_t));
+	if(!a)
+		return NULL;
+	a->head = NULL;
+	a->cur = NULL;
+	a->chunksz = ARENA_ALIGN(chunksz > 0 ? chunksz : 64 * 1024);
+	a->used = 0;
+	a->peak = 0;
+	return a;
+}
+EXPORT_SYMBOL(arena_alloc);
+
+void arena_free(struct arena_t * a)
+{
+	struct arena_chunk_t * c, * n;
+
+	if(a)
+	{
+		for(c = a->head; c; c = n)
+		{
+			n = c->next;
+			free(c);
+		}
+		free(a);
+	}
+}
+EXPORT_SYMBOL(arena_free);
+
+/*
+ * Bump the pointer of the current chunk, or move on to the next chunk that
+ * fits. A chunk too small for the request is skipped, and a new chunk is
+ * linked in after the current one when none is left.
+ */
+void * arena_malloc(struct arena_t * a, size_t size)
+{
+	struct arena_chunk_t * c, * n;
+	void * p;
+
+	if(!a)
+		return NULL;
+	size = ARENA_ALIGN(size > 0 ? size : 1);
+
+	c = a->cur;
+	if(!c || (c->used + size > c->size))
+	{
+		n = c ? c->next : a->head;
+		while(n && (n->size < size))
+		{
+			n->used = 0;
+			c = n;
+			n = n->next;
+		}
+		if(!n)
+		{
+			n = arena_chunk_alloc(size > a->chunksz ? size : a->chunksz);
+			if(!n)
+				return NULL;
+			if(c)
+			{
+				n->next = c->next;
+				c->next = n;
+			}
+			else
+			{
+				n->next = a->head;
+				a->head = n;
+			}
+		}
+		n->used = 0;
+		a->cur = c = n;
+	}
+	p = &c->mem[c->used];
+	c->used += size;
+	a->used += size;
+	if(a->used > a->peak)
+		a->peak = a->used;
+	return p;
+}
+EXPORT_SYMBOL(arena_malloc);
+
+void * arena_calloc(struct arena_t * a, size_t size)
+{
+	void * p = arena_malloc(a, size);
+
+	if(p)
+		memset(p, 0, size);
+	return p;
+}
+EXPORT_SYMBOL(arena_calloc);
+
+/*
+ * The last block of the current chunk grows in place, any other block is
+ * copied into a new one. The old space is reclaimed on the next release.
+ */
+void * arena_realloc(struct arena_t * a, void * ptr, size_t osize, size_t nsize)
+{
+	struct arena_chunk_t * c;
+	size_t o, n;
+	void * p;
+
+	if(!a)
+		return NULL;
+	if(!ptr)
+		return arena_malloc(a, nsize);
+
+	c = a->cur;
+	o = ARENA_ALIGN(osize > 0 ? osize : 1);
+	n = ARENA_ALIGN(nsize > 0 ? nsize : 1);
+	if(c && ((unsigned char *)ptr + o == &c->mem[c->used]) && (c->used - o + n <= c->size))
+	{
+		c->used = c->used - o + n;
+		a->used = a->used - o + n;
+		if(a->used > a->peak)
+			a->peak = a->used;
+		return ptr;
+	}
+	p = arena_malloc(a, nsize);
+	if(p)
+		memcpy(p, ptr, osize < nsize ? osize : nsize);
+	return p;
+}
+EXPORT_SYMBOL(arena_realloc);
+
+void arena_mark(struct arena_t * a, struct arena_mark_t * m)
+{
+	if(a && m)
+	{
+		m->chunk = a->cur;
+		m->used = a->cur ? a->cur->used : 0;
+		m->total = a->used;
+	}
+}
+EXPORT_SYMBOL(arena_mark);
+
+void arena_release(struct arena_t * a, struct arena_mark_t * m)
+{
+	if(a && m)
+	{
+		a->cur = m->chunk;
+		if(a->cur)
+			a->cur->used = m->used;
+		a->used = m->total;
+	}
+}
+EXPORT_SYMBOL(arena_release);
+
+void arena_reset(struct arena_t * a)
+{
+	if(a)
+	{
+		a->cur = NULL;
+		a->used = 0;
+	}
+}
+EXPORT_SYMBOL(arena_reset);
@@ -7,6 +7,7 @@
 #include <math.h>
 #include <stdio.h>
 #include <malloc.h>
+#include <xboot/slab.h>
 #include <json.h>
 
 enum {
@@ -69,6 +70,8 @@ static unsigned char hex_value(char c)
 	}
 }
 
+static KMEM_CACHE_DEFINE(__json_value_cache, "json_value", sizeof(struct json_value_t), 0, NULL, NULL);
+
 static void * json_alloc(struct json_state_t * state, unsigned long size, int zero)
 {
 	if((state->ulong_max - state->used_memory) < size)
@@ -122,7 +125,9 @@ static int new_value(struct json_state_t * state, struct json_value_t ** top, st
 		return 1;
 	}
 
-	if(!(value = (struct json_value_t *)json_alloc(state, sizeof(struct json_value_t), 1)))
+	if((state->ulong_max - state->used_memory) < sizeof(struct json_value_t))
+		return 0;
+	if(!(value = (struct json_value_t *)kmem_cache_zalloc(&__json_value_cache)))
 		return 0;
 
 	if(!*root)
@@ -825,7 +830,7 @@ e_failed:
 	while(alloc)
 	{
 		top = alloc->reserved.next_alloc;
-		free(alloc);
+		kmem_cache_free(&__json_value_cache, alloc);
 		alloc = top;
 	}
 	if(!state.first_pass)
@@ -873,6 +878,6 @@ void json_free(struct json_value_t * value)
 
 		v = value;
 		value = value->parent;
-		free(v);
+		kmem_cache_free(&__json_value_cache, v);
 	}
 }
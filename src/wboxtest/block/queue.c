@@ -0,0 +1,167 @@
+/*
+ * wboxtest/block/queue.c
+ */
+
+#include <wboxtest.h>
+
+#define QUEUE_NREQ		(32)
+#define QUEUE_BLKCNT	(8)
+
+struct wbt_queue_pdata_t
+{
+	struct block_t * blk;
+	unsigned char * rambuf;
+	unsigned char * buf;
+	struct block_request_t req[QUEUE_NREQ];
+	struct semaphore_t sem;
+};
+
+static void queue_complete(struct block_request_t * req)
+{
+	semaphore_up((struct semaphore_t *)req->data);
+}
+
+static void * queue_setup(struct wboxtest_t * wbt)
+{
+	struct wbt_queue_pdata_t * pdat;
+	char json[256];
+	int length;
+
+	pdat = malloc(sizeof(struct wbt_queue_pdata_t));
+	if(!pdat)
+		return NULL;
+
+	pdat->rambuf = malloc(SZ_1M);
+	pdat->buf = malloc(SZ_1M);
+	if(!pdat->rambuf || !pdat->buf)
+	{
+		free(pdat->rambuf);
+		free(pdat->buf);
+		free(pdat);
+		return NULL;
+	}
+
+	length = sprintf(json,
+		"{\"blk-ramdisk@998\":{\"address\":%lld,\"size\":%lld}}",
+		(unsigned long long)((virtual_addr_t)pdat->rambuf),
+		(unsigned long long)((virtual_size_t)SZ_1M));
+	probe_device(json, length, NULL);
+
+	pdat->blk = search_block("blk-ramdisk.998");
+	if(!pdat->blk)
+	{
+		free(pdat->rambuf);
+		free(pdat->buf);
+		free(pdat);
+		return NULL;
+	}
+	semaphore_init(&pdat->sem, 0);
+
+	return pdat;
+}
+
+static void queue_clean(struct wboxtest_t * wbt, void * data)
+{
+	struct wbt_queue_pdata_t * pdat = (struct wbt_queue_pdata_t *)data;
+
+	if(pdat)
+	{
+		unregister_block(pdat->blk);
+		free(pdat->rambuf);
+		free(pdat->buf);
+		free(pdat);
+	}
+}
+
+static void queue_batch(struct wbt_queue_pdata_t * pdat, int write, u64_t blkno)
+{
+	u64_t blksz = block_size(pdat->blk);
+	int i;
+
+	for(i = 0; i < QUEUE_NREQ; i++)
+	{
+		pdat->req[i].write = write;
+		pdat->req[i].blkno = blkno + i * QUEUE_BLKCNT;
+		pdat->req[i].blkcnt = QUEUE_BLKCNT;
+		pdat->req[i].buf = pdat->buf + i * QUEUE_BLKCNT * blksz;
+		pdat->req[i].complete = queue_complete;
+		pdat->req[i].data = &pdat->sem;
+	}
+	for(i = QUEUE_NREQ - 1; i >= 0; i--)
+		block_submit(pdat->blk, &pdat->req[i]);
+	for(i = 0; i < QUEUE_NREQ; i++)
+		semaphore_down(&pdat->sem);
+}
+
+static void queue_run(struct wboxtest_t * wbt, void * data)
+{
+	struct wbt_queue_pdata_t * pdat = (struct wbt_queue_pdata_t *)data;
+	u64_t blksz, len, bytes;
+	ktime_t t1, t2;
+	char buf[32];
+	char * ref;
+	int i;
+
+	if(pdat)
+	{
+		blksz = block_size(pdat->blk);
+		len = QUEUE_NREQ * QUEUE_BLKCNT * blksz;
+		if((len > SZ_1M) || (QUEUE_NREQ * QUEUE_BLKCNT > block_count(pdat->blk)))
+			return;
+		ref = malloc(len);
+		if(!ref)
+			return;
+
+		wboxtest_random_buffer((char *)pdat->buf, len);
+		memcpy(ref, pdat->buf, len);
+		queue_batch(pdat, 1, 0);
+		for(i = 0; i < QUEUE_NREQ; i++)
+			assert_equal(pdat->req[i].done, QUEUE_BLKCNT);
+		memset(pdat->buf, 0, len);
+		block_read(pdat->blk, pdat->buf, 0, len);
+		assert_memory_equal(pdat->buf, ref, len);
+		memset(pdat->buf, 0, len);
+		queue_batch(pdat, 0, 0);
+		assert_memory_equal(pdat->buf, ref, len);
+		free(ref);
+
+		bytes = 0;
+		t2 = t1 = ktime_get();
+		do {
+			for(i = 0; i < QUEUE_NREQ; i++)
+				bytes += block_read(pdat->blk, pdat->buf + i * QUEUE_BLKCNT * blksz, i * QUEUE_BLKCNT * blksz, QUEUE_BLKCNT * blksz);
+			t2 = ktime_get();
+		} while(ktime_before(t2, ktime_add_ms(t1, 1000)));
+		wboxtest_print(" Synchronous: %s/s\r\n", ssize(buf, (double)bytes * 1000.0 / ktime_ms_delta(t2, t1)));
+
+		bytes = 0;
+		t2 = t1 = ktime_get();
+		do {
+			queue_batch(pdat, 0, 0);
+			bytes += len;
+			t2 = ktime_get();
+		} while(ktime_before(t2, ktime_add_ms(t1, 1000)));
+		wboxtest_print(" Queued: %s/s\r\n", ssize(buf, (double)bytes * 1000.0 / ktime_ms_delta(t2, t1)));
+	}
+}
+
+static struct wboxtest_t wbt_queue = {
+	.group	= "block",
+	.name	= "queue",
+	.setup	= queue_setup,
+	.clean	= queue_clean,
+	.run	= queue_run,
+};
+
+static __init void queue_wbt_init(void)
+{
+	register_wboxtest(&wbt_queue);
+}
+
+static __exit void queue_wbt_exit(void)
+{
+	unregister_wboxtest(&wbt_queue);
+}
+
+wboxtest_initcall(queue_wbt_init);
+wboxtest_exitcall(queue_wbt_exit);
@@ -60,7 +60,7 @@ static void ramdisk_run(struct wboxtest_t * wbt, void * data)
 {
 	struct wbt_ramdisk_pdata_t * pdat = (struct wbt_ramdisk_pdata_t *)data;
 	u64_t blkno, blkcnt;
-	char * buf1, * buf2;
+	char * buf1, * buf2, * p;
 	int len;
 
 	if(pdat)
@@ -90,6 +90,11 @@ static void ramdisk_run(struct wboxtest_t * wbt, void * data)
 		block_read(pdat->blk, (u8_t *)buf2, block_size(pdat->blk) * blkno, block_size(pdat->blk) * blkcnt);
 		assert_memory_equal(buf1, buf2, len);
 
+		p = block_mmap(pdat->blk, block_size(pdat->blk) * blkno, block_size(pdat->blk) * blkcnt);
+		assert_equal(p, (char *)&pdat->rambuf[block_size(pdat->blk) * blkno]);
+		assert_memory_equal(buf1, p, len);
+		assert_null(block_mmap(pdat->blk, block_capacity(pdat->blk), 1));
+
 		free(buf1);
 		free(buf2);
 	}
@@ -33,8 +33,8 @@ static void * dmacpy_setup(struct wboxtest_t * wbt)
 	pdat->dst = dma_alloc_coherent(pdat->size);
 	if(!pdat->src || !pdat->dst)
 	{
-		free(pdat->src);
-		free(pdat->dst);
+		dma_free_coherent(pdat->src);
+		dma_free_coherent(pdat->dst);
 		free(pdat);
 		return NULL;
 	}
@@ -0,0 +1,120 @@
+/*
+ * wboxtest/dma/dmapool.c
+ */
+
+#include <dma/dmapool.h>
+#include <wboxtest.h>
+
+#define DMAPOOL_NBUF		(64)
+
+struct wbt_dmapool_pdata_t
+{
+	void * buf[DMAPOOL_NBUF];
+	unsigned long size[DMAPOOL_NBUF];
+
+	ktime_t t1;
+	ktime_t t2;
+	int calls;
+};
+
+static void * dmapool_setup(struct wboxtest_t * wbt)
+{
+	struct wbt_dmapool_pdata_t * pdat;
+
+	pdat = malloc(sizeof(struct wbt_dmapool_pdata_t));
+	if(!pdat)
+		return NULL;
+	memset(pdat, 0, sizeof(struct wbt_dmapool_pdata_t));
+
+	return pdat;
+}
+
+static void dmapool_clean(struct wboxtest_t * wbt, void * data)
+{
+	struct wbt_dmapool_pdata_t * pdat = (struct wbt_dmapool_pdata_t *)data;
+	int i;
+
+	if(pdat)
+	{
+		for(i = 0; i < DMAPOOL_NBUF; i++)
+		{
+			if(pdat->buf[i])
+				dma_free_coherent(pdat->buf[i]);
+		}
+		free(pdat);
+	}
+}
+
+static void dmapool_run(struct wboxtest_t * wbt, void * data)
+{
+	struct wbt_dmapool_pdata_t * pdat = (struct wbt_dmapool_pdata_t *)data;
+	struct dma_pool_info_t info;
+	unsigned long align;
+	int i, j;
+
+	if(pdat)
+	{
+		for(i = 0; i < DMAPOOL_NBUF; i++)
+		{
+			pdat->size[i] = wboxtest_random_int(1, (i & 0x3) ? 2048 : SZ_64K);
+			pdat->buf[i] = dma_alloc_coherent(pdat->size[i]);
+			assert_not_null(pdat->buf[i]);
+			if(pdat->buf[i])
+			{
+				for(align = 64; (align < pdat->size[i]) && (align < SZ_4K); align <<= 1);
+				assert_equal((unsigned long)pdat->buf[i] & (align - 1), 0);
+				memset(pdat->buf[i], i, pdat->size[i]);
+			}
+		}
+		for(i = 0; i < DMAPOOL_NBUF; i++)
+		{
+			for(j = 0; pdat->buf[i] && (j < pdat->size[i]); j++)
+			{
+				if(((unsigned char *)pdat->buf[i])[j] != (unsigned char)i)
+					break;
+			}
+			assert_true(!pdat->buf[i] || (j == pdat->size[i]));
+			dma_free_coherent(pdat->buf[i]);
+			pdat->buf[i] = NULL;
+		}
+
+		pdat->calls = 0;
+		pdat->t2 = pdat->t1 = ktime_get();
+		do {
+			for(i = 0; i < DMAPOOL_NBUF; i++)
+				pdat->buf[i] = dma_alloc_coherent((i & 0x3) ? SZ_512 : SZ_16K);
+			for(i = 0; i < DMAPOOL_NBUF; i++)
+			{
+				dma_free_coherent(pdat->buf[i]);
+				pdat->buf[i] = NULL;
+			}
+			pdat->calls += DMAPOOL_NBUF;
+			pdat->t2 = ktime_get();
+		} while(ktime_before(pdat->t2, ktime_add_ms(pdat->t1, 2000)));
+		wboxtest_print(" Throughput: %d allocs/s\r\n", (int)((double)pdat->calls * 1000.0 / ktime_ms_delta(pdat->t2, pdat->t1)));
+
+		dma_pool_info(&info);
+		wboxtest_print(" Pool: %lu used, %lu peak, %lu largest free, %lu fails\r\n", info.used, info.peak, info.largest, info.fails);
+	}
+}
+
+static struct wboxtest_t wbt_dmapool = {
+	.group	= "dma",
+	.name	= "dmapool",
+	.setup	= dmapool_setup,
+	.clean	= dmapool_clean,
+	.run	= dmapool_run,
+};
+
+static __init void dmapool_wbt_init(void)
+{
+	register_wboxtest(&wbt_dmapool);
+}
+
+static __exit void dmapool_wbt_exit(void)
+{
+	unregister_wboxtest(&wbt_dmapool);
+}
+
+wboxtest_initcall(dmapool_wbt_init);
+wboxtest_exitcall(dmapool_wbt_exit);